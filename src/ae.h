@@ -154,6 +154,9 @@ typedef struct aeEventLoop {
     // 在处理事件前要执行的函数
     aeBeforeSleepProc *beforesleep;
 
+    // 在等待事件返回之后要执行的函数
+    aeBeforeSleepProc *aftersleep;
+
 } aeEventLoop;
 
 /* Prototypes */
@@ -173,6 +176,7 @@ int aeWait(int fd, int mask, long long milliseconds);
 void aeMain(aeEventLoop *eventLoop);
 char *aeGetApiName(void);
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep);
+void aeSetAfterSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *aftersleep);
 int aeGetSetSize(aeEventLoop *eventLoop);
 int aeResizeSetSize(aeEventLoop *eventLoop, int setsize);
 
@@ -34,6 +34,15 @@ void aofUpdateCurrentSize(void);
  * 因为分配一个非常大的空间并不总是可能的，也可能产生大量的复制工作，
  * 所以这里使用多个大小为 AOF_RW_BUF_BLOCK_SIZE 的空间来保存命令。
  *
+ * While the child is running, the buffer is continuously sent to it over a
+ * pipe, so that it can append most of the differences to the new AOF by
+ * itself. This way the buffer does not grow with the length of the rewrite,
+ * and the parent only has to write a small residual once the child exits.
+ *
+ * 在子进程运行期间，缓存中的内容会通过管道被不断发送给子进程，
+ * 由子进程将大部分差异追加到新的 AOF 文件中。
+ * 这样缓存不会随着重写时间增长，父进程在重写完成后只需要写入少量剩余内容。
+ *
  * ------------------------------------------------------------------------- */
 
 // 每个缓存块的大小
@@ -82,6 +91,44 @@ unsigned long aofRewriteBufferSize(void) {
     return size;
 }
 
+/* Event handler used to send data to the child process doing the AOF
+ * rewrite. We send pieces of our AOF differences buffer so that the final
+ * write when the child finishes the rewrite will be small.
+ *
+ * 将重写缓存中的内容发送给执行重写的子进程，
+ * 这样子进程退出之后父进程只需要写入很少的数据。 */
+void aofChildWriteDiffData(aeEventLoop *el, int fd, void *privdata, int mask) {
+    listNode *ln;
+    aofrwblock *block;
+    ssize_t nwritten;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(privdata);
+    REDIS_NOTUSED(mask);
+
+    while(1) {
+        ln = listFirst(server.aof_rewrite_buf_blocks);
+        block = ln ? ln->value : NULL;
+
+        // 子进程已经不再接收差异，或者缓存已经发送完毕
+        if (server.aof_stop_sending_diff || !block) {
+            aeDeleteFileEvent(server.el,server.aof_pipe_write_data_to_child,
+                              AE_WRITABLE);
+            return;
+        }
+        if (block->used > 0) {
+            nwritten = write(server.aof_pipe_write_data_to_child,
+                             block->buf,block->used);
+            if (nwritten <= 0) return;
+            memmove(block->buf,block->buf+nwritten,block->used-nwritten);
+            block->used -= nwritten;
+            block->free += nwritten;
+        }
+        // 缓存块已经全部发送，释放它
+        if (block->used == 0) listDelNode(server.aof_rewrite_buf_blocks,ln);
+    }
+}
+
 /*
  * 将字符数组 s 追加到 AOF 缓存的末尾，
  * 如果有需要的话，分配一个新的缓存块。
@@ -136,6 +183,17 @@ void aofRewriteBufferAppend(unsigned char *s, unsigned long len) {
             }
         }
     }
+
+    /* Install a file event to send data to the rewrite child if there is
+     * not one already.
+     *
+     * 安装一个写事件处理器，将缓存发送给子进程 */
+    if (!server.aof_stop_sending_diff &&
+        aeGetFileEvents(server.el,server.aof_pipe_write_data_to_child) == 0)
+    {
+        aeCreateFileEvent(server.el, server.aof_pipe_write_data_to_child,
+            AE_WRITABLE, aofChildWriteDiffData, NULL);
+    }
 }
 
 /*
@@ -177,6 +235,789 @@ void aof_background_fsync(int fd) {
     bioCreateBackgroundJob(REDIS_BIO_AOF_FSYNC,(void*)(long)fd,NULL,NULL);
 }
 
+/* ------------------------ AOF writer with group commit ----------------------
+ *
+ * AOF 写线程和组提交
+ *
+ * With appendfsync always, flushAppendOnlyFile() used to write() and fsync()
+ * the AOF buffer in beforeSleep(), so every iteration of the event loop
+ * waited for the disk. When server.aof_group_commit is also set, the buffer
+ * is instead handed to a writer thread that writes it and calls fsync().
+ * Buffers handed while an fsync is in progress are written together and
+ * covered by the next single fsync, so the cost of the fsync is shared by
+ * all the clients that wrote in the meantime.
+ *
+ * 在 appendfsync always 模式下，如果打开了 aof_group_commit ，
+ * 那么 AOF 缓存会被交给写线程写入并 fsync 。
+ * 在 fsync 期间交给写线程的缓存会一起被写入，并由下一次 fsync 覆盖，
+ * 这样多个客户端的写入只需要一次 fsync 。
+ *
+ * The durability contract is kept holding the replies: call() records in
+ * c->aof_sync_offset the AOF offset reached when any command (reads too,
+ * since they can observe writes not yet fsynced) returned, and
+ * sendReplyToClient() does not send anything to the client until
+ * server.aof_synced_offset gets there. The writer thread signals completed
+ * fsyncs through a pipe, and aofWriterNotifyHandler() installs again the
+ * write handler of the clients that can receive their replies.
+ *
+ * 为了保证持久性，命令的回复会被推迟到 AOF 被 fsync 到命令的偏移量之后才发送。 */
+
+static struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;   /* Signaled when buffers are queued. */
+    pthread_cond_t done_cond;   /* Signaled when an fsync completes. */
+    list *queue;                /* sds buffers to write. */
+    int fd;                     /* AOF file descriptor. */
+    int nofsync;                /* Write without fsync (no-appendfsync-on-rewrite). */
+    long long queued;           /* AOF offset after the last queued byte. */
+    long long synced;           /* AOF offset durable on disk. */
+    int error;                  /* errno of the first failed write or fsync. */
+    int pipe[2];                /* Used to wake up the event loop. */
+    int started;
+} aofWriter;
+
+void *aofWriterMain(void *arg) {
+    sigset_t sigset;
+
+    REDIS_NOTUSED(arg);
+
+    /* Make sure only the main thread receives the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    pthread_mutex_lock(&aofWriter.mutex);
+    while(1) {
+        list *batch;
+        listNode *ln;
+        long long target;
+        int fd, nofsync, err = 0;
+        char token = 'x';
+
+        if (listLength(aofWriter.queue) == 0) {
+            pthread_cond_wait(&aofWriter.work_cond,&aofWriter.mutex);
+            continue;
+        }
+
+        // 取出所有排队的缓存，它们将被同一次 fsync 覆盖
+        batch = aofWriter.queue;
+        aofWriter.queue = listCreate();
+        target = aofWriter.queued;
+        fd = aofWriter.fd;
+        nofsync = aofWriter.nofsync;
+        pthread_mutex_unlock(&aofWriter.mutex);
+
+        while ((ln = listFirst(batch)) != NULL) {
+            sds buf = listNodeValue(ln);
+            size_t len = sdslen(buf), off = 0;
+
+            while (!err && off < len) {
+                ssize_t nwritten = write(fd,buf+off,len-off);
+
+                if (nwritten == -1 && errno == EINTR) continue;
+                if (nwritten <= 0) {
+                    err = nwritten == -1 ? errno : EIO;
+                    break;
+                }
+                off += nwritten;
+            }
+            sdsfree(buf);
+            listDelNode(batch,ln);
+        }
+        listRelease(batch);
+        if (!err && !nofsync && aof_fsync(fd) == -1) err = errno;
+
+        pthread_mutex_lock(&aofWriter.mutex);
+        if (err && !aofWriter.error) aofWriter.error = err;
+        if (!err) aofWriter.synced = target;
+        pthread_cond_broadcast(&aofWriter.done_cond);
+        /* Wake up the event loop. If the pipe is full a wake up is already
+         * pending, so the error can be ignored. */
+        if (write(aofWriter.pipe[1],&token,1) == -1) {
+            /* Nothing to do. */
+        }
+    }
+    return NULL;
+}
+
+/* Let the clients whose replies are now durable receive them. */
+// 为回复已经可以发送的客户端重新安装写处理器
+static void aofReleaseWaitingClients(void) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(server.clients_waiting_aof,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        redisClient *c = listNodeValue(ln);
+
+        if (c->aof_sync_offset > server.aof_synced_offset) continue;
+        c->flags &= ~REDIS_AOF_WAIT;
+        listDelNode(server.clients_waiting_aof,ln);
+        if ((c->bufpos || listLength(c->reply)) &&
+            aeCreateFileEvent(server.el,c->fd,AE_WRITABLE,
+                sendReplyToClient,c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+}
+
+/* Read the synced offset published by the writer thread. With the AOF
+ * fsync policy set to always we can't recover from write errors, exactly
+ * like flushAppendOnlyFile() does. */
+static void aofWriterUpdateSynced(void) {
+    int err;
+
+    pthread_mutex_lock(&aofWriter.mutex);
+    err = aofWriter.error;
+    server.aof_synced_offset = aofWriter.synced;
+    pthread_mutex_unlock(&aofWriter.mutex);
+    if (err) {
+        redisLog(REDIS_WARNING,"Error writing to the AOF file: %s",
+            strerror(err));
+        redisLog(REDIS_WARNING,"Can't recover from AOF write error when the AOF fsync policy is 'always'. Exiting...");
+        exit(1);
+    }
+    server.aof_last_fsync = server.unixtime;
+    aofReleaseWaitingClients();
+}
+
+// 写线程完成 fsync 之后，由事件循环调用
+void aofWriterNotifyHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    char buf[64];
+
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(privdata);
+    REDIS_NOTUSED(mask);
+
+    while (read(fd,buf,sizeof(buf)) > 0);
+    aofWriterUpdateSynced();
+}
+
+// 创建写线程以及用于唤醒事件循环的管道
+static void aofWriterInit(void) {
+    pthread_mutex_init(&aofWriter.mutex,NULL);
+    pthread_cond_init(&aofWriter.work_cond,NULL);
+    pthread_cond_init(&aofWriter.done_cond,NULL);
+    aofWriter.queue = listCreate();
+    aofWriter.queued = aofWriter.synced = server.aof_synced_offset;
+    aofWriter.error = 0;
+    if (pipe(aofWriter.pipe) == -1 ||
+        anetNonBlock(NULL,aofWriter.pipe[0]) == ANET_ERR ||
+        anetNonBlock(NULL,aofWriter.pipe[1]) == ANET_ERR ||
+        aeCreateFileEvent(server.el,aofWriter.pipe[0],AE_READABLE,
+            aofWriterNotifyHandler,NULL) == AE_ERR ||
+        pthread_create(&aofWriter.thread,NULL,aofWriterMain,NULL) != 0)
+    {
+        redisLog(REDIS_WARNING,"Fatal: Can't initialize the AOF writer thread.");
+        exit(1);
+    }
+    aofWriter.started = 1;
+}
+
+/* Hand the AOF buffer to the writer thread. */
+// 将 AOF 缓存交给写线程
+static void aofWriterSubmit(void) {
+    size_t len = sdslen(server.aof_buf);
+
+    if (!aofWriter.started) aofWriterInit();
+    pthread_mutex_lock(&aofWriter.mutex);
+    listAddNodeTail(aofWriter.queue,server.aof_buf);
+    aofWriter.queued += len;
+    aofWriter.fd = server.aof_fd;
+    aofWriter.nofsync = server.aof_no_fsync_on_rewrite &&
+        (server.aof_child_pid != -1 || server.rdb_child_pid != -1);
+    pthread_cond_signal(&aofWriter.work_cond);
+    pthread_mutex_unlock(&aofWriter.mutex);
+
+    server.aof_buf = sdsempty();
+    server.aof_queued_offset += len;
+    server.aof_current_size += len;
+}
+
+/* Block until everything handed to the writer thread is on disk. Must be
+ * called before writing to the AOF from the main thread, and before the
+ * AOF file descriptor is changed or closed.
+ *
+ * 阻塞直到交给写线程的数据全部写入磁盘。
+ * 在主线程写入 AOF 文件，或者修改、关闭 AOF 文件描述符之前必须调用。 */
+void aofWriterDrain(void) {
+    if (!aofWriter.started) return;
+    pthread_mutex_lock(&aofWriter.mutex);
+    while (aofWriter.synced != aofWriter.queued && !aofWriter.error)
+        pthread_cond_wait(&aofWriter.done_cond,&aofWriter.mutex);
+    pthread_mutex_unlock(&aofWriter.mutex);
+    aofWriterUpdateSynced();
+}
+
+/* Return the AOF offset that would be reached if the AOF buffer was
+ * written now. */
+// 返回 AOF 缓存被写入之后， AOF 文件将会到达的偏移量
+long long aofBufferedOffset(void) {
+    return server.aof_queued_offset + sdslen(server.aof_buf);
+}
+
+/* Return true if the replies of 'c' must be held since the AOF is not yet
+ * durable up to the last write command of the client. */
+// 客户端的最后一个写命令还没有被 fsync 到 AOF 文件时返回真
+int aofClientMustWait(redisClient *c) {
+    return c->aof_sync_offset > server.aof_synced_offset;
+}
+
+/* Clients blocked on lists are served by handleClientsBlockedOnLists()
+ * outside call(), so call() does not set their AOF offset. Called after
+ * serving them: 'last' is the tail of server.unblocked_clients, and
+ * unblockClient() appended the served clients after it. Their replies are
+ * held like the ones of the commands, since they carry the elements pushed
+ * by writes that may not be fsynced yet.
+ *
+ * 被阻塞在列表上的客户端在 call() 之外被服务，所以 call() 不会设置它们的偏移量。
+ * 和命令一样推迟这些客户端的回复。 */
+void aofHoldUnblockedClients(listNode *last) {
+    listNode *ln;
+
+    if (!server.aof_group_commit || server.aof_fsync != AOF_FSYNC_ALWAYS)
+        return;
+
+    ln = last ? listNextNode(last) : listFirst(server.unblocked_clients);
+    for (; ln; ln = listNextNode(ln)) {
+        redisClient *c = listNodeValue(ln);
+
+        c->aof_sync_offset = aofBufferedOffset();
+    }
+}
+
+/* ------------------------------ Multi part AOF ------------------------------
+ *
+ * 多文件 AOF
+ *
+ * When server.aof_multi_part is set the AOF is not a single file but a base
+ * file, the output of the last rewrite, followed by one or more incremental
+ * files that only receive appends. The list of files is kept in a small
+ * text manifest, "<appendfilename>.manifest", that is always replaced
+ * atomically with rename(2):
+ *
+ * 打开 aof_multi_part 之后，AOF 由一个基础文件（最近一次重写的结果）
+ * 和多个只追加的增量文件组成，文件列表保存在清单文件中，
+ * 清单文件总是通过 rename(2) 原子地替换：
+ *
+ *   seq 5
+ *   base appendonly.aof.3.base
+ *   incr appendonly.aof.4.incr
+ *   incr appendonly.aof.5.incr
+ *
+ * BGREWRITEAOF opens a new incremental file just before forking, so the
+ * child snapshot covers exactly the base and the incremental files written
+ * so far. The parent keeps appending to the new file, so it does not need
+ * to accumulate the differences in the rewrite buffer, and when the child
+ * is done the new base is just renamed in place and the manifest replaced,
+ * without writing anything else from the main thread.
+ *
+ * BGREWRITEAOF 在 fork 之前打开一个新的增量文件，子进程的快照正好覆盖
+ * 基础文件和之前的全部增量文件。父进程继续追加到新的增量文件中，
+ * 所以不再需要 AOF 重写缓存，重写完成时也只需要对新的基础文件改名并
+ * 替换清单文件，主线程不需要再写入重写缓存。
+ *
+ * The option is only read at startup. */
+
+typedef struct aofManifest {
+    sds base;               /* Base file, NULL if there is none. */
+    list *incr;             /* Incremental files, oldest first. */
+    long long seq;          /* Sequence number of the last file created. */
+    unsigned long covered;  /* Incr files included in the running rewrite. */
+} aofManifest;
+
+static aofManifest *aofManifestCurrent = NULL;
+
+static void aofSdsFree(void *ptr) {
+    sdsfree(ptr);
+}
+
+static aofManifest *aofManifestCreate(void) {
+    aofManifest *am = zmalloc(sizeof(*am));
+
+    am->base = NULL;
+    am->incr = listCreate();
+    listSetFreeMethod(am->incr,aofSdsFree);
+    am->seq = 0;
+    am->covered = 0;
+    return am;
+}
+
+static void aofManifestFree(aofManifest *am) {
+    if (am->base) sdsfree(am->base);
+    listRelease(am->incr);
+    zfree(am);
+}
+
+// 清单文件的名字
+static sds aofManifestFileName(void) {
+    return sdscatprintf(sdsempty(),"%s.manifest",server.aof_filename);
+}
+
+/* Load the manifest from disk. Returns NULL if it does not exist, and exits
+ * if it can't be read or is corrupted, since we can't guess the files the
+ * AOF is composed of. */
+static aofManifest *aofManifestLoad(void) {
+    sds filename = aofManifestFileName();
+    FILE *fp = fopen(filename,"r");
+    aofManifest *am;
+    char buf[1024];
+    int linenum = 0;
+
+    if (fp == NULL) {
+        if (errno != ENOENT) {
+            redisLog(REDIS_WARNING,"Fatal error: can't open the AOF manifest %s: %s",
+                filename, strerror(errno));
+            exit(1);
+        }
+        sdsfree(filename);
+        return NULL;
+    }
+
+    am = aofManifestCreate();
+    while(fgets(buf,sizeof(buf),fp) != NULL) {
+        sds line = sdstrim(sdsnew(buf)," \t\r\n");
+        sds *argv;
+        int argc, ok = 0;
+
+        linenum++;
+        if (line[0] == '#' || line[0] == '\0') {
+            sdsfree(line);
+            continue;
+        }
+        argv = sdssplitargs(line,&argc);
+        if (argv && argc == 2) {
+            ok = 1;
+            if (!strcasecmp(argv[0],"seq")) {
+                am->seq = strtoll(argv[1],NULL,10);
+            } else if (!strcasecmp(argv[0],"base") && am->base == NULL) {
+                am->base = sdsdup(argv[1]);
+            } else if (!strcasecmp(argv[0],"incr")) {
+                listAddNodeTail(am->incr,sdsdup(argv[1]));
+            } else {
+                ok = 0;
+            }
+        }
+        if (argv) sdsfreesplitres(argv,argc);
+        sdsfree(line);
+        if (!ok) {
+            redisLog(REDIS_WARNING,"Fatal error: bad line %d in the AOF manifest %s",
+                linenum, filename);
+            exit(1);
+        }
+    }
+    if (ferror(fp)) {
+        redisLog(REDIS_WARNING,"Fatal error: can't read the AOF manifest %s: %s",
+            filename, strerror(errno));
+        exit(1);
+    }
+    fclose(fp);
+    sdsfree(filename);
+    return am;
+}
+
+/* Write the manifest to a temp file, sync it and rename it in place, so
+ * that on disk there is always a complete manifest. */
+// 原子地将清单写入到磁盘
+static int aofManifestPersist(aofManifest *am) {
+    sds filename = aofManifestFileName();
+    sds tmpfile = sdscatprintf(sdsempty(),"%s.tmp",filename);
+    FILE *fp = fopen(tmpfile,"w");
+    listIter li;
+    listNode *ln;
+
+    if (fp == NULL) goto werr;
+    if (fprintf(fp,"seq %lld\n",am->seq) < 0) goto werr;
+    if (am->base && fprintf(fp,"base %s\n",am->base) < 0) goto werr;
+    listRewind(am->incr,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        if (fprintf(fp,"incr %s\n",(char*)listNodeValue(ln)) < 0) goto werr;
+    }
+    if (fflush(fp) == EOF) goto werr;
+    if (fsync(fileno(fp)) == -1) goto werr;
+    if (fclose(fp) == EOF) {
+        fp = NULL;
+        goto werr;
+    }
+    fp = NULL;
+    if (rename(tmpfile,filename) == -1) goto werr;
+    sdsfree(tmpfile);
+    sdsfree(filename);
+    return REDIS_OK;
+
+werr:
+    redisLog(REDIS_WARNING,"Error writing the AOF manifest %s: %s",
+        filename, strerror(errno));
+    if (fp) fclose(fp);
+    unlink(tmpfile);
+    sdsfree(tmpfile);
+    sdsfree(filename);
+    return REDIS_ERR;
+}
+
+// 为新的基础文件或者增量文件生成名字
+static sds aofManifestNextFileName(aofManifest *am, char *type) {
+    return sdscatprintf(sdsempty(),"%s.%lld.%s",
+        server.aof_filename, ++am->seq, type);
+}
+
+/* Sum the size of all the files of the AOF. */
+static off_t aofManifestSize(aofManifest *am) {
+    struct redis_stat sb;
+    listIter li;
+    listNode *ln;
+    off_t size = 0;
+
+    if (am->base && redis_stat(am->base,&sb) != -1) size += sb.st_size;
+    listRewind(am->incr,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        if (redis_stat(listNodeValue(ln),&sb) != -1) size += sb.st_size;
+    }
+    return size;
+}
+
+/* Unlink a file that is no longer referenced by the manifest, leaving the
+ * actual reclaim of the disk space, that happens on close, to a background
+ * thread. */
+// 删除不再被清单引用的文件，在后台线程中关闭它
+static void aofDeleteFileAsync(char *filename) {
+    int fd = open(filename,O_RDONLY|O_NONBLOCK);
+
+    if (unlink(filename) == -1 && errno != ENOENT)
+        redisLog(REDIS_WARNING,"Can't remove the old AOF file %s: %s",
+            filename, strerror(errno));
+    if (fd != -1)
+        bioCreateBackgroundJob(REDIS_BIO_CLOSE_FILE,(void*)(long)fd,NULL,NULL);
+}
+
+/* Add a new incremental file to the manifest and open it. When persist is
+ * true the manifest is written on disk before returning. Returns the file
+ * descriptor, or -1 on error. */
+static int aofOpenNewIncrFile(aofManifest *am, int persist) {
+    sds filename = aofManifestNextFileName(am,"incr");
+    int fd = open(filename,O_WRONLY|O_APPEND|O_CREAT,0644);
+
+    if (fd == -1) {
+        redisLog(REDIS_WARNING,"Can't open the AOF incremental file %s: %s",
+            filename, strerror(errno));
+        sdsfree(filename);
+        return -1;
+    }
+    listAddNodeTail(am->incr,filename);
+    if (persist && aofManifestPersist(am) == REDIS_ERR) {
+        listDelNode(am->incr,listLast(am->incr));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Open the file where the AOF should be appended: the configured file, or
+ * with a multi part AOF the last incremental file in the manifest. The
+ * manifest is created if needed, adopting a previous single file AOF as
+ * the base. Returns the file descriptor, or -1 on error. */
+// 打开 AOF 的追加目标文件
+int aofOpenCurrentFile(void) {
+    aofManifest *am;
+    struct redis_stat sb;
+
+    if (!server.aof_multi_part)
+        return open(server.aof_filename,O_WRONLY|O_APPEND|O_CREAT,0644);
+
+    if (aofManifestCurrent == NULL) {
+        aofManifestCurrent = aofManifestLoad();
+        if (aofManifestCurrent == NULL) {
+            aofManifestCurrent = aofManifestCreate();
+            if (redis_stat(server.aof_filename,&sb) != -1) {
+                redisLog(REDIS_NOTICE,
+                    "Using the append only file %s as the base of the multi part AOF",
+                    server.aof_filename);
+                aofManifestCurrent->base = sdsnew(server.aof_filename);
+            }
+        }
+    }
+    am = aofManifestCurrent;
+
+    if (listLength(am->incr) == 0) return aofOpenNewIncrFile(am,1);
+    return open(listNodeValue(listLast(am->incr)),O_WRONLY|O_APPEND|O_CREAT,0644);
+}
+
+/* Called before forking the rewrite child: switch the AOF to a new
+ * incremental file, so that everything appended from now on is not part
+ * of the snapshot the child is about to write. */
+// 在 fork 重写子进程之前，切换到新的增量文件
+static int aofMultiPartRewriteStart(void) {
+    aofManifest *am = aofManifestCurrent;
+    int newfd, oldfd = server.aof_fd;
+
+    if (am == NULL) am = aofManifestCurrent = aofManifestCreate();
+    am->covered = listLength(am->incr);
+
+    // AOF 被关闭时，新的基础文件直接取代全部旧文件
+    if (server.aof_fd == -1) return REDIS_OK;
+
+    // 将已有的写入全部写到旧的增量文件中
+    flushAppendOnlyFile(1);
+    aofWriterDrain();
+
+    /* Make the old file durable before switching to the new one. This is
+     * done synchronously: an fsync job and a close job would run in two
+     * different bio threads, so the file could be closed before the fsync
+     * started. */
+    // 在切换到新文件之前同步地 fsync 旧文件
+    if (server.aof_fsync != AOF_FSYNC_NO) {
+        aof_fsync(oldfd);
+        server.aof_last_fsync = server.unixtime;
+    }
+
+    /* While waiting for the first rewrite the files in the manifest are
+     * stale, so the new incremental file is only persisted together with
+     * the new base. */
+    newfd = aofOpenNewIncrFile(am,server.aof_state == REDIS_AOF_ON);
+    if (newfd == -1) return REDIS_ERR;
+    server.aof_fd = newfd;
+    server.aof_selected_db = -1; /* Make sure SELECT is re-issued */
+
+    // 在后台关闭旧文件
+    bioCreateBackgroundJob(REDIS_BIO_CLOSE_FILE,(void*)(long)oldfd,NULL,NULL);
+    return REDIS_OK;
+}
+
+/* Called when the rewrite child terminated with success: the temp file
+ * becomes the new base and the covered incremental files are dropped. */
+// 重写完成，将临时文件设为新的基础文件，并删除已经被覆盖的旧文件
+static int aofMultiPartRewriteDone(char *tmpfile) {
+    aofManifest *am = aofManifestCurrent, *newam = aofManifestCreate();
+    listIter li;
+    listNode *ln;
+    unsigned long j = 0;
+
+    newam->seq = am->seq;
+    newam->base = aofManifestNextFileName(newam,"base");
+    listRewind(am->incr,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        if (j++ >= am->covered)
+            listAddNodeTail(newam->incr,sdsdup(listNodeValue(ln)));
+    }
+
+    if (rename(tmpfile,newam->base) == -1) {
+        redisLog(REDIS_WARNING,
+            "Error trying to rename the temporary AOF file: %s", strerror(errno));
+        aofManifestFree(newam);
+        return REDIS_ERR;
+    }
+    if (aofManifestPersist(newam) == REDIS_ERR) {
+        unlink(newam->base);
+        aofManifestFree(newam);
+        return REDIS_ERR;
+    }
+
+    // 新的清单已经生效，删除旧的基础文件和被覆盖的增量文件
+    if (am->base) aofDeleteFileAsync(am->base);
+    j = 0;
+    listRewind(am->incr,&li);
+    while ((ln = listNext(&li)) != NULL && j++ < am->covered)
+        aofDeleteFileAsync(listNodeValue(ln));
+
+    aofManifestFree(am);
+    aofManifestCurrent = newam;
+    server.aof_current_size = aofManifestSize(newam);
+    server.aof_rewrite_base_size = server.aof_current_size;
+    return REDIS_OK;
+}
+
+/* Load every file of the AOF, the base first. */
+// 按照清单载入 AOF 的全部文件
+int loadAppendOnlyFiles(void) {
+    aofManifest *am = aofManifestCurrent;
+    listIter li;
+    listNode *ln;
+    int loaded = 0;
+
+    if (!server.aof_multi_part || am == NULL)
+        return loadAppendOnlyFile(server.aof_filename);
+
+    if (server.aof_load_stop_time)
+        redisLog(REDIS_WARNING,"Loading the AOF up to a point in time is not supported with a multi part AOF, loading all the files.");
+
+    if (am->base && loadAppendOnlyFile(am->base) == REDIS_OK) loaded++;
+    listRewind(am->incr,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        if (loadAppendOnlyFile(listNodeValue(ln)) == REDIS_OK) loaded++;
+    }
+    server.aof_current_size = aofManifestSize(am);
+    server.aof_rewrite_base_size = server.aof_current_size;
+    return loaded ? REDIS_OK : REDIS_ERR;
+}
+
+/* ------------------------------ AOF timestamps ------------------------------
+ *
+ * AOF 时间戳
+ *
+ * When server.aof_timestamp_enabled is set, feedAppendOnlyFile() precedes
+ * the commands with a "#TS:<unix time in ms>\r\n" annotation, at most once
+ * per millisecond. Annotations are never emitted inside a MULTI/EXEC block,
+ * so every annotation marks a point where the AOF can be cut.
+ *
+ * 打开 aof_timestamp_enabled 之后，feedAppendOnlyFile() 每毫秒最多一次
+ * 在命令之前写入 "#TS:<毫秒时间戳>\r\n" 注释。
+ * 注释不会出现在事务内部，所以每个注释都是一个可以截断 AOF 的位置。
+ *
+ * With a single file AOF, an entry "<time> <offset>\n" is also appended to
+ * "<appendfilename>.tsidx" every AOF_TSIDX_INTERVAL milliseconds, mapping
+ * the time of an annotation to its offset in the file. The index is just a
+ * hint: it is not synced, and every entry is checked against the AOF
+ * before being used. It is removed when the AOF is rewritten.
+ *
+ * 单文件 AOF 还会每隔 AOF_TSIDX_INTERVAL 毫秒将注释的时间和它在文件中的
+ * 偏移量写入到索引文件中。索引只是提示，使用前会在 AOF 中检查，
+ * 重写 AOF 时索引会被删除。
+ *
+ * When server.aof_load_stop_time is set the AOF is loaded up to that time:
+ * the file is cut at the first annotation after it, and a
+ * "#RESTORE:<time>\r\n" annotation is appended, so that the commands
+ * written after the restore are not discarded again on the next restart.
+ * The cut point is found seeking from the index when possible, otherwise
+ * while replaying the file.
+ *
+ * 设置了 aof_load_stop_time 时，AOF 只被载入到这个时间为止：
+ * 文件在这个时间之后的第一个注释处被截断，并追加 "#RESTORE:<time>\r\n" 注释，
+ * 这样恢复之后写入的命令在下次重启时不会再被丢弃。
+ * 如果可能的话，截断位置通过索引定位，否则在载入文件的过程中查找。
+ *
+ * Point in time loading is only supported with a single file AOF. */
+
+#define AOF_TSIDX_INTERVAL 1000 /* Milliseconds between index entries. */
+
+// 索引文件的名字
+static sds aofTimestampIndexFileName(void) {
+    return sdscatprintf(sdsempty(),"%s.tsidx",server.aof_filename);
+}
+
+/* Remember that the annotation for time 'ts' starts at 'offset'. */
+static void aofTimestampIndexAdd(long long ts, off_t offset) {
+    char line[64];
+    int len;
+
+    if (ts - server.aof_tsidx_last < AOF_TSIDX_INTERVAL) return;
+    server.aof_tsidx_last = ts;
+
+    if (server.aof_tsidx_fd == -1) {
+        sds filename = aofTimestampIndexFileName();
+
+        server.aof_tsidx_fd = open(filename,O_WRONLY|O_APPEND|O_CREAT,0644);
+        if (server.aof_tsidx_fd == -1)
+            redisLog(REDIS_WARNING,"Can't open the AOF timestamp index %s: %s",
+                filename, strerror(errno));
+        sdsfree(filename);
+        if (server.aof_tsidx_fd == -1) return;
+    }
+
+    len = snprintf(line,sizeof(line),"%lld %lld\n",ts,(long long)offset);
+    if (write(server.aof_tsidx_fd,line,len) != len) {
+        redisLog(REDIS_WARNING,"Error writing the AOF timestamp index: %s",
+            strerror(errno));
+        close(server.aof_tsidx_fd);
+        server.aof_tsidx_fd = -1;
+    }
+}
+
+/* Remove the index, since the offsets it contains refer to an AOF that
+ * was just replaced. */
+// AOF 文件被替换之后，删除索引
+static void aofTimestampIndexReset(void) {
+    sds filename = aofTimestampIndexFileName();
+
+    if (server.aof_tsidx_fd != -1) {
+        close(server.aof_tsidx_fd);
+        server.aof_tsidx_fd = -1;
+    }
+    unlink(filename);
+    sdsfree(filename);
+    server.aof_tsidx_last = 0;
+}
+
+/* Find the last index entry with time <= 'stop' and offset <= 'maxoff'.
+ * Returns REDIS_OK and fills 'ts' and 'offset' if there is one. */
+static int aofTimestampIndexLookup(long long stop, off_t maxoff,
+                                   long long *ts, off_t *offset)
+{
+    sds filename = aofTimestampIndexFileName();
+    FILE *fp = fopen(filename,"r");
+    long long t, o;
+    int found = 0;
+
+    sdsfree(filename);
+    if (fp == NULL) return REDIS_ERR;
+    while (fscanf(fp,"%lld %lld",&t,&o) == 2) {
+        if (t > stop || o > maxoff) break;
+        *ts = t;
+        *offset = o;
+        found = 1;
+    }
+    fclose(fp);
+    return found ? REDIS_OK : REDIS_ERR;
+}
+
+/* Drop the index entries at or after 'cut'. */
+static void aofTimestampIndexTruncate(off_t cut) {
+    sds filename = aofTimestampIndexFileName();
+    sds tmpfile = sdscatprintf(sdsempty(),"%s.tmp",filename);
+    FILE *fp = fopen(filename,"r"), *tmp;
+    long long t, o;
+
+    if (server.aof_tsidx_fd != -1) {
+        close(server.aof_tsidx_fd);
+        server.aof_tsidx_fd = -1;
+    }
+    if (fp == NULL) goto cleanup;
+    if ((tmp = fopen(tmpfile,"w")) == NULL) {
+        fclose(fp);
+        unlink(filename);
+        goto cleanup;
+    }
+    while (fscanf(fp,"%lld %lld",&t,&o) == 2 && o < cut)
+        fprintf(tmp,"%lld %lld\n",t,o);
+    fclose(fp);
+    // 索引只是提示，写入失败的话直接删除它
+    if (fclose(tmp) == EOF || rename(tmpfile,filename) == -1) {
+        unlink(tmpfile);
+        unlink(filename);
+    }
+
+cleanup:
+    sdsfree(tmpfile);
+    sdsfree(filename);
+}
+
+/* Cut the AOF at 'cut' and mark the restore point. Exits on error, since
+ * the dataset would not match the requested point in time. */
+// 在 cut 处截断 AOF 文件，并追加 RESTORE 注释
+static void aofTruncateToTimestamp(char *filename, off_t cut, long long stop) {
+    char marker[64];
+    int fd, len;
+
+    redisLog(REDIS_WARNING,
+        "Truncating the AOF at offset %lld to restore the dataset at %lld ms",
+        (long long)cut, stop);
+    len = snprintf(marker,sizeof(marker),"#RESTORE:%lld\r\n",stop);
+    if (truncate(filename,cut) == -1 ||
+        (fd = open(filename,O_WRONLY|O_APPEND)) == -1)
+    {
+        redisLog(REDIS_WARNING,"Can't truncate the AOF: %s",strerror(errno));
+        exit(1);
+    }
+    if (write(fd,marker,len) != len || aof_fsync(fd) == -1) {
+        redisLog(REDIS_WARNING,"Can't write the AOF restore point: %s",
+            strerror(errno));
+        exit(1);
+    }
+    close(fd);
+    aofTimestampIndexTruncate(cut);
+}
+
 //在用户通过CONFIG命令在运行时关闭AOF持久化调用
 void stopAppendOnly(void) {
 
@@ -186,6 +1027,7 @@ void stopAppendOnly(void) {
     // 将 AOF 缓存的内容写入并冲洗到 AOF 文件中
     // 参数 1 表示强制模式
     flushAppendOnlyFile(1);
+    aofWriterDrain();
 
     // 冲洗 AOF 文件
     aof_fsync(server.aof_fd);
@@ -217,6 +1059,7 @@ void stopAppendOnly(void) {
          * 清理未完成的 AOF 重写留下来的缓存和临时文件
          */
         aofRewriteBufferReset();
+        aofClosePipes();
         aofRemoveTempFile(server.aof_child_pid);
         server.aof_child_pid = -1;
         server.aof_rewrite_time_start = -1;
@@ -233,7 +1076,7 @@ int startAppendOnly(void) {
     server.aof_last_fsync = server.unixtime;
 
     // 打开 AOF 文件
-    server.aof_fd = open(server.aof_filename,O_WRONLY|O_APPEND|O_CREAT,0644);
+    server.aof_fd = aofOpenCurrentFile();
 
     redisAssert(server.aof_state == REDIS_AOF_OFF);
 
@@ -270,7 +1113,7 @@ int startAppendOnly(void) {
     server.aof_last_fsync = server.unixtime;
 
     // 打开 AOF 文件
-    server.aof_fd = open(server.aof_filename,O_WRONLY|O_APPEND|O_CREAT,0644);
+    server.aof_fd = aofOpenCurrentFile();
 
     redisAssert(server.aof_state == REDIS_AOF_OFF);
 
@@ -344,6 +1187,17 @@ void flushAppendOnlyFile(int force) {
     // 缓冲区中没有任何内容，直接返回
     if (sdslen(server.aof_buf) == 0) return;
 
+    /* Group commit: the writer thread writes and fsyncs the buffer.
+     * Otherwise make sure it is done with what it was given before writing
+     * from this thread. */
+    // 组提交：由写线程写入并 fsync ，否则先等待写线程完成之前的写入
+    if (server.aof_fsync == AOF_FSYNC_ALWAYS && server.aof_group_commit) {
+        aofWriterSubmit();
+        if (force) aofWriterDrain();
+        return;
+    }
+    if (server.aof_synced_offset != server.aof_queued_offset) aofWriterDrain();
+
     // 策略为每秒 FSYNC 
     if (server.aof_fsync == AOF_FSYNC_EVERYSEC)
         // 是否有 SYNC 正在后台进行？
@@ -502,6 +1356,9 @@ void flushAppendOnlyFile(int force) {
 
     // 更新写入后的 AOF 文件大小
     server.aof_current_size += nwritten;
+    server.aof_queued_offset += nwritten;
+    server.aof_synced_offset = server.aof_queued_offset;
+    if (listLength(server.clients_waiting_aof)) aofReleaseWaitingClients();
 
     /* Re-use AOF buffer when it is small enough. The maximum comes from the
      * arena size of 4k minus some overhead (but is otherwise arbitrary). 
@@ -661,6 +1518,25 @@ sds catAppendOnlyExpireAtCommand(sds buf, struct redisCommand *cmd, robj *key, r
 void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int argc) {
     sds buf = sdsempty();
     robj *tmpargv[3];
+    char *raw = NULL;
+    size_t rawlen = 0;
+
+    /* Annotate the time, unless we are in the middle of a transaction. */
+    // 写入时间戳注释，事务内部的命令之前不写入
+    if (server.aof_timestamp_enabled && cmd->proc != execCommand &&
+        (cmd->proc == multiCommand || server.current_client == NULL ||
+         !(server.current_client->flags & REDIS_MULTI)))
+    {
+        long long now = mstime();
+
+        if (now != server.aof_last_timestamp) {
+            if (server.aof_state == REDIS_AOF_ON && !server.aof_multi_part)
+                aofTimestampIndexAdd(now,
+                    server.aof_current_size+sdslen(server.aof_buf));
+            buf = sdscatprintf(buf,"#TS:%lld\r\n",now);
+            server.aof_last_timestamp = now;
+        }
+    }
 
     /* The DB this command was targeting is not the same as the last command
      * we appendend. To issue a SELECT command is needed. 
@@ -704,6 +1580,12 @@ void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int a
         buf = catAppendOnlyExpireAtCommand(buf,cmd,argv[1],argv[2]);
 
     // 其他命令
+    } else if (server.propagate_raw) {
+        /* The arguments are the ones the client sent: use its protocol
+         * as it is instead of encoding the command again. */
+        // 直接使用客户端发送的原始协议，不再重新编码
+        raw = server.propagate_raw;
+        rawlen = server.propagate_raw_len;
     } else {
         /* All the other commands don't need translation or need the
          * same translation already operated in the command vector
@@ -719,8 +1601,12 @@ void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int a
      * 在重新进入事件循环之前，这些命令会被冲洗到磁盘上，
      * 并向客户端返回一个回复。
      */
-    if (server.aof_state == REDIS_AOF_ON)
+    if (server.aof_state == REDIS_AOF_ON ||
+        (server.aof_multi_part && server.aof_state == REDIS_AOF_WAIT_REWRITE))
+    {
         server.aof_buf = sdscatlen(server.aof_buf,buf,sdslen(buf));
+        if (raw) server.aof_buf = sdscatlen(server.aof_buf,raw,rawlen);
+    }
 
     /* If a background append only file rewriting is in progress we want to
      * accumulate the differences between the child DB and the current one
@@ -730,9 +1616,14 @@ void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int a
      * 如果 BGREWRITEAOF 正在进行，
      * 那么我们还需要将命令追加到重写缓存中，
      * 从而记录当前正在重写的 AOF 文件和数据库当前状态的差异。
+     *
+     * With a multi part AOF the differences are already in the new
+     * incremental file.
      */
-    if (server.aof_child_pid != -1)
+    if (server.aof_child_pid != -1 && !server.aof_multi_part) {
         aofRewriteBufferAppend((unsigned char*)buf,sdslen(buf));
+        if (raw) aofRewriteBufferAppend((unsigned char*)raw,rawlen);
+    }
 
     // 释放
     sdsfree(buf);
@@ -774,7 +1665,7 @@ struct redisClient *createFakeClient(void) {
     c->obuf_soft_limit_reached_time = 0;
     c->watched_keys = listCreate();
     c->peerid = NULL;
-    listSetFreeMethod(c->reply,decrRefCountVoid);
+    listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
     initClientMultiState(c);
 
@@ -802,6 +1693,328 @@ void freeFakeClient(struct redisClient *c) {
 }
 
 
+/* Return values of the AOF parsing functions. */
+#define AOF_LOAD_OK 0       /* A command was parsed. */
+#define AOF_LOAD_EOF 1      /* End of file reached between two commands. */
+#define AOF_LOAD_READERR 2  /* Read error or truncated command. */
+#define AOF_LOAD_FMTERR 3   /* Bad protocol format. */
+#define AOF_LOAD_STOP 4     /* Reached server.aof_load_stop_time. */
+
+/* Point in time loading state, only used by the parsing code. */
+static long long aofLoadStopTime;   /* Stop at annotations after it, or 0. */
+static off_t aofLoadStopOffset;     /* Offset of the annotation we stopped at. */
+
+/* Handle an annotation line read from the AOF. Returns AOF_LOAD_STOP if
+ * the loading must stop before it. */
+// 处理 AOF 中的注释，到达载入的终止时间时返回 AOF_LOAD_STOP
+static int aofLoadAnnotation(FILE *fp, char *line) {
+    long long t;
+
+    if (!strncmp(line,"#TS:",4)) {
+        t = strtoll(line+4,NULL,10);
+        if (aofLoadStopTime && t > aofLoadStopTime) {
+            aofLoadStopOffset = ftello(fp)-strlen(line);
+            return AOF_LOAD_STOP;
+        }
+    } else if (!strncmp(line,"#RESTORE:",9)) {
+        /* The file was already cut at this time: what follows was written
+         * after the restore. */
+        t = strtoll(line+9,NULL,10);
+        if (t == aofLoadStopTime) aofLoadStopTime = 0;
+    }
+    return AOF_LOAD_OK;
+}
+
+/* Read the next command from the AOF, creating the argument objects.
+ * On success the new argument vector is stored in '*argvp' and its length
+ * in '*argcp'.
+ *
+ * 从 AOF 文件中读入下一个命令，并为命令参数创建对象。
+ *
+ * Only zmalloc and sds functions are used, so it is safe to call it from
+ * the pipelined parsing thread. */
+static int aofLoadParseCommand(FILE *fp, int *argcp, robj ***argvp) {
+    int argc, j;
+    unsigned long len;
+    robj **argv;
+    char buf[128];
+    sds argsds;
+
+    // 读入文件内容到缓存，跳过注释
+    while(1) {
+        if (fgets(buf,sizeof(buf),fp) == NULL) {
+            if (feof(fp))
+                // 文件已经读完
+                return AOF_LOAD_EOF;
+            else
+                return AOF_LOAD_READERR;
+        }
+        if (buf[0] != '#') break;
+        if (aofLoadAnnotation(fp,buf) == AOF_LOAD_STOP) return AOF_LOAD_STOP;
+    }
+
+    // 确认协议格式，比如 *3\r\n
+    if (buf[0] != '*') return AOF_LOAD_FMTERR;
+
+    // 取出命令参数，比如 *3\r\n 中的 3
+    argc = atoi(buf+1);
+
+    // 至少要有一个参数（被调用的命令）
+    if (argc < 1) return AOF_LOAD_FMTERR;
+
+    // 从文本中创建字符串对象：包括命令，以及命令参数
+    // 例如 $3\r\nSET\r\n$3\r\nKEY\r\n$5\r\nVALUE\r\n
+    // 将创建三个包含以下内容的字符串对象：
+    // SET 、 KEY 、 VALUE
+    argv = zmalloc(sizeof(robj*)*argc);
+    for (j = 0; j < argc; j++) {
+        if (fgets(buf,sizeof(buf),fp) == NULL) return AOF_LOAD_READERR;
+
+        if (buf[0] != '$') return AOF_LOAD_FMTERR;
+
+        // 读取参数值的长度
+        len = strtol(buf+1,NULL,10);
+        // 读取参数值
+        argsds = sdsnewlen(NULL,len);
+        if (len && fread(argsds,len,1,fp) == 0) return AOF_LOAD_FMTERR;
+        // 为参数创建对象
+        argv[j] = createObject(REDIS_STRING,argsds);
+
+        if (fread(buf,2,1,fp) == 0) return AOF_LOAD_FMTERR; /* discard CRLF */
+    }
+    *argcp = argc;
+    *argvp = argv;
+    return AOF_LOAD_OK;
+}
+
+/* Execute a command read from the AOF in the context of the fake client,
+ * then release its arguments. */
+// 使用伪客户端执行从 AOF 文件中读入的命令，然后释放命令参数
+static void aofLoadExecuteCommand(redisClient *fakeClient, int argc, robj **argv) {
+    struct redisCommand *cmd;
+    int j;
+
+    /* Command lookup 
+     *
+     * 查找命令
+     */
+    cmd = lookupCommand(argv[0]->ptr);
+    if (!cmd) {
+        redisLog(REDIS_WARNING,"Unknown command '%s' reading the append only file", (char*)argv[0]->ptr);
+        exit(1);
+    }
+
+    /* Run the command in the context of a fake client 
+     *
+     * 调用伪客户端，执行命令
+     */
+    fakeClient->argc = argc;
+    fakeClient->argv = argv;
+    cmd->proc(fakeClient);
+
+    /* The fake client should not have a reply */
+    redisAssert(fakeClient->bufpos == 0 && listLength(fakeClient->reply) == 0);
+    /* The fake client should never get blocked */
+    redisAssert((fakeClient->flags & REDIS_BLOCKED) == 0);
+
+    /* Clean up. Command code may have changed argv/argc so we use the
+     * argv/argc of the client instead of the local variables. 
+     *
+     * 清理命令和命令参数对象
+     */
+    for (j = 0; j < fakeClient->argc; j++)
+        decrRefCount(fakeClient->argv[j]);
+    zfree(fakeClient->argv);
+}
+
+/* ---------------------------- Pipelined loading ---------------------------
+ *
+ * 流水线式载入 AOF 文件
+ *
+ * When server.aof_load_pipeline is true a parsing thread reads the AOF and
+ * turns it into batches of argument vectors, while the main thread executes
+ * the commands of the previous batch. Reading and parsing (fgets, fread,
+ * sds and object allocation) are a large part of the replay time, and they
+ * only use the thread safe zmalloc, so they can overlap with execution.
+ *
+ * 解析线程读入 AOF 文件，并将其转换为一批批命令参数，
+ * 同时主线程执行上一批命令。
+ *
+ * Commands are still executed by the main thread one after the other, in
+ * file order: the keyspace, MULTI/EXEC state, expires and the command table
+ * are only touched here, so the semantics are exactly the ones of the
+ * serial replay. Executing commands on different threads would need a
+ * keyspace split in independent shards, which Redis doesn't have. */
+
+#define AOF_LOAD_BATCH_SIZE 1024
+
+typedef struct aofLoadBatch {
+    int argc[AOF_LOAD_BATCH_SIZE];
+    robj **argv[AOF_LOAD_BATCH_SIZE];
+    int count;
+    int status;             /* AOF_LOAD_* status after the last command. */
+    off_t offset;           /* File offset after the last command. */
+} aofLoadBatch;
+
+/* State shared by the main thread and the parsing thread. Batches are used
+ * as a ring: the parser fills batches[filled % 2] while the main thread
+ * executes batches[executed % 2]. */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;        /* Signaled on every state change. */
+    aofLoadBatch batches[2];
+    unsigned long filled;       /* Batches parsed so far. */
+    unsigned long executed;     /* Batches executed so far. */
+    FILE *fp;
+} aofLoaders;
+
+void *aofLoadParserMain(void *arg) {
+    sigset_t sigset;
+
+    REDIS_NOTUSED(arg);
+
+    /* Make sure only the main thread receives the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    while(1) {
+        aofLoadBatch *b;
+
+        // 等待主线程执行完上上批命令，空出缓冲区
+        pthread_mutex_lock(&aofLoaders.mutex);
+        while (aofLoaders.filled - aofLoaders.executed == 2)
+            pthread_cond_wait(&aofLoaders.cond,&aofLoaders.mutex);
+        pthread_mutex_unlock(&aofLoaders.mutex);
+
+        b = aofLoaders.batches+(aofLoaders.filled % 2);
+        b->count = 0;
+        b->status = AOF_LOAD_OK;
+        while (b->count < AOF_LOAD_BATCH_SIZE) {
+            b->status = aofLoadParseCommand(aofLoaders.fp,
+                            b->argc+b->count,b->argv+b->count);
+            if (b->status != AOF_LOAD_OK) break;
+            b->count++;
+        }
+        b->offset = ftello(aofLoaders.fp);
+
+        pthread_mutex_lock(&aofLoaders.mutex);
+        aofLoaders.filled++;
+        pthread_cond_signal(&aofLoaders.cond);
+        pthread_mutex_unlock(&aofLoaders.mutex);
+
+        // 文件结束或者出错，线程退出
+        if (b->status != AOF_LOAD_OK) return NULL;
+    }
+}
+
+/* Replay the AOF using the parsing thread. Returns AOF_LOAD_EOF when the
+ * whole file was executed, or the error found by the parser. Commands
+ * parsed before an error are executed, like the serial loader does. */
+// 使用解析线程载入 AOF 文件，成功时返回 AOF_LOAD_EOF ，否则返回解析错误
+static int aofLoadPipelined(redisClient *fakeClient, FILE *fp) {
+    pthread_t parser;
+    long long start = ustime();
+    unsigned long long commands = 0;
+    int status = AOF_LOAD_OK;
+
+    pthread_mutex_init(&aofLoaders.mutex,NULL);
+    pthread_cond_init(&aofLoaders.cond,NULL);
+    aofLoaders.filled = aofLoaders.executed = 0;
+    aofLoaders.fp = fp;
+    if (pthread_create(&parser,NULL,aofLoadParserMain,NULL) != 0) {
+        redisLog(REDIS_WARNING,"Fatal: Can't create the AOF parsing thread.");
+        exit(1);
+    }
+
+    while (status == AOF_LOAD_OK) {
+        aofLoadBatch *b;
+        int j;
+
+        // 等待解析线程解析完下一批命令
+        pthread_mutex_lock(&aofLoaders.mutex);
+        while (aofLoaders.filled == aofLoaders.executed)
+            pthread_cond_wait(&aofLoaders.cond,&aofLoaders.mutex);
+        pthread_mutex_unlock(&aofLoaders.mutex);
+
+        b = aofLoaders.batches+(aofLoaders.executed % 2);
+        for (j = 0; j < b->count; j++)
+            aofLoadExecuteCommand(fakeClient,b->argc[j],b->argv[j]);
+        commands += b->count;
+        status = b->status;
+
+        /* Serve the clients from time to time. */
+        // 间隔性地处理客户端发送来的请求
+        loadingProgress(b->offset);
+        processEventsWhileBlocked();
+
+        pthread_mutex_lock(&aofLoaders.mutex);
+        aofLoaders.executed++;
+        pthread_cond_signal(&aofLoaders.cond);
+        pthread_mutex_unlock(&aofLoaders.mutex);
+    }
+
+    pthread_join(parser,NULL);
+    pthread_mutex_destroy(&aofLoaders.mutex);
+    pthread_cond_destroy(&aofLoaders.cond);
+    redisLog(REDIS_VERBOSE,"AOF replayed %llu commands in %.3f seconds "
+        "using a parsing thread", commands, (float)(ustime()-start)/1000000);
+    return status;
+}
+
+/* Look for the point in time cut of a single file AOF starting from the
+ * nearest timestamp index entry, without executing anything. If the cut
+ * is found the file is truncated there. Returns REDIS_OK if there is
+ * nothing left to do while loading, REDIS_ERR if the cut must be searched
+ * while replaying the whole file.
+ *
+ * 从最近的索引项开始查找截断位置，不执行任何命令。
+ * 如果找到了截断位置，那么截断文件。
+ * 返回 REDIS_ERR 表示需要在载入过程中查找截断位置。 */
+static int aofLoadSeekCut(char *filename, FILE *fp, off_t size) {
+    long long ts;
+    off_t offset;
+    char buf[128], expected[64];
+    int retval, argc, j;
+    robj **argv;
+
+    if (aofTimestampIndexLookup(aofLoadStopTime,size,&ts,&offset) == REDIS_ERR)
+        return REDIS_ERR;
+
+    /* The index is not synced with the AOF: make sure the entry points to
+     * the annotation it claims. */
+    // 检查索引项确实指向对应的注释
+    snprintf(expected,sizeof(expected),"#TS:%lld\r\n",ts);
+    if (fseeko(fp,offset,SEEK_SET) == -1 ||
+        fgets(buf,sizeof(buf),fp) == NULL ||
+        strcmp(buf,expected) != 0) goto fallback;
+
+    while(1) {
+        retval = aofLoadParseCommand(fp,&argc,&argv);
+        if (retval != AOF_LOAD_OK) break;
+        for (j = 0; j < argc; j++) decrRefCount(argv[j]);
+        zfree(argv);
+        // 文件已经在这个时间点被截断过
+        if (aofLoadStopTime == 0) break;
+    }
+    if (retval == AOF_LOAD_READERR || retval == AOF_LOAD_FMTERR)
+        goto fallback;
+
+    if (retval == AOF_LOAD_STOP)
+        aofTruncateToTimestamp(filename,aofLoadStopOffset,aofLoadStopTime);
+    aofLoadStopTime = 0;
+    if (fseeko(fp,0,SEEK_SET) == -1) goto fallback;
+    return REDIS_OK;
+
+fallback:
+    aofLoadStopTime = server.aof_load_stop_time;
+    if (fseeko(fp,0,SEEK_SET) == -1) {
+        redisLog(REDIS_WARNING,"Unrecoverable error reading the append only file: %s", strerror(errno));
+        exit(1);
+    }
+    return REDIS_ERR;
+}
+
 /* Replay the append log file. On error REDIS_OK is returned. On non fatal
  * error (the append only file is zero-length) REDIS_ERR is returned. On
  * fatal error an error message is logged and the program exists.
@@ -825,6 +2038,8 @@ int loadAppendOnlyFile(char *filename) {
     struct redis_stat sb;
     int old_aof_state = server.aof_state;
     long loops = 0;
+    char sig[5]; /* "REDIS" */
+    int stopped = 0;
 
     // 检查文件的正确性
     if (fp && redis_fstat(fileno(fp),&sb) != -1 && sb.st_size == 0) {
@@ -839,6 +2054,12 @@ int loadAppendOnlyFile(char *filename) {
         exit(1);
     }
 
+    /* Point in time loading: try to cut the file using the timestamp index
+     * before loading it. */
+    // 载入到指定的时间点：首先尝试通过索引截断文件
+    aofLoadStopTime = server.aof_multi_part ? 0 : server.aof_load_stop_time;
+    if (aofLoadStopTime) aofLoadSeekCut(filename,fp,sb.st_size);
+
     /* Temporarily disable AOF, to prevent EXEC from feeding a MULTI
      * to the same file we're about to read. 
      *
@@ -853,13 +2074,37 @@ int loadAppendOnlyFile(char *filename) {
     // startLoading 定义于 rdb.c
     startLoading(fp);
 
-    while(1) {
-        int argc, j;
-        unsigned long len;
+    /* Check if this AOF file has an RDB preamble. In that case we load the
+     * RDB payload with the RDB loader, then continue with the AOF tail.
+     *
+     * 检查 AOF 文件是否以 RDB 前言开头，如果是的话，
+     * 先使用 RDB 载入程序载入数据集，然后继续载入之后的 AOF 命令。 */
+    if (fread(sig,1,5,fp) == 5 && memcmp(sig,"REDIS",5) == 0) {
+        if (fseeko(fp,0,SEEK_SET) == -1) goto readerr;
+        redisLog(REDIS_NOTICE,"Reading RDB preamble from AOF file...");
+        if (rdbLoadAofPreamble(fp) != REDIS_OK) {
+            redisLog(REDIS_WARNING,"Error reading the RDB preamble of the AOF file, AOF loading aborted");
+            goto readerr;
+        }
+        redisLog(REDIS_NOTICE,"Reading the remaining AOF tail...");
+    } else {
+        if (fseeko(fp,0,SEEK_SET) == -1) goto readerr;
+    }
+
+    /* Parse the file in a background thread while the commands are
+     * executed here, or do both in this thread. */
+    // 在后台线程中解析 AOF 文件，同时在主线程中执行命令
+    if (server.aof_load_pipeline) {
+        switch(aofLoadPipelined(fakeClient,fp)) {
+        case AOF_LOAD_READERR: goto readerr;
+        case AOF_LOAD_FMTERR: goto fmterr;
+        case AOF_LOAD_STOP: stopped = 1; break;
+        }
+    }
+
+    while(!server.aof_load_pipeline) {
+        int argc, retval;
         robj **argv;
-        char buf[128];
-        sds argsds;
-        struct redisCommand *cmd;
 
         /* Serve the clients from time to time 
          *
@@ -871,76 +2116,18 @@ int loadAppendOnlyFile(char *filename) {
             processEventsWhileBlocked();
         }
 
-        // 读入文件内容到缓存
-        if (fgets(buf,sizeof(buf),fp) == NULL) {
-            if (feof(fp))
-                // 文件已经读完，跳出
-                break;
-            else
-                goto readerr;
-        }
-
-        // 确认协议格式，比如 *3\r\n
-        if (buf[0] != '*') goto fmterr;
-        
-        // 取出命令参数，比如 *3\r\n 中的 3
-        argc = atoi(buf+1);
-
-        // 至少要有一个参数（被调用的命令）
-        if (argc < 1) goto fmterr;
-
-        // 从文本中创建字符串对象：包括命令，以及命令参数
-        // 例如 $3\r\nSET\r\n$3\r\nKEY\r\n$5\r\nVALUE\r\n
-        // 将创建三个包含以下内容的字符串对象：
-        // SET 、 KEY 、 VALUE
-        argv = zmalloc(sizeof(robj*)*argc);
-        for (j = 0; j < argc; j++) {
-            if (fgets(buf,sizeof(buf),fp) == NULL) goto readerr;
-
-            if (buf[0] != '$') goto fmterr;
-
-            // 读取参数值的长度
-            len = strtol(buf+1,NULL,10);
-            // 读取参数值
-            argsds = sdsnewlen(NULL,len);
-            if (len && fread(argsds,len,1,fp) == 0) goto fmterr;
-            // 为参数创建对象
-            argv[j] = createObject(REDIS_STRING,argsds);
-
-            if (fread(buf,2,1,fp) == 0) goto fmterr; /* discard CRLF */
+        // 从文件中读入并解析一个命令
+        retval = aofLoadParseCommand(fp,&argc,&argv);
+        if (retval == AOF_LOAD_EOF) break;
+        if (retval == AOF_LOAD_STOP) {
+            stopped = 1;
+            break;
         }
+        if (retval == AOF_LOAD_READERR) goto readerr;
+        if (retval == AOF_LOAD_FMTERR) goto fmterr;
 
-        /* Command lookup 
-         *
-         * 查找命令
-         */
-        cmd = lookupCommand(argv[0]->ptr);
-        if (!cmd) {
-            redisLog(REDIS_WARNING,"Unknown command '%s' reading the append only file", (char*)argv[0]->ptr);
-            exit(1);
-        }
-
-        /* Run the command in the context of a fake client 
-         *
-         * 调用伪客户端，执行命令
-         */
-        fakeClient->argc = argc;
-        fakeClient->argv = argv;
-        cmd->proc(fakeClient);
-
-        /* The fake client should not have a reply */
-        redisAssert(fakeClient->bufpos == 0 && listLength(fakeClient->reply) == 0);
-        /* The fake client should never get blocked */
-        redisAssert((fakeClient->flags & REDIS_BLOCKED) == 0);
-
-        /* Clean up. Command code may have changed argv/argc so we use the
-         * argv/argc of the client instead of the local variables. 
-         *
-         * 清理命令和命令参数对象
-         */
-        for (j = 0; j < fakeClient->argc; j++)
-            decrRefCount(fakeClient->argv[j]);
-        zfree(fakeClient->argv);
+        // 调用伪客户端，执行命令
+        aofLoadExecuteCommand(fakeClient,argc,argv);
     }
 
     /* This point can only be reached when EOF is reached without errors.
@@ -951,6 +2138,12 @@ int loadAppendOnlyFile(char *filename) {
      */
     if (fakeClient->flags & REDIS_MULTI) goto readerr;
 
+    /* We stopped at the requested point in time: drop the rest of the file
+     * so that new writes are appended after the restored dataset. */
+    // 到达了指定的时间点，丢弃文件的剩余部分
+    if (stopped)
+        aofTruncateToTimestamp(filename,aofLoadStopOffset,aofLoadStopTime);
+
     // 关闭 AOF 文件
     fclose(fp);
     // 释放伪客户端
@@ -1289,6 +2482,46 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
     return 1;
 }
 
+/* This function is called by the child rewriting the AOF file to read
+ * the difference accumulated from the parent into a buffer, that is
+ * concatenated at the end of the rewrite.
+ *
+ * 由执行重写的子进程调用，读取父进程发送过来的差异，
+ * 这些差异会在重写的最后被追加到新 AOF 文件中。 */
+ssize_t aofReadDiffFromParent(void) {
+    char buf[65536]; /* Default pipe buffer size on most Linux systems. */
+    ssize_t nread, total = 0;
+
+    while ((nread =
+            read(server.aof_pipe_read_data_from_parent,buf,sizeof(buf))) > 0) {
+        server.aof_child_diff = sdscatlen(server.aof_child_diff,buf,nread);
+        total += nread;
+    }
+    return total;
+}
+
+/* Bytes written by the rewriting child between two reads of the diff sent
+ * by the parent, so that the pipe never fills up. */
+#define AOF_REWRITE_DIFF_READ_BYTES (1024*10)
+
+/* rio callback used while the rewriting child writes the RDB preamble:
+ * like rioGenericUpdateChecksum(), and also reads the diff from the parent
+ * every AOF_REWRITE_DIFF_READ_BYTES, since rdbSaveRio() knows nothing
+ * about the diff pipe.
+ *
+ * 子进程写入 RDB 前言时使用的 rio 回调函数：计算校验和，
+ * 并且每写入 AOF_REWRITE_DIFF_READ_BYTES 字节就读取一次父进程发送过来的差异。 */
+static void rewriteAppendOnlyFilePreambleCallback(rio *r, const void *buf,
+                                                  size_t len)
+{
+    if (server.rdb_checksum)
+        rioGenericUpdateChecksum(r,buf,len);
+    if (server.aof_pipe_read_data_from_parent != -1 &&
+        (r->processed_bytes+len)/AOF_REWRITE_DIFF_READ_BYTES >
+        r->processed_bytes/AOF_REWRITE_DIFF_READ_BYTES)
+        aofReadDiffFromParent();
+}
+
 /* Write a sequence of commands able to fully rebuild the dataset into
  * "filename". Used both by REWRITEAOF and BGREWRITEAOF.
  *
@@ -1315,6 +2548,10 @@ int rewriteAppendOnlyFile(char *filename) {
     char tmpfile[256];
     int j;
     long long now = mstime();
+    int writebehind = server.save_write_behind;
+    int diffs = server.aof_pipe_read_data_from_parent != -1;
+    size_t processed = 0;
+    char byte;
 
     /* Note that we have to use a different temp name here compared to the
      * one used by rewriteAppendOnlyFileBackground() function. 
@@ -1330,17 +2567,38 @@ int rewriteAppendOnlyFile(char *filename) {
         return REDIS_ERR;
     }
 
-    // 初始化文件 io
-    rioInitWithFile(&aof,fp);
+    // 初始化文件 io ，如果可能的话，由写线程异步写入文件，
+    // 写线程会渐进地冲洗数据，所以不需要再设置 autosync
+    if (!writebehind ||
+        rioInitWithWriteBehind(&aof,fileno(fp),server.save_direct_io) == REDIS_ERR)
+    {
+        writebehind = 0;
+        rioInitWithFile(&aof,fp);
+
+        // 设置每写入 REDIS_AOF_AUTOSYNC_BYTES 字节
+        // 就执行一次 FSYNC 
+        // 防止缓存中积累太多命令内容，造成 I/O 阻塞时间过长
+        if (server.aof_rewrite_incremental_fsync)
+            rioSetAutoSync(&aof,REDIS_AOF_AUTOSYNC_BYTES);
+    }
 
-    // 设置每写入 REDIS_AOF_AUTOSYNC_BYTES 字节
-    // 就执行一次 FSYNC 
-    // 防止缓存中积累太多命令内容，造成 I/O 阻塞时间过长
-    if (server.aof_rewrite_incremental_fsync)
-        rioSetAutoSync(&aof,REDIS_AOF_AUTOSYNC_BYTES);
+    // 用于接收父进程发送过来的差异
+    if (diffs) server.aof_child_diff = sdsempty();
+
+    /* Write the dataset in RDB format instead of as commands: it is much
+     * smaller and faster to load. The commands accumulated by the parent
+     * during the rewrite are appended after it as usual, and
+     * loadAppendOnlyFile() detects the "REDIS" magic at the start of the
+     * file. */
+    // 以 RDB 格式保存数据集，重写期间累积的命令照常追加在它的后面
+    if (server.aof_use_rdb_preamble) {
+        aof.update_cksum = rewriteAppendOnlyFilePreambleCallback;
+        if (rdbSaveRio(&aof,0) == REDIS_ERR) goto werr;
+        aof.update_cksum = NULL;
+    }
 
-    // 遍历所有数据库
-    for (j = 0; j < server.dbnum; j++) {
+    // 遍历所有数据库，已经以 RDB 格式保存数据集时跳过
+    for (j = 0; j < server.dbnum && !server.aof_use_rdb_preamble; j++) {
 
         char selectcmd[] = "*2\r\n$6\r\nSELECT\r\n";
 
@@ -1424,10 +2682,81 @@ int rewriteAppendOnlyFile(char *filename) {
                 if (rioWriteBulkObject(&aof,&key) == 0) goto werr;
                 if (rioWriteBulkLongLong(&aof,expiretime) == 0) goto werr;
             }
+
+            /* Read some diff from the parent from time to time. */
+            // 不时读取父进程发送过来的差异，避免管道被填满
+            if (diffs &&
+                aof.processed_bytes > processed+AOF_REWRITE_DIFF_READ_BYTES) {
+                processed = aof.processed_bytes;
+                aofReadDiffFromParent();
+            }
         }
 
         // 释放迭代器
         dictReleaseIterator(di);
+        di = NULL;
+    }
+
+    if (diffs) {
+        int nodata = 0;
+        long long start = mstime();
+
+        /* Do an initial slow fsync here while the parent is still sending
+         * data, in order to make the next final fsync faster.
+         *
+         * 在父进程仍在发送数据时先执行一次较慢的 fsync ，
+         * 让最后的 fsync 更快。 */
+        if (rioFlush(&aof) == 0) goto werr;
+        if (aof_fsync(fileno(fp)) == -1) goto werr;
+
+        /* Read again a few times to get more data from the parent.
+         * We can't read forever (the server may receive data from clients
+         * faster than it is able to send data to the child), so we try to
+         * read some more data in a loop as soon as there is a good chance
+         * more data will come. If it looks like we are wasting time, we
+         * abort (this happens after 20 ms without new data).
+         *
+         * 继续读取父进程发送的数据，直到 20 毫秒内没有新数据，
+         * 或者已经读取了 1 秒。 */
+        while(mstime()-start < 1000 && nodata < 20) {
+            if (aeWait(server.aof_pipe_read_data_from_parent, AE_READABLE, 1) <= 0)
+            {
+                nodata++;
+                continue;
+            }
+            nodata = 0; /* Start counting from zero, we stop on N *contiguous*
+                           timeouts. */
+            aofReadDiffFromParent();
+        }
+
+        /* Ask the master to stop sending diffs. */
+        // 请求父进程停止发送差异，并等待父进程的确认
+        if (write(server.aof_pipe_write_ack_to_parent,"!",1) != 1) goto werr;
+        if (anetNonBlock(NULL,server.aof_pipe_read_ack_from_parent) != ANET_OK)
+            goto werr;
+        /* We read the ACK from the server using a 5 seconds timeout. Normally
+         * it should reply ASAP, but just in case we lose its reply, we are
+         * sure the child will eventually get terminated. */
+        if (syncRead(server.aof_pipe_read_ack_from_parent,&byte,1,5000) != 1 ||
+            byte != '!') goto werr;
+        redisLog(REDIS_NOTICE,"Parent agreed to stop sending diffs. Finalizing AOF...");
+
+        /* Read the final diff if any. */
+        aofReadDiffFromParent();
+
+        /* Write the received diff to the file. */
+        // 将收到的差异追加到新 AOF 文件中
+        redisLog(REDIS_NOTICE,
+            "Concatenating %.2f MB of AOF diff received from parent.",
+            (double) sdslen(server.aof_child_diff) / (1024*1024));
+        if (rioWrite(&aof,server.aof_child_diff,sdslen(server.aof_child_diff)) == 0)
+            goto werr;
+    }
+
+    // 等待写线程写入所有数据
+    if (writebehind) {
+        if (rioFlush(&aof) == 0) goto werr;
+        rioFreeWriteBehind(&aof);
     }
 
     /* Make sure data will not remain on the OS's output buffers */
@@ -1452,6 +2781,7 @@ int rewriteAppendOnlyFile(char *filename) {
     return REDIS_OK;
 
 werr:
+    if (writebehind) rioFreeWriteBehind(&aof);
     fclose(fp);
     unlink(tmpfile);
     redisLog(REDIS_WARNING,"Write error writing append only file on disk: %s", strerror(errno));
@@ -1459,6 +2789,92 @@ werr:
     return REDIS_ERR;
 }
 
+/* This event handler is called when the AOF rewriting child sends us a
+ * single '!' char to signal we should stop sending buffer diffs. The
+ * parent sends a '!' as well to acknowledge.
+ *
+ * 子进程发送 '!' 请求父进程停止发送差异时调用，
+ * 父进程同样回复一个 '!' 作为确认。 */
+void aofChildPipeReadable(aeEventLoop *el, int fd, void *privdata, int mask) {
+    char byte;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(privdata);
+    REDIS_NOTUSED(mask);
+
+    if (read(fd,&byte,1) == 1 && byte == '!') {
+        redisLog(REDIS_NOTICE,"AOF rewrite child asks to stop sending diffs.");
+        server.aof_stop_sending_diff = 1;
+        if (write(server.aof_pipe_write_ack_to_child,"!",1) != 1) {
+            /* If we can't send the ack, inform the user, but don't try again
+             * since in the other side the children will use a timeout if the
+             * kernel can't buffer our write, or, the children was
+             * terminated. */
+            redisLog(REDIS_WARNING,"Can't send ACK to AOF child: %s",
+                strerror(errno));
+        }
+    }
+    /* Remove the handler since this can be called only one time during a
+     * rewrite. */
+    aeDeleteFileEvent(server.el,server.aof_pipe_read_ack_from_child,AE_READABLE);
+}
+
+/* Create the pipes used for parent - child process IPC during rewrite.
+ * We have a data pipe used to send AOF incremental diffs to the child,
+ * and two other pipes used by the children to signal it finished with
+ * the rewrite so no more data should be written, and another for the
+ * parent to acknowledge it understood this new condition.
+ *
+ * 创建重写期间父子进程通信所需的管道：
+ * 一个用于向子进程发送差异，
+ * 另外两个用于子进程请求停止发送差异，以及父进程的确认。 */
+int aofCreatePipes(void) {
+    int fds[6] = {-1, -1, -1, -1, -1, -1};
+    int j;
+
+    if (pipe(fds) == -1) goto error; /* parent -> children data. */
+    if (pipe(fds+2) == -1) goto error; /* children -> parent ack. */
+    if (pipe(fds+4) == -1) goto error; /* parent -> children ack. */
+    /* Parent -> children data is non blocking. */
+    if (anetNonBlock(NULL,fds[0]) != ANET_OK) goto error;
+    if (anetNonBlock(NULL,fds[1]) != ANET_OK) goto error;
+    if (aeCreateFileEvent(server.el, fds[2], AE_READABLE, aofChildPipeReadable, NULL) == AE_ERR) goto error;
+
+    server.aof_pipe_write_data_to_child = fds[1];
+    server.aof_pipe_read_data_from_parent = fds[0];
+    server.aof_pipe_write_ack_to_parent = fds[3];
+    server.aof_pipe_read_ack_from_child = fds[2];
+    server.aof_pipe_write_ack_to_child = fds[5];
+    server.aof_pipe_read_ack_from_parent = fds[4];
+    server.aof_stop_sending_diff = 0;
+    return REDIS_OK;
+
+error:
+    redisLog(REDIS_WARNING,"Error opening /setting AOF rewrite IPC pipes: %s",
+        strerror(errno));
+    for (j = 0; j < 6; j++) if(fds[j] != -1) close(fds[j]);
+    return REDIS_ERR;
+}
+
+// 关闭重写期间父子进程通信所使用的管道
+void aofClosePipes(void) {
+    if (server.aof_pipe_write_data_to_child == -1) return;
+
+    aeDeleteFileEvent(server.el,server.aof_pipe_read_ack_from_child,AE_READABLE);
+    aeDeleteFileEvent(server.el,server.aof_pipe_write_data_to_child,AE_WRITABLE);
+    close(server.aof_pipe_write_data_to_child);
+    close(server.aof_pipe_read_data_from_parent);
+    close(server.aof_pipe_write_ack_to_parent);
+    close(server.aof_pipe_read_ack_from_child);
+    close(server.aof_pipe_write_ack_to_child);
+    close(server.aof_pipe_read_ack_from_parent);
+    server.aof_pipe_write_data_to_child = -1;
+    server.aof_pipe_read_data_from_parent = -1;
+    server.aof_pipe_write_ack_to_parent = -1;
+    server.aof_pipe_read_ack_from_child = -1;
+    server.aof_pipe_write_ack_to_child = -1;
+    server.aof_pipe_read_ack_from_parent = -1;
+}
+
 /* This is how rewriting of the append only file in background works:
  * 
  * 以下是后台重写 AOF 文件（BGREWRITEAOF）的工作步骤：
@@ -1472,14 +2888,17 @@ werr:
  *    2a) the child rewrite the append only file in a temp file.
  *        子进程在临时文件中对 AOF 文件进行重写
  *
- *    2b) the parent accumulates differences in server.aof_rewrite_buf.
- *        父进程将新输入的写命令追加到 server.aof_rewrite_buf 中
+ *    2b) the parent accumulates differences in server.aof_rewrite_buf,
+ *        and sends them to the child over a pipe while it is running.
+ *        父进程将新输入的写命令追加到 server.aof_rewrite_buf 中，
+ *        并在子进程运行期间通过管道将它们发送给子进程
  *
  * 3) When the child finished '2a' exists.
  *    当步骤 2a 执行完之后，子进程结束
  *
  * 4) The parent will trap the exit code, if it's OK, will append the
- *    data accumulated into server.aof_rewrite_buf into the temp file, and
+ *    data accumulated into server.aof_rewrite_buf into the temp file (only
+ *    the residual the child did not receive), and
  *    finally will rename(2) the temp file in the actual file name.
  *    The the new file is reopened as the new append only file. Profit!
  *
@@ -1496,6 +2915,14 @@ int rewriteAppendOnlyFileBackground(void) {
     // 已经有进程在进行 AOF 重写了
     if (server.aof_child_pid != -1) return REDIS_ERR;
 
+    // 多文件 AOF 模式下，先切换到新的增量文件
+    if (server.aof_multi_part && aofMultiPartRewriteStart() == REDIS_ERR)
+        return REDIS_ERR;
+
+    // 创建和子进程通信的管道，多文件 AOF 不需要发送差异
+    if (!server.aof_multi_part && aofCreatePipes() != REDIS_OK)
+        return REDIS_ERR;
+
     // 记录 fork 开始前的时间，计算 fork 耗时用
     start = ustime();
 
@@ -1535,6 +2962,7 @@ int rewriteAppendOnlyFileBackground(void) {
             redisLog(REDIS_WARNING,
                 "Can't rewrite append only file in background: fork: %s",
                 strerror(errno));
+            aofClosePipes();
             return REDIS_ERR;
         }
 
@@ -1573,7 +3001,8 @@ void bgrewriteaofCommand(redisClient *c) {
 
     // 如果正在执行 BGSAVE ，那么预定 BGREWRITEAOF
     // 等 BGSAVE 完成之后， BGREWRITEAOF 就会开始执行
-    } else if (server.rdb_child_pid != -1) {
+    } else if (server.rdb_child_pid != -1 ||
+               server.rdb_snapshot_in_progress) {
         server.aof_rewrite_scheduled = 1;
         addReplyStatus(c,"Background append only file rewriting scheduled");
 
@@ -1633,6 +3062,21 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
         redisLog(REDIS_NOTICE,
             "Background AOF rewrite terminated with success");
 
+        /* With a multi part AOF the parent diff is already on disk in the
+         * incremental files, so we only need to install the new base. */
+        if (server.aof_multi_part) {
+            snprintf(tmpfile,256,"temp-rewriteaof-bg-%d.aof",
+                (int)server.aof_child_pid);
+            if (aofMultiPartRewriteDone(tmpfile) == REDIS_ERR) goto cleanup;
+            server.aof_lastbgrewrite_status = REDIS_OK;
+            redisLog(REDIS_NOTICE, "Background AOF rewrite finished successfully");
+            if (server.aof_state == REDIS_AOF_WAIT_REWRITE)
+                server.aof_state = REDIS_AOF_ON;
+            redisLog(REDIS_VERBOSE,
+                "Background AOF rewrite signal handler took %lldus", ustime()-now);
+            goto cleanup;
+        }
+
         /* Flush the differences accumulated by the parent to the
          * rewritten AOF. */
         // 打开保存新 AOF 文件内容的临时文件
@@ -1745,6 +3189,8 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
              *
              * 用新 AOF 文件的 fd 替换原来 AOF 文件的 fd
              */
+            // 等待写线程写完旧文件，之后它将写入新文件
+            aofWriterDrain();
             oldfd = server.aof_fd;
             server.aof_fd = newfd;
 
@@ -1772,6 +3218,9 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
             server.aof_buf = sdsempty();
         }
 
+        // 索引中的偏移量指向被替换的旧文件
+        aofTimestampIndexReset();
+
         server.aof_lastbgrewrite_status = REDIS_OK;
 
         redisLog(REDIS_NOTICE, "Background AOF rewrite finished successfully");
@@ -1809,6 +3258,9 @@ void backgroundRewriteDoneHandler(int exitcode, int bysignal) {
 
 cleanup:
 
+    // 关闭和子进程通信的管道
+    aofClosePipes();
+
     // 清空 AOF 缓冲区
     aofRewriteBufferReset();
 
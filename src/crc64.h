@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+void crc64_init(void);
+const char *crc64_impl_name(void);
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
 
 #endif
@@ -0,0 +1,436 @@
+/* Offline simulator of the approximated LRU and LFU eviction.
+ *
+ * 近似 LRU 和 LFU 驱逐算法的离线模拟器。
+ *
+ * The program builds a synthetic keyspace split across a few DBs of uneven
+ * size, accesses the keys with a skewed pattern, and then evicts half of
+ * the keys using the same sampling and pool logic of evictionPoolPopulate()
+ * and evictionPoolPickBest() in redis.c. The precision reported is the
+ * fraction of the evicted keys that a true LRU would have evicted as well:
+ * 100% is a perfect LRU, about 50% is random eviction.
+ *
+ * 程序创建一个分布在多个大小不均的数据库中的键空间，按倾斜的模式访问这些键，
+ * 然后使用和 redis.c 中 evictionPoolPopulate() 及 evictionPoolPickBest()
+ * 相同的抽样和驱逐池逻辑淘汰一半的键。
+ * 输出的精确度是被淘汰的键中同样会被真正的 LRU 淘汰的键所占的比例：
+ * 100% 为完美的 LRU ，随机淘汰约为 50% 。
+ *
+ * Both the shared pool and the old layout with a pool for every DB, where
+ * freeMemoryIfNeeded() evicted one key from every DB in turn, are
+ * simulated, so that the effect of the pool size, of maxmemory-samples and
+ * of the DB layout can be compared.
+ *
+ * The second part of the program uses the keyspace as a cache of a bigger
+ * set of keys requested with a Zipf distribution, and reports the hit rate
+ * of allkeys-lru and allkeys-lfu. The LFU counter is driven by copies of
+ * LFULogIncr() and LFUDecrAndReturn() of object.c, with a simulated clock
+ * advancing one minute every REDIS_SIM_REQS_PER_MINUTE requests. A trace
+ * where the popularity of the keys changes halfway shows how the counter
+ * decay lets LFU forget keys that are no longer hot.
+ *
+ * 程序的第二部分将键空间用作一个更大的键集合的缓存，按 Zipf 分布请求这些键，
+ * 并输出 allkeys-lru 和 allkeys-lfu 两种策略的命中率。
+ * LFU 计数器由 object.c 中 LFULogIncr() 和 LFUDecrAndReturn() 的副本驱动。
+ *
+ * Build and run with:
+ *
+ *   gcc -O2 -DTEST_MAIN -o evictsim evictsim.c -lm && ./evictsim [keys]
+ *
+ * The simulator does not link with the rest of the server: keys are just
+ * integers with the logical time of their last access, and sampling is
+ * uniform, while dictGetRandomKeys() returns keys of nearby buckets. Keep
+ * the pool logic in sync with redis.c when changing it. */
+
+#ifdef TEST_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define SIM_MAX_DBS 16
+#define SIM_MAX_POOL 64
+
+/* Same defaults of redis.h. */
+#define REDIS_LFU_INIT_VAL 5
+#define REDIS_DEFAULT_LFU_LOG_FACTOR 10
+#define REDIS_DEFAULT_LFU_DECAY_TIME 1
+#define REDIS_SIM_REQS_PER_MINUTE 100000
+#define REDIS_EVICTION_POOL_SIZE 16
+#define REDIS_DEFAULT_MAXMEMORY_SAMPLES 5
+
+/* A key of the synthetic keyspace. */
+// 模拟键空间中的一个键
+typedef struct simKey {
+    unsigned long long atime;   /* Logical time of the last access. */
+    unsigned long ldt;          /* LFU last decrement time, in minutes. */
+    unsigned long counter;      /* LFU logarithmic access counter. */
+    int dbid;                   /* DB the key belongs to. */
+    int pos;                    /* Index in the DB live array, -1 if evicted. */
+} simKey;
+
+/* A DB is just the array of the ids of the keys not yet evicted, so that
+ * random sampling and removal are both O(1). */
+// 数据库只是未被淘汰的键的 id 数组
+typedef struct simDb {
+    int *live;
+    int len;
+} simDb;
+
+/* Same as struct evictionPoolEntry, with an integer key. */
+typedef struct simPoolEntry {
+    unsigned long long idle;
+    int key;                    /* -1 for an empty entry. */
+    int dbid;
+} simPoolEntry;
+
+static simKey *sim_keys;
+static simDb sim_dbs[SIM_MAX_DBS];
+static int sim_numdbs;
+static unsigned long long sim_clock;
+static int sim_lfu;             /* Rank keys by LFU counter instead of idle. */
+static unsigned long long sim_seed = 0x2545f4914f6cdd1dULL;
+
+static unsigned long long simRandom(void) {
+    sim_seed ^= sim_seed >> 12;
+    sim_seed ^= sim_seed << 25;
+    sim_seed ^= sim_seed >> 27;
+    return sim_seed * 0x2545f4914f6cdd1dULL;
+}
+
+/* Return a random double in [0,1). */
+static double simRandomUnit(void) {
+    return (simRandom() >> 11) * (1.0/9007199254740992.0);
+}
+
+static void simPoolReset(simPoolEntry *pool, int size) {
+    int k;
+
+    for (k = 0; k < size; k++) {
+        pool[k].idle = 0;
+        pool[k].key = -1;
+        pool[k].dbid = 0;
+    }
+}
+
+/* Current time in minutes of the simulated clock. */
+static unsigned long simMinutes(void) {
+    return (unsigned long)(sim_clock / REDIS_SIM_REQS_PER_MINUTE);
+}
+
+/* Same as LFULogIncr() in object.c. */
+static unsigned long simLFULogIncr(unsigned long counter) {
+    double baseval, p;
+
+    if (counter == 255) return 255;
+    baseval = (double)counter - REDIS_LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    p = 1.0/(baseval*REDIS_DEFAULT_LFU_LOG_FACTOR+1);
+    if (simRandomUnit() < p) counter++;
+    return counter;
+}
+
+/* Same as LFUDecrAndReturn() in object.c. The simulated clock never wraps. */
+static unsigned long simLFUDecrAndReturn(simKey *k) {
+    unsigned long num_periods = (simMinutes()-k->ldt) /
+                                REDIS_DEFAULT_LFU_DECAY_TIME;
+
+    if (num_periods)
+        return (num_periods > k->counter) ? 0 : k->counter - num_periods;
+    return k->counter;
+}
+
+/* Record an access to the key, like lookupKey() and updateLFU() do. */
+static void simTouch(simKey *k) {
+    k->atime = ++sim_clock;
+    k->counter = simLFULogIncr(simLFUDecrAndReturn(k));
+    k->ldt = simMinutes();
+}
+
+/* Sample 'count' keys of the DB 'dbid' and add them to the pool, exactly
+ * like evictionPoolPopulate() does. */
+static void simPoolPopulate(int dbid, int count, simPoolEntry *pool, int size) {
+    simDb *db = sim_dbs+dbid;
+    int j, k;
+
+    for (j = 0; j < count; j++) {
+        int key = db->live[simRandom() % db->len];
+        unsigned long long idle;
+
+        if (sim_lfu)
+            idle = 255-simLFUDecrAndReturn(sim_keys+key);
+        else
+            idle = sim_clock - sim_keys[key].atime;
+
+        k = 0;
+        while (k < size && pool[k].key != -1 && pool[k].idle < idle) k++;
+        if (k == 0 && pool[size-1].key != -1) {
+            continue;
+        } else if (k < size && pool[k].key == -1) {
+            /* Inserting into empty position. */
+        } else {
+            if (pool[size-1].key == -1) {
+                memmove(pool+k+1,pool+k,sizeof(pool[0])*(size-k-1));
+            } else {
+                k--;
+                memmove(pool,pool+1,sizeof(pool[0])*k);
+            }
+        }
+        pool[k].idle = idle;
+        pool[k].key = key;
+        pool[k].dbid = dbid;
+    }
+}
+
+/* Pick the best key of the pool that still exists, or -1 if the pool only
+ * holds ghosts. */
+static int simPoolPop(simPoolEntry *pool, int size) {
+    int k;
+
+    for (k = size-1; k >= 0; k--) {
+        int key = pool[k].key;
+
+        if (key == -1) continue;
+        pool[k].key = -1;
+        pool[k].idle = 0;
+        if (sim_keys[key].pos != -1) return key;
+    }
+    return -1;
+}
+
+/* Like evictionPoolPickBest(): one shared pool, samples split across the
+ * DBs proportionally to their size. */
+static int simPickShared(simPoolEntry *pool, int size, int samples) {
+    int j, key;
+
+    while(1) {
+        unsigned long long total = 0;
+
+        for (j = 0; j < sim_numdbs; j++) total += sim_dbs[j].len;
+        if (total == 0) return -1;
+        for (j = 0; j < sim_numdbs; j++) {
+            unsigned long long len = sim_dbs[j].len;
+
+            if (len == 0) continue;
+            simPoolPopulate(j,(int)((samples*len+total-1)/total),pool,size);
+        }
+        if ((key = simPoolPop(pool,size)) != -1) return key;
+    }
+}
+
+/* Old layout: a pool for every DB, filled with 'samples' keys of that DB
+ * alone. The caller visits the DBs in turn. */
+static int simPickPerDb(simPoolEntry *pool, int size, int samples, int dbid) {
+    int key;
+
+    if (sim_dbs[dbid].len == 0) return -1;
+    while(1) {
+        simPoolPopulate(dbid,samples,pool,size);
+        if ((key = simPoolPop(pool,size)) != -1) return key;
+    }
+}
+
+static void simEvict(int key) {
+    simDb *db = sim_dbs+sim_keys[key].dbid;
+    int pos = sim_keys[key].pos;
+
+    db->live[pos] = db->live[--db->len];
+    sim_keys[db->live[pos]].pos = pos;
+    sim_keys[key].pos = -1;
+}
+
+/* Build the keyspace: 'numkeys' keys assigned to the DBs according to
+ * 'weights', created in order, then accessed 'numkeys*2' times with a
+ * power law skew so that a few keys are much hotter than the others. */
+static void simSetup(int numkeys, const int *weights, int numdbs) {
+    int j, wsum = 0;
+
+    sim_numdbs = numdbs;
+    sim_clock = 0;
+    for (j = 0; j < numdbs; j++) {
+        wsum += weights[j];
+        sim_dbs[j].live = realloc(sim_dbs[j].live,sizeof(int)*numkeys);
+        sim_dbs[j].len = 0;
+    }
+    for (j = 0; j < numkeys; j++) {
+        int r = simRandom() % wsum, d = 0;
+        simDb *db;
+
+        while (r >= weights[d]) r -= weights[d++];
+        db = sim_dbs+d;
+        sim_keys[j].atime = ++sim_clock;
+        sim_keys[j].dbid = d;
+        sim_keys[j].pos = db->len;
+        db->live[db->len++] = j;
+    }
+    for (j = 0; j < numkeys*2; j++) {
+        int key = (int)(numkeys*pow(simRandomUnit(),3));
+        sim_keys[key].atime = ++sim_clock;
+    }
+}
+
+static int simCompareTime(const void *a, const void *b) {
+    unsigned long long ta = *(const unsigned long long*)a;
+    unsigned long long tb = *(const unsigned long long*)b;
+    return (ta > tb) - (ta < tb);
+}
+
+/* Evict half of the keys and return the percentage of the evicted keys
+ * that are among the least recently used half. */
+static double simRun(int numkeys, const int *weights, int numdbs,
+                     int poolsize, int samples, int shared)
+{
+    static simPoolEntry pools[SIM_MAX_DBS][SIM_MAX_POOL];
+    unsigned long long *times, threshold;
+    int j, evicted = 0, hits = 0, toevict = numkeys/2;
+
+    simSetup(numkeys,weights,numdbs);
+
+    /* Access times are unique: the true LRU evicts the keys with an
+     * access time up to the toevict-th smallest one. */
+    times = malloc(sizeof(*times)*numkeys);
+    for (j = 0; j < numkeys; j++) times[j] = sim_keys[j].atime;
+    qsort(times,numkeys,sizeof(*times),simCompareTime);
+    threshold = times[toevict-1];
+    free(times);
+
+    for (j = 0; j < numdbs; j++) simPoolReset(pools[j],poolsize);
+    while (evicted < toevict) {
+        for (j = 0; j < (shared ? 1 : numdbs) && evicted < toevict; j++) {
+            int key = shared ? simPickShared(pools[0],poolsize,samples) :
+                               simPickPerDb(pools[j],poolsize,samples,j);
+            if (key == -1) continue;
+            if (sim_keys[key].atime <= threshold) hits++;
+            simEvict(key);
+            evicted++;
+        }
+    }
+    return (double)hits*100/toevict;
+}
+
+/* Return a Zipf distributed rank in [0,n) using the cumulative
+ * distribution 'cdf'. */
+static int simZipf(const double *cdf, int n) {
+    double r = simRandomUnit();
+    int lo = 0, hi = n-1;
+
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+
+        if (cdf[mid] < r) lo = mid+1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Serve 'numreqs' requests of 'universe' keys, with Zipf exponent 'alpha',
+ * from a cache of 'cachesize' keys evicting with the shared pool. When
+ * 'shift' is true the popularity ranks are rotated by half the universe
+ * halfway through the trace. Return the hit rate in percent. */
+static double simCache(int universe, int cachesize, double alpha,
+                       long long numreqs, int shift, int lfu)
+{
+    static simPoolEntry pool[SIM_MAX_POOL];
+    simDb *db = sim_dbs;
+    double *cdf, sum = 0;
+    long long j, hits = 0;
+    int k;
+
+    /* The cache is the single DB 0, keys out of the cache have pos -1. */
+    cdf = malloc(sizeof(*cdf)*universe);
+    for (k = 0; k < universe; k++) cdf[k] = (sum += 1.0/pow(k+1,alpha));
+    for (k = 0; k < universe; k++) cdf[k] /= sum;
+    for (k = 0; k < universe; k++) sim_keys[k].pos = -1;
+    db->live = realloc(db->live,sizeof(int)*cachesize);
+    db->len = 0;
+    sim_numdbs = 1;
+    sim_clock = 0;
+    sim_lfu = lfu;
+    simPoolReset(pool,REDIS_EVICTION_POOL_SIZE);
+
+    for (j = 0; j < numreqs; j++) {
+        int key = simZipf(cdf,universe);
+        simKey *sk;
+
+        if (shift && j >= numreqs/2) key = (key+universe/2) % universe;
+        sk = sim_keys+key;
+        if (sk->pos != -1) {
+            hits++;
+            simTouch(sk);
+            continue;
+        }
+        if (db->len == cachesize)
+            simEvict(simPickShared(pool,REDIS_EVICTION_POOL_SIZE,
+                                   REDIS_DEFAULT_MAXMEMORY_SAMPLES));
+
+        /* New keys start with REDIS_LFU_INIT_VAL, see createObject(). */
+        sk->atime = ++sim_clock;
+        sk->counter = REDIS_LFU_INIT_VAL;
+        sk->ldt = simMinutes();
+        sk->dbid = 0;
+        sk->pos = db->len;
+        db->live[db->len++] = key;
+    }
+    sim_lfu = 0;
+    free(cdf);
+    return (double)hits*100/numreqs;
+}
+
+int main(int argc, char **argv) {
+    static const int one[] = {1};
+    static const int uneven[] = {70,20,9,1};
+    static const int poolsizes[] = {1,16,64};
+    static const int samplecounts[] = {1,3,5,10};
+    int numkeys = argc > 1 ? atoi(argv[1]) : 100000;
+    int p, s;
+
+    if (numkeys < 2) {
+        fprintf(stderr,"Usage: %s [keys]\n",argv[0]);
+        return 1;
+    }
+    sim_keys = malloc(sizeof(*sim_keys)*numkeys);
+
+    printf("%d keys, evicting %d, precision vs true LRU\n",
+        numkeys,numkeys/2);
+    printf("%5s %8s %12s %12s %12s\n",
+        "pool","samples","1 db","4 dbs","4 dbs/per-db");
+    for (p = 0; p < (int)(sizeof(poolsizes)/sizeof(int)); p++) {
+        for (s = 0; s < (int)(sizeof(samplecounts)/sizeof(int)); s++) {
+            int pool = poolsizes[p], samples = samplecounts[s];
+
+            printf("%5d %8d %11.2f%% %11.2f%% %11.2f%%\n", pool, samples,
+                simRun(numkeys,one,1,pool,samples,1),
+                simRun(numkeys,uneven,4,pool,samples,1),
+                simRun(numkeys,uneven,4,pool,samples,0));
+        }
+    }
+
+    /* The cache holds from 1% to 10% of the keys requested. */
+    {
+        static const double alphas[] = {0.8,1.0,1.2};
+        static const int ratios[] = {100,20,10};
+        long long numreqs = (long long)numkeys*50;
+        int a, r, shift;
+
+        printf("\n%d keys requested with Zipf distribution, %lld requests, "
+               "pool %d, samples %d\n", numkeys, numreqs,
+               REDIS_EVICTION_POOL_SIZE, REDIS_DEFAULT_MAXMEMORY_SAMPLES);
+        printf("%6s %6s %8s %10s %10s\n",
+            "alpha","cache","trace","lru hits","lfu hits");
+        for (shift = 0; shift <= 1; shift++) {
+            for (a = 0; a < (int)(sizeof(alphas)/sizeof(double)); a++) {
+                for (r = 0; r < (int)(sizeof(ratios)/sizeof(int)); r++) {
+                    int cachesize = numkeys/ratios[r];
+
+                    if (cachesize < 1) continue;
+                    printf("%6.1f %5d%% %8s %9.2f%% %9.2f%%\n",
+                        alphas[a], 100/ratios[r],
+                        shift ? "shifting" : "static",
+                        simCache(numkeys,cachesize,alphas[a],numreqs,shift,0),
+                        simCache(numkeys,cachesize,alphas[a],numreqs,shift,1));
+                }
+            }
+        }
+    }
+    free(sim_keys);
+    return 0;
+}
+#endif
@@ -0,0 +1,182 @@
+/* Time-bucketed index of keys with an expire set.
+ *
+ * 带过期时间的键的时间轮索引。
+ *
+ * By default activeExpireCycle() samples random keys from db->expires and
+ * keeps going only while enough of the sampled keys are found expired. This
+ * has a very small memory overhead, but when millions of keys share similar
+ * TTLs the already expired keys may linger in memory for a long time, while
+ * the cycle burns its whole time budget sampling keys that are not yet due.
+ *
+ * 默认情况下，activeExpireCycle() 从 db->expires 中随机抽样检查过期键。
+ * 这种方式的内存开销很小，但当大量键的 TTL 相近时，
+ * 已过期的键可能会在内存中停留很长时间。
+ *
+ * When server.active_expire_wheel is true every DB also owns a timer wheel:
+ * an array of REDIS_EXPIRE_WHEEL_SLOTS buckets, every bucket covering
+ * REDIS_EXPIRE_WHEEL_RESOLUTION milliseconds. A key with an expire at time
+ * 'when' is linked into the bucket (when/resolution) % slots, so the cron
+ * only needs to visit the buckets that became due since the last call,
+ * popping exactly the keys that are expired.
+ *
+ * 当 server.active_expire_wheel 为真时，每个数据库都带有一个时间轮：
+ * 时间轮由 REDIS_EXPIRE_WHEEL_SLOTS 个桶组成，
+ * 每个桶覆盖 REDIS_EXPIRE_WHEEL_RESOLUTION 毫秒。
+ * 过期时间为 when 的键被放到 (when/resolution) % slots 号桶中，
+ * 定时任务只需要访问已经到期的桶，就可以准确地找到所有过期键。
+ *
+ * Keys expiring more than one revolution in the future share the bucket
+ * with keys expiring sooner: they are just skipped, and left in place, when
+ * the bucket is visited before their time.
+ *
+ * The index is lazy: db->expires is always the authoritative source. When
+ * an expire is removed or changed the old entry is not searched, instead it
+ * is discarded when its bucket is visited and the entry is found to no
+ * longer match the time stored in db->expires.
+ *
+ * 索引是惰性的：db->expires 始终是权威数据。
+ * 当键的过期时间被移除或者修改时，旧的索引项不会被立即删除，
+ * 而是在它所在的桶被访问时，发现和 db->expires 中的时间不一致而被丢弃。
+ */
+
+#include "redis.h"
+
+/* Create an empty timer wheel starting at the current time. */
+// 创建一个新的空时间轮
+expireWheel *expireWheelCreate(void) {
+    expireWheel *w = zmalloc(sizeof(*w));
+
+    w->slots = zcalloc(sizeof(expireWheelEntry*)*REDIS_EXPIRE_WHEEL_SLOTS);
+    w->tick = mstime()/REDIS_EXPIRE_WHEEL_RESOLUTION;
+    w->entries = 0;
+    return w;
+}
+
+/* Remove all the entries from the wheel, without releasing the wheel. */
+// 清空时间轮中的所有索引项
+void expireWheelEmpty(expireWheel *w) {
+    int j;
+
+    for (j = 0; j < REDIS_EXPIRE_WHEEL_SLOTS; j++) {
+        expireWheelEntry *e = w->slots[j], *next;
+
+        while(e) {
+            next = e->next;
+            sdsfree(e->key);
+            zfree(e);
+            e = next;
+        }
+        w->slots[j] = NULL;
+    }
+    w->entries = 0;
+}
+
+/* Index the key 'key' of 'db' as expiring at the unix time 'when' in
+ * milliseconds. This is a no-op if the DB has no timer wheel.
+ *
+ * Every setExpire() call should call this function: previous entries for
+ * the same key do not need to be removed. */
+// 将过期时间为 when 的键 key 添加到数据库的时间轮中
+void expireWheelAdd(redisDb *db, sds key, long long when) {
+    expireWheel *w = db->expire_wheel;
+    expireWheelEntry *e;
+    long long tick;
+    int slot;
+
+    if (w == NULL) return;
+
+    /* Keys already due are stored in the next bucket we are going to
+     * visit. */
+    // 已经过期的键放到下一个要访问的桶中
+    tick = when/REDIS_EXPIRE_WHEEL_RESOLUTION;
+    if (tick < w->tick) tick = w->tick;
+    slot = tick % REDIS_EXPIRE_WHEEL_SLOTS;
+
+    e = zmalloc(sizeof(*e));
+    e->key = sdsdup(key);
+    e->when = when;
+    e->next = w->slots[slot];
+    w->slots[slot] = e;
+    w->entries++;
+}
+
+/* Visit all the buckets of the DB timer wheel that are due, expiring the
+ * keys that are actually expired, discarding stale entries, and leaving
+ * in place the entries expiring in a future revolution.
+ *
+ * 访问数据库时间轮中所有已经到期的桶，删除已过期的键，
+ * 丢弃失效的索引项，并保留那些在之后的轮次中才过期的索引项。
+ *
+ * The function returns 1 if it returned because the time limit was
+ * reached ('start' and 'timelimit' are in microseconds, like in
+ * activeExpireCycle()), otherwise 0 is returned. The number of keys
+ * expired is added to '*expired'. */
+int expireWheelProcess(redisDb *db, long long start, long long timelimit,
+                       long long *expired)
+{
+    expireWheel *w = db->expire_wheel;
+    long long now = mstime();
+    long long now_tick = now/REDIS_EXPIRE_WHEEL_RESOLUTION;
+
+    /* If we are late for more than a whole revolution, visiting every
+     * bucket once is enough to find all the expired keys. */
+    // 如果落后超过一整轮，那么每个桶只需要访问一次
+    if (now_tick - w->tick > REDIS_EXPIRE_WHEEL_SLOTS)
+        w->tick = now_tick - REDIS_EXPIRE_WHEEL_SLOTS;
+
+    /* Only visit buckets whose time range is entirely in the past: the
+     * bucket of the current tick may still receive keys expiring within
+     * this tick, so it is visited at the next call. */
+    // 只访问时间范围已经完全过去的桶
+    while (w->tick < now_tick) {
+        int slot = w->tick % REDIS_EXPIRE_WHEEL_SLOTS;
+        expireWheelEntry *e = w->slots[slot], *next, *keep = NULL;
+        expireWheelEntry *keep_tail = NULL;
+        unsigned long visited = 0;
+
+        while(e) {
+            /* Many keys may share the same expire time and end in the same
+             * bucket: check the time limit every 16 entries, and if it was
+             * reached leave the rest of the bucket for the next call,
+             * without advancing w->tick. */
+            // 每处理 16 个索引项检查一次时间限制，超时的话将桶中余下的索引项
+            // 留到下次调用再处理，并且不移动 w->tick
+            if ((++visited & 0xf) == 0 && (ustime()-start) > timelimit) {
+                if (keep) {
+                    keep_tail->next = e;
+                    w->slots[slot] = keep;
+                } else {
+                    w->slots[slot] = e;
+                }
+                return 1;
+            }
+
+            next = e->next;
+            if (e->when > now) {
+                /* Expires in a future revolution: keep it. */
+                // 在之后的轮次才过期，保留
+                e->next = keep;
+                keep = e;
+                if (keep_tail == NULL) keep_tail = e;
+            } else {
+                dictEntry *de = dictFind(db->expires,e->key);
+
+                /* Only expire the key if the entry still matches the
+                 * current expire of the key, otherwise it is stale. */
+                // 只有在索引项和键当前的过期时间一致时才删除键
+                if (de && dictGetSignedIntegerVal(de) == e->when &&
+                    activeExpireCycleTryExpire(db,de,now)) (*expired)++;
+                sdsfree(e->key);
+                zfree(e);
+                w->entries--;
+            }
+            e = next;
+        }
+        w->slots[slot] = keep;
+        w->tick++;
+
+        // 已经超时了，返回
+        if ((ustime()-start) > timelimit) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+/* Latency histograms of commands and event loop iterations.
+ *
+ * 命令以及事件循环迭代的延迟直方图。
+ *
+ * call() records for every command the total microseconds and the number
+ * of calls, so INFO commandstats can only show the average latency, that
+ * hides the tail. The histograms in this file keep the distribution of the
+ * samples, so that percentiles such as p50, p99 and p99.9 can be reported.
+ *
+ * call() 只为每个命令记录总耗时和调用次数，所以只能得出平均延迟，
+ * 看不到长尾延迟。这个文件中的直方图保存了延迟的分布，
+ * 可以用来计算 p50 、 p99 和 p99.9 等百分位数。
+ *
+ * The buckets are log-linear, like the ones of HdrHistogram: values below
+ * 2^REDIS_LATENCY_HIST_SUB_BITS microseconds have a bucket each, then every
+ * power of two is split into 2^REDIS_LATENCY_HIST_SUB_BITS buckets of the
+ * same width, so the relative error of a reported value is bounded by
+ * 1/2^REDIS_LATENCY_HIST_SUB_BITS. Adding a sample is a count of leading
+ * zeros, a shift and an increment.
+ *
+ * 直方图的桶是对数线性的（和 HdrHistogram 一样）：
+ * 每个 2 的幂之间的区间被分成 2^REDIS_LATENCY_HIST_SUB_BITS 个等宽的桶，
+ * 所以结果的相对误差不超过 1/2^REDIS_LATENCY_HIST_SUB_BITS 。
+ * 添加一个样本只需要一次前导零计数、一次移位和一次加法。
+ *
+ * The histogram of a command is allocated the first time the command is
+ * called, so commands never used cost only a pointer. */
+
+#include "redis.h"
+
+// 记录事件循环每次迭代（不包括等待事件的时间）耗时的直方图
+static latencyHistogram eventloop_hist;
+
+/* ------------------------------ Histograms ------------------------------- */
+
+// 返回保存 usec 的桶的索引
+static int latencyHistogramIndex(long long usec) {
+    unsigned long long v = usec;
+    int msb, shift;
+
+    if (v < (1ULL << REDIS_LATENCY_HIST_SUB_BITS)) return (int) v;
+    if (v >= (1ULL << REDIS_LATENCY_HIST_MAX_BITS))
+        return REDIS_LATENCY_HIST_BUCKETS-1;
+
+    // 最高位的位置
+#if defined(__GNUC__)
+    msb = 63 - __builtin_clzll(v);
+#else
+    msb = 0;
+    while (v >> (msb+1)) msb++;
+#endif
+    shift = msb - REDIS_LATENCY_HIST_SUB_BITS;
+    return ((shift+1) << REDIS_LATENCY_HIST_SUB_BITS) +
+           (int) ((v >> shift) & ((1 << REDIS_LATENCY_HIST_SUB_BITS)-1));
+}
+
+/* Return the highest value that is stored in the bucket 'idx'. */
+// 返回桶中可以保存的最大值
+static long long latencyHistogramBucketValue(int idx) {
+    int group = idx >> REDIS_LATENCY_HIST_SUB_BITS, shift;
+    long long sub = idx & ((1 << REDIS_LATENCY_HIST_SUB_BITS)-1);
+
+    if (group == 0) return sub;
+    shift = group - 1;
+    return (((1LL << REDIS_LATENCY_HIST_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+latencyHistogram *latencyHistogramCreate(void) {
+    return zcalloc(sizeof(latencyHistogram));
+}
+
+void latencyHistogramReset(latencyHistogram *h) {
+    memset(h,0,sizeof(*h));
+}
+
+// 添加一个以微秒为单位的样本
+void latencyHistogramAdd(latencyHistogram *h, long long usec) {
+    if (usec < 0) usec = 0;
+    h->buckets[latencyHistogramIndex(usec)]++;
+    h->count++;
+    if (usec > h->max) h->max = usec;
+}
+
+/* Return the value below which 'perc' percent of the samples fall, with
+ * the precision of the buckets, or 0 if the histogram is empty.
+ *
+ * 返回百分位数 perc 对应的值，直方图为空时返回 0 。 */
+long long latencyHistogramPercentile(latencyHistogram *h, double perc) {
+    unsigned long long target, seen = 0;
+    int j;
+
+    if (h->count == 0) return 0;
+    target = (unsigned long long) (perc/100*h->count + 0.5);
+    if (target == 0) target = 1;
+    for (j = 0; j < REDIS_LATENCY_HIST_BUCKETS; j++) {
+        seen += h->buckets[j];
+        if (seen >= target) {
+            long long value = latencyHistogramBucketValue(j);
+            return value < h->max ? value : h->max;
+        }
+    }
+    return h->max;
+}
+
+/* ------------------------------- Samples --------------------------------- */
+
+/* Called by call() for every command executed. */
+void latencyAddCommandSample(struct redisCommand *cmd, long long usec) {
+    if (cmd->latency == NULL) cmd->latency = latencyHistogramCreate();
+    latencyHistogramAdd(cmd->latency,usec);
+}
+
+/* Called by beforeSleep() with the time spent processing the events of the
+ * iteration of the event loop that is ending. */
+void latencyAddEventLoopSample(long long usec) {
+    latencyHistogramAdd(&eventloop_hist,usec);
+}
+
+/* Drop the samples of a command, called by resetCommandTableStats(). */
+void latencyResetCommand(struct redisCommand *cmd) {
+    zfree(cmd->latency);
+    cmd->latency = NULL;
+}
+
+void latencyResetEventLoop(void) {
+    latencyHistogramReset(&eventloop_hist);
+}
+
+/* ---------------------------- INFO latencystats -------------------------- */
+
+static sds latencyCatPercentiles(sds info, char *name, latencyHistogram *h) {
+    return sdscatprintf(info,
+        "%s:p50=%lld,p99=%lld,p99.9=%lld,max=%lld,samples=%lld\r\n",
+        name,
+        latencyHistogramPercentile(h,50),
+        latencyHistogramPercentile(h,99),
+        latencyHistogramPercentile(h,99.9),
+        h->max, h->count);
+}
+
+/* Append the lines of the latencystats INFO section to 'info'. */
+// 生成 INFO latencystats 的内容
+sds genLatencyStatsInfoString(sds info) {
+    dictIterator *di;
+    dictEntry *de;
+
+    info = latencyCatPercentiles(info,"eventloop_percentiles_usec",
+        &eventloop_hist);
+    di = dictGetIterator(server.commands);
+    while((de = dictNext(di)) != NULL) {
+        struct redisCommand *c = dictGetVal(de);
+        char name[128];
+
+        if (!c->latency || !c->latency->count) continue;
+        snprintf(name,sizeof(name),"latency_percentiles_usec_%s",c->name);
+        info = latencyCatPercentiles(info,name,c->latency);
+    }
+    dictReleaseIterator(di);
+    return info;
+}
+
+/* ------------------------------ LATENCY command -------------------------- */
+
+/* Reply with the non empty buckets of 'h' as a flat array of
+ * <bucket max usec> <cumulative count> pairs. */
+static void latencyReplyHistogram(redisClient *c, latencyHistogram *h) {
+    void *replylen = addDeferredMultiBulkLength(c);
+    long long cumulative = 0;
+    long items = 0;
+    int j;
+
+    for (j = 0; j < REDIS_LATENCY_HIST_BUCKETS; j++) {
+        if (!h->buckets[j]) continue;
+        cumulative += h->buckets[j];
+        addReplyLongLong(c,latencyHistogramBucketValue(j));
+        addReplyLongLong(c,cumulative);
+        items += 2;
+    }
+    setDeferredMultiBulkLength(c,replylen,items);
+}
+
+// 以 名字、调用次数、直方图 的格式回复一个命令的延迟
+static void latencyReplyCommand(redisClient *c, struct redisCommand *cmd) {
+    addReplyBulkCString(c,cmd->name);
+    addReplyMultiBulkLen(c,4);
+    addReplyBulkCString(c,"calls");
+    addReplyLongLong(c,cmd->latency->count);
+    addReplyBulkCString(c,"histogram_usec");
+    latencyReplyHistogram(c,cmd->latency);
+}
+
+/* LATENCY HISTOGRAM [command ...]
+ * LATENCY EVENTLOOP
+ *
+ * HISTOGRAM replies with the latency histograms of the given commands, or
+ * of all the commands called at least once. EVENTLOOP replies with the
+ * histogram of the duration of the event loop iterations. */
+void latencyCommand(redisClient *c) {
+    if (!strcasecmp(c->argv[1]->ptr,"histogram")) {
+        void *replylen = addDeferredMultiBulkLength(c);
+        long items = 0;
+        int j;
+
+        if (c->argc == 2) {
+            dictIterator *di = dictGetIterator(server.commands);
+            dictEntry *de;
+
+            while((de = dictNext(di)) != NULL) {
+                struct redisCommand *cmd = dictGetVal(de);
+
+                if (!cmd->latency || !cmd->latency->count) continue;
+                latencyReplyCommand(c,cmd);
+                items += 2;
+            }
+            dictReleaseIterator(di);
+        } else {
+            for (j = 2; j < c->argc; j++) {
+                struct redisCommand *cmd = lookupCommand(c->argv[j]->ptr);
+
+                if (!cmd || !cmd->latency || !cmd->latency->count) continue;
+                latencyReplyCommand(c,cmd);
+                items += 2;
+            }
+        }
+        setDeferredMultiBulkLength(c,replylen,items);
+    } else if (!strcasecmp(c->argv[1]->ptr,"eventloop") && c->argc == 2) {
+        addReplyMultiBulkLen(c,4);
+        addReplyBulkCString(c,"iterations");
+        addReplyLongLong(c,eventloop_hist.count);
+        addReplyBulkCString(c,"histogram_usec");
+        latencyReplyHistogram(c,&eventloop_hist);
+    } else {
+        addReplyError(c,
+            "Unknown LATENCY subcommand or wrong number of arguments");
+    }
+}
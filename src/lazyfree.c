@@ -0,0 +1,313 @@
+/* Lazy freeing of big values.
+ *
+ * 惰性释放：在后台线程中释放大对象。
+ *
+ * Deleting a key whose value is a big aggregate (a list, set, sorted set or
+ * hash with millions of elements) is O(N) and, when done synchronously by
+ * decrRefCount(), blocks the server for the whole time needed to release
+ * every single element.
+ *
+ * 删除一个包含大量元素的聚合类型的键是 O(N) 的操作，
+ * 如果在主线程中同步释放，服务器会在释放期间被阻塞。
+ *
+ * The functions in this file remove the key from the keyspace immediately
+ * (so from the point of view of the clients the key is gone) but, if the
+ * value is big enough, the value itself is reclaimed by a background thread.
+ *
+ * 这个文件中的函数会立即从键空间中移除键，
+ * 但如果值足够大，那么值会被放到后台线程中释放。
+ *
+ * The background thread works like the ones of bio.c: jobs are appended to a
+ * list protected by a mutex, and the thread is woken up using a condition
+ * variable. Objects handed to the thread must not be referenced anymore by
+ * the main thread. This is true for the value itself only if its refcount
+ * is 1, but the elements of linked lists, sets, sorted sets and hashes are
+ * refcounted objects too, and may be shared with other keys (SINTERSTORE,
+ * ZUNIONSTORE, RPOPLPUSH...) or with the slow log: refcounts are not
+ * atomic, so a value is freed lazily only if none of its elements is
+ * referenced from elsewhere (see lazyfreeObjectIsPrivate()). Shared objects
+ * use REDIS_SHARED_REFCOUNT so that they are never touched by decrRefCount().
+ *
+ * 交给后台线程的对象不能再被主线程引用。
+ * 聚合类型的元素也是带引用计数的对象，并且可能和其他键共享，
+ * 所以只有当值本身以及它的所有元素都没有在其他地方被引用时，才会被惰性释放。
+ */
+
+#include "redis.h"
+
+#include <pthread.h>
+
+/* Job types. */
+#define LAZYFREE_JOB_OBJECT 0   /* Free a single object. */
+
+// 后台线程的栈大小，和 bio.h 中的 REDIS_THREAD_STACK_SIZE 相同
+#define LAZYFREE_THREAD_STACK_SIZE (1024*1024*4)
+
+/* A job in the lazy free queue. */
+typedef struct lazyfreeJob {
+    int type;
+    void *arg1;
+} lazyfreeJob;
+
+static pthread_t lazyfree_thread;
+static pthread_mutex_t lazyfree_mutex;
+static pthread_cond_t lazyfree_condvar;
+static list *lazyfree_jobs;
+
+// 等待被后台线程释放的对象数量
+static unsigned long long lazyfree_objects = 0;
+
+void *lazyfreeProcessBackgroundJobs(void *arg);
+
+/* Initialize the lazy free subsystem, spawning the background thread. */
+// 初始化惰性释放系统，创建后台线程
+void lazyfreeInit(void) {
+    pthread_attr_t attr;
+    size_t stacksize;
+
+    pthread_mutex_init(&lazyfree_mutex,NULL);
+    pthread_cond_init(&lazyfree_condvar,NULL);
+    lazyfree_jobs = listCreate();
+
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr,&stacksize);
+    if (!stacksize) stacksize = 1; /* The world is full of Solaris Fixes */
+    while (stacksize < LAZYFREE_THREAD_STACK_SIZE) stacksize *= 2;
+    pthread_attr_setstacksize(&attr, stacksize);
+
+    if (pthread_create(&lazyfree_thread,&attr,
+                       lazyfreeProcessBackgroundJobs,NULL) != 0)
+    {
+        redisLog(REDIS_WARNING,"Fatal: Can't initialize the lazy free thread.");
+        exit(1);
+    }
+}
+
+/* Queue a job for the background thread. */
+static void lazyfreeCreateJob(int type, void *arg1) {
+    lazyfreeJob *job = zmalloc(sizeof(*job));
+
+    job->type = type;
+    job->arg1 = arg1;
+    pthread_mutex_lock(&lazyfree_mutex);
+    listAddNodeTail(lazyfree_jobs,job);
+    lazyfree_objects++;
+    pthread_cond_signal(&lazyfree_condvar);
+    pthread_mutex_unlock(&lazyfree_mutex);
+}
+
+void *lazyfreeProcessBackgroundJobs(void *arg) {
+    lazyfreeJob *job;
+    sigset_t sigset;
+
+    REDIS_NOTUSED(arg);
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        redisLog(REDIS_WARNING,
+            "Warning: can't mask SIGALRM in lazy free thread: %s",
+            strerror(errno));
+
+    pthread_mutex_lock(&lazyfree_mutex);
+    while(1) {
+        listNode *ln;
+
+        // 没有任务，等待
+        if (listLength(lazyfree_jobs) == 0) {
+            pthread_cond_wait(&lazyfree_condvar,&lazyfree_mutex);
+            continue;
+        }
+
+        /* Pop the job from the queue, and release the lock while we
+         * perform the (potentially slow) free. */
+        ln = listFirst(lazyfree_jobs);
+        job = ln->value;
+        listDelNode(lazyfree_jobs,ln);
+        pthread_mutex_unlock(&lazyfree_mutex);
+
+        if (job->type == LAZYFREE_JOB_OBJECT) {
+            decrRefCount(job->arg1);
+        } else {
+            redisPanic("Wrong job type in lazyfreeProcessBackgroundJobs().");
+        }
+        zfree(job);
+
+        pthread_mutex_lock(&lazyfree_mutex);
+        lazyfree_objects--;
+    }
+}
+
+/* Return the number of objects not yet reclaimed by the background
+ * thread. */
+// 返回后台线程尚未释放的任务数量
+unsigned long long lazyfreeGetPendingObjectsCount(void) {
+    unsigned long long count;
+
+    pthread_mutex_lock(&lazyfree_mutex);
+    count = lazyfree_objects;
+    pthread_mutex_unlock(&lazyfree_mutex);
+    return count;
+}
+
+/* Return the amount of work needed in order to free an object.
+ * The return value is not always the actual number of allocations the
+ * object is composed of, but a number proportional to it.
+ *
+ * 返回释放一个对象所需的工作量，
+ * 这个值不一定等于对象的内存分配次数，但和它成正比。
+ *
+ * For strings the function always returns 1.
+ *
+ * For aggregated objects represented by hash tables or other data structures
+ * the function just returns the number of elements the object is composed of.
+ *
+ * Objects composed of single allocations (ziplists, intsets) are always
+ * reported as having a single item even if they are actually logically
+ * composed of multiple elements. */
+size_t lazyfreeGetFreeEffort(robj *obj) {
+    if (obj->type == REDIS_LIST && obj->encoding == REDIS_ENCODING_LINKEDLIST) {
+        list *l = obj->ptr;
+        return listLength(l);
+    } else if (obj->type == REDIS_SET && obj->encoding == REDIS_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else if (obj->type == REDIS_ZSET && obj->encoding == REDIS_ENCODING_SKIPLIST){
+        zset *zs = obj->ptr;
+        return zs->zsl->length;
+    } else if (obj->type == REDIS_HASH && obj->encoding == REDIS_ENCODING_HT) {
+        dict *ht = obj->ptr;
+        return dictSize(ht);
+    } else {
+        return 1; /* Everything else is a single allocation. */
+    }
+}
+
+/* Return true if 'refcount' means that the object is referenced only by
+ * the aggregate being examined, that holds 'owners' references to it. */
+static int lazyfreeRefIsPrivate(robj *o, int owners) {
+    return o->refcount == owners || o->refcount == REDIS_SHARED_REFCOUNT;
+}
+
+/* Return true if the object 'o', and every element object it contains, is
+ * referenced only by 'o' itself, so that the background thread can release
+ * it without racing with the main thread on non atomic refcounts.
+ *
+ * 如果对象以及它包含的所有元素对象都没有在其他地方被引用，那么返回真。
+ *
+ * This walks all the elements, but it only reads them: it's much cheaper
+ * than releasing them. Sorted sets reference every element twice, from the
+ * skiplist and from the dict. */
+static int lazyfreeObjectIsPrivate(robj *o) {
+    if (o->refcount != 1) return 0;
+
+    if (o->type == REDIS_LIST && o->encoding == REDIS_ENCODING_LINKEDLIST) {
+        listIter li;
+        listNode *ln;
+
+        listRewind(o->ptr,&li);
+        while((ln = listNext(&li)) != NULL)
+            if (!lazyfreeRefIsPrivate(listNodeValue(ln),1)) return 0;
+    } else if (o->type == REDIS_ZSET &&
+               o->encoding == REDIS_ENCODING_SKIPLIST)
+    {
+        zskiplistNode *zn = ((zset*)o->ptr)->zsl->header->level[0].forward;
+
+        for (; zn; zn = zn->level[0].forward)
+            if (!lazyfreeRefIsPrivate(zn->obj,2)) return 0;
+    } else if ((o->type == REDIS_SET || o->type == REDIS_HASH) &&
+               o->encoding == REDIS_ENCODING_HT)
+    {
+        dictIterator *di = dictGetIterator(o->ptr);
+        dictEntry *de;
+        int private = 1;
+
+        while(private && (de = dictNext(di)) != NULL) {
+            if (!lazyfreeRefIsPrivate(dictGetKey(de),1) ||
+                (o->type == REDIS_HASH &&
+                 !lazyfreeRefIsPrivate(dictGetVal(de),1))) private = 0;
+        }
+        dictReleaseIterator(di);
+        return private;
+    }
+    return 1;
+}
+
+/* Release an object, in a background thread if its free effort is greater
+ * than REDIS_LAZYFREE_THRESHOLD and no one else references it or its
+ * elements, otherwise synchronously. */
+// 释放对象，如果对象足够大并且没有被共享，那么交给后台线程释放
+void freeObjAsync(robj *o) {
+    size_t free_effort = lazyfreeGetFreeEffort(o);
+
+    if (free_effort > REDIS_LAZYFREE_THRESHOLD && lazyfreeObjectIsPrivate(o)) {
+        lazyfreeCreateJob(LAZYFREE_JOB_OBJECT,o);
+    } else {
+        decrRefCount(o);
+    }
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the DB.
+ * If there are enough allocations to free the value object may be put into
+ * a lazy free list instead of being freed synchronously. The lazy free list
+ * will be reclaimed in a different thread.
+ *
+ * 从数据库中删除给定的键，键的值，以及键的过期时间。
+ * 如果值足够大，那么值会被交给后台线程释放。
+ *
+ * Returns 1 if the key was deleted, 0 if the key was not found. */
+int dbAsyncDelete(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    /* Deleting an entry from the expires dict will not free the sds of
+     * the key, because it is shared with the main dictionary. */
+    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
+
+    de = dictFind(db->dict,key->ptr);
+    if (de) {
+        robj *val = dictGetVal(de);
+        size_t free_effort = lazyfreeGetFreeEffort(val);
+
+        /* If releasing the object is too much work, let's put it into the
+         * lazy free list. */
+        if (free_effort > REDIS_LAZYFREE_THRESHOLD &&
+            lazyfreeObjectIsPrivate(val))
+        {
+            lazyfreeCreateJob(LAZYFREE_JOB_OBJECT,val);
+            // 将值设为 NULL ，这样 dictDelete 就不会释放它
+            dictSetVal(db->dict,de,NULL);
+        }
+
+        /* Release the key-val pair, or just the key if we set the val
+         * field to NULL in order to lazy free it later. */
+        dictDelete(db->dict,key->ptr);
+        if (server.cluster_enabled) slotToKeyDel(key);
+        return 1;
+    }
+    return 0;
+}
+
+/* Remove the specified keys from the keyspace like DEL does, but reclaim
+ * the memory of big values in a background thread.
+ *
+ * UNLINK key [key ...]
+ *
+ * 和 DEL 一样删除给定的键，但大对象的内存由后台线程回收。 */
+void unlinkCommand(redisClient *c) {
+    int deleted = 0, j;
+
+    for (j = 1; j < c->argc; j++) {
+        // 先删除过期键
+        expireIfNeeded(c->db,c->argv[j]);
+        if (dbAsyncDelete(c->db,c->argv[j])) {
+            signalModifiedKey(c->db,c->argv[j]);
+            notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,
+                "del",c->argv[j],c->db->id);
+            server.dirty++;
+            deleted++;
+        }
+    }
+    addReplyLongLong(c,deleted);
+}
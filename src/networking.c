@@ -1,5 +1,6 @@
 #include "redis.h"
 #include <sys/uio.h>
+#include <poll.h>
 #include <math.h>
 
 static void setProtocolError(redisClient *c, int pos);
@@ -9,22 +10,105 @@ size_t zmalloc_size_sds(sds s) {
     return zmalloc_size(s-sizeof(struct sdshdr));
 }
 
-// 返回 object->ptr 所指向的字符串对象所使用的内存数量。
-size_t getStringObjectSdsUsedMemory(robj *o) {
-    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-    switch(o->encoding) {
-    case REDIS_ENCODING_RAW: return zmalloc_size_sds(o->ptr);
-    case REDIS_ENCODING_EMBSTR: return sdslen(o->ptr);
-    default: return 0; /* Just integer encoding for now. */
+/* ----------------------------------------------------------------------------
+ * Reply blocks pool.
+ *
+ * 回复块池
+ *
+ * Blocks of REDIS_REPLY_BLOCK_SIZE bytes released by the clients are kept
+ * in a global pool, up to REDIS_REPLY_BLOCK_POOL_SIZE blocks, so that
+ * clients producing many replies don't allocate and free memory for every
+ * reply. Blocks of other sizes (see setDeferredMultiBulkLength()) are not
+ * pooled.
+ *
+ * Blocks that stay unused in the pool are released by clientsCron() via
+ * replyBlockPoolTrim(), and the memory still pooled is not counted against
+ * maxmemory, see replyBlockPoolMemory().
+ *
+ * 客户端释放的回复块会被保存到全局的空闲块池中，
+ * 这样产生大量回复的客户端不需要为每个回复分配和释放内存。
+ * 长时间没有被使用的块会由 clientsCron() 释放。
+ * -------------------------------------------------------------------------- */
+
+static clientReplyBlock *replyBlockPool[REDIS_REPLY_BLOCK_POOL_SIZE];
+static int replyBlockPoolLen = 0;
+
+/* Smallest length the pool reached since the last replyBlockPoolTrim():
+ * this many blocks were never taken in the meantime. */
+// 上次修剪以来池的最小长度，也即这段时间内一直没有被使用的块的数量
+static int replyBlockPoolLowWater = 0;
+
+// 创建一个可以容纳 size 字节的回复块，标准大小的回复块从池中取出
+static clientReplyBlock *replyBlockCreate(size_t size) {
+    clientReplyBlock *b;
+
+    if (size == REDIS_REPLY_BLOCK_SIZE-sizeof(clientReplyBlock) &&
+        replyBlockPoolLen > 0)
+    {
+        b = replyBlockPool[--replyBlockPoolLen];
+        if (replyBlockPoolLen < replyBlockPoolLowWater)
+            replyBlockPoolLowWater = replyBlockPoolLen;
+    } else {
+        b = zmalloc(sizeof(*b)+size);
+        b->size = size;
+    }
+    b->used = 0;
+    return b;
+}
+
+/* Create a block for the tail of the reply list. */
+static clientReplyBlock *replyBlockCreateDefault(void) {
+    return replyBlockCreate(REDIS_REPLY_BLOCK_SIZE-sizeof(clientReplyBlock));
+}
+
+/*
+ * 回复块释放函数，标准大小的回复块会被放回池中
+ */
+void freeClientReplyValue(void *o) {
+    clientReplyBlock *b = o;
+
+    // 延迟设置的多条回复长度的占位节点
+    if (b == NULL) return;
+    if (b->size == REDIS_REPLY_BLOCK_SIZE-sizeof(clientReplyBlock) &&
+        replyBlockPoolLen < REDIS_REPLY_BLOCK_POOL_SIZE)
+    {
+        replyBlockPool[replyBlockPoolLen++] = b;
+    } else {
+        zfree(b);
     }
 }
 
+/* Release half of the blocks that were not taken from the pool since the
+ * previous call, so an idle pool shrinks to zero in a few calls while a
+ * pool in use keeps the blocks it needs. Called by clientsCron().
+ *
+ * 释放上次调用以来一直没有被使用的块中的一半，
+ * 这样空闲的池会在几次调用之后清空，而正在使用的池则保留它需要的块。 */
+void replyBlockPoolTrim(void) {
+    int idle = replyBlockPoolLowWater;
+
+    if (idle > replyBlockPoolLen) idle = replyBlockPoolLen;
+    idle = (idle+1)/2;
+    while(idle--) zfree(replyBlockPool[--replyBlockPoolLen]);
+    replyBlockPoolLowWater = replyBlockPoolLen;
+}
+
+/* Return the memory used by the blocks in the pool. */
+// 返回池中的块占用的内存
+size_t replyBlockPoolMemory(void) {
+    return (size_t)replyBlockPoolLen*REDIS_REPLY_BLOCK_SIZE;
+}
+
 /*
- * 回复内容复制函数
+ * 回复块复制函数
  */
 void *dupClientReplyValue(void *o) {
-    incrRefCount((robj*)o);
-    return o;
+    clientReplyBlock *b = o, *copy;
+
+    copy = replyBlockCreate(b->size);
+    memcpy(copy->buf,b->buf,b->used);
+    copy->used = b->used;
+    return copy;
 }
 
 /*
@@ -36,8 +120,13 @@ int listMatchObjects(void *a, void *b) {
 
 /*
  * 创建一个新客户端
+ *
+ * When 'socket_ready' is true the socket was already set non blocking,
+ * with TCP_NODELAY and keepalive, by an accept thread.
+ *
+ * 如果 socket_ready 为真，那么套接字的选项已经由 accept 线程设置好了。
  */
-redisClient *createClient(int fd) {
+static redisClient *createClientGeneric(int fd, int socket_ready) {
 
     // 分配空间
     redisClient *c = zmalloc(sizeof(redisClient));
@@ -47,13 +136,15 @@ redisClient *createClient(int fd) {
     // 因为 Redis 的命令必须在客户端的上下文中使用，所以在执行 Lua 环境中的命令时
     // 需要用到这种伪终端
     if (fd != -1) {
-        // 非阻塞
-        anetNonBlock(NULL,fd);
-        // 禁用 Nagle 算法
-        anetEnableTcpNoDelay(NULL,fd);
-        // 设置 keep alive
-        if (server.tcpkeepalive)
-            anetKeepAlive(NULL,fd,server.tcpkeepalive);
+        if (!socket_ready) {
+            // 非阻塞
+            anetNonBlock(NULL,fd);
+            // 禁用 Nagle 算法
+            anetEnableTcpNoDelay(NULL,fd);
+            // 设置 keep alive
+            if (server.tcpkeepalive)
+                anetKeepAlive(NULL,fd,server.tcpkeepalive);
+        }
         // 绑定读事件到事件 loop （开始接收命令请求）
         if (aeCreateFileEvent(server.el,fd,AE_READABLE,
             readQueryFromClient, c) == AE_ERR)
@@ -78,6 +169,8 @@ redisClient *createClient(int fd) {
     c->querybuf = sdsempty();
     // 查询缓冲区峰值
     c->querybuf_peak = 0;
+    c->querybuf_cmdlen = 0;
+    c->querybuf_argv = NULL;
     // 命令请求的类型
     c->reqtype = 0;
     // 命令参数数量
@@ -86,6 +179,7 @@ redisClient *createClient(int fd) {
     c->argv = NULL;
     // 当前执行的命令和最近一次执行的命令
     c->cmd = c->lastcmd = NULL;
+    c->lastcmd_name = NULL;
     // 查询缓冲区中未读入的命令内容数量
     c->multibulklen = 0;
     // 读入的参数的长度
@@ -115,7 +209,7 @@ redisClient *createClient(int fd) {
     // 回复缓冲区大小达到软限制的时间
     c->obuf_soft_limit_reached_time = 0;
     // 回复链表的释放和复制函数
-    listSetFreeMethod(c->reply,decrRefCountVoid);
+    listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
     // 阻塞类型
     c->btype = REDIS_BLOCKED_NONE;
@@ -129,6 +223,7 @@ redisClient *createClient(int fd) {
     c->bpop.numreplicas = 0;
     c->bpop.reploffset = 0;
     c->woff = 0;
+    c->aof_sync_offset = 0;
     // 进行事务时监视的键
     c->watched_keys = listCreate();
     // 订阅的频道和模式
@@ -146,6 +241,10 @@ redisClient *createClient(int fd) {
     return c;
 }
 
+redisClient *createClient(int fd) {
+    return createClientGeneric(fd,0);
+}
+
 /*
  * 这个函数在每次向客户端发送数据时都会被调用。函数的行为如下：
  *
@@ -184,22 +283,6 @@ int prepareClientToWrite(redisClient *c) {
     return REDIS_OK;
 }
 
-// 当回复列表中的最后一个对象并非只属于回复的一部分时
-// 创建该对象的一个复制品
-robj *dupLastObjectIfNeeded(list *reply) {
-    robj *new, *cur;
-    listNode *ln;
-    redisAssert(listLength(reply) > 0);
-    ln = listLast(reply);
-    cur = listNodeValue(ln);
-    if (cur->refcount > 1) {
-        new = dupStringObject(cur);
-        decrRefCount(cur);
-        listNodeValue(ln) = new;
-    }
-    return listNodeValue(ln);
-}
-
 /* -----------------------------------------------------------------------------
  * Low level functions to add more data to output buffers.
  * -------------------------------------------------------------------------- */
@@ -230,45 +313,40 @@ int _addReplyToBuffer(redisClient *c, char *s, size_t len) {
 }
 
 /*
- * 将回复对象（一个 SDS ）添加到 c->reply 回复链表中
+ * 将字符串添加到 c->reply 回复链表中
+ *
+ * The string is copied in the free space of the last block, and in new
+ * blocks for the part that does not fit.
+ *
+ * 字符串首先被复制到链表最后一个回复块的空闲空间中，
+ * 放不下的部分被复制到新的回复块中。
  */
-void _addReplyObjectToList(redisClient *c, robj *o) {
-    robj *tail;
+void _addReplyStringToList(redisClient *c, char *s, size_t len) {
+    listNode *ln;
+    clientReplyBlock *tail;
 
     // 客户端即将被关闭，无须再发送回复
     if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
-    // 链表中无缓冲块，直接将对象追加到链表中
-    if (listLength(c->reply) == 0) {
-        incrRefCount(o);
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += getStringObjectSdsUsedMemory(o);
-
-        // 链表中已有缓冲块，尝试将回复添加到块内
-        // 如果当前的块不能容纳回复的话，那么新建一个块
-    } else {
-
-        // 取出表尾的 SDS
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        // 如果表尾 SDS 的已用空间加上对象的长度，小于 REDIS_REPLY_CHUNK_BYTES
-        // 那么将新对象的内容拼接到表尾 SDS 的末尾
-        if (tail->ptr != NULL &&
-            tail->encoding == REDIS_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(o->ptr) <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            // 拼接
-            tail->ptr = sdscatlen(tail->ptr,o->ptr,sdslen(o->ptr));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
+    ln = listLast(c->reply);
+    tail = ln ? listNodeValue(ln) : NULL;
+    while(len) {
+        // 尽可能多地复制到最后一个回复块中
+        if (tail && tail->used < tail->size) {
+            size_t avail = tail->size - tail->used;
+            size_t copy = avail >= len ? len : avail;
+
+            memcpy(tail->buf+tail->used,s,copy);
+            tail->used += copy;
+            s += copy;
+            len -= copy;
+        }
 
-        // 直接将对象追加到末尾
-        } else {
-            incrRefCount(o);
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += getStringObjectSdsUsedMemory(o);
+        // 最后一个回复块已满（或者是占位节点），新建一个回复块
+        if (len) {
+            tail = replyBlockCreateDefault();
+            listAddNodeTail(c->reply,tail);
+            c->reply_bytes += zmalloc_size(tail);
         }
     }
 
@@ -276,70 +354,17 @@ void _addReplyObjectToList(redisClient *c, robj *o) {
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
-// 和 _addReplyObjectToList 类似，但会负责 SDS 的释放功能（如果需要的话）
-void _addReplySdsToList(redisClient *c, sds s) {
-    robj *tail;
-
-    if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
-        sdsfree(s);
-        return;
-    }
-
-    if (listLength(c->reply) == 0) {
-        listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-        c->reply_bytes += zmalloc_size_sds(s);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == REDIS_ENCODING_RAW &&
-            sdslen(tail->ptr)+sdslen(s) <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-            sdsfree(s);
-        } else {
-            listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-            c->reply_bytes += zmalloc_size_sds(s);
-        }
-    }
-    asyncCloseClientOnOutputBufferLimitReached(c);
+/*
+ * 将回复对象（一个 SDS ）添加到 c->reply 回复链表中
+ */
+void _addReplyObjectToList(redisClient *c, robj *o) {
+    _addReplyStringToList(c,o->ptr,sdslen(o->ptr));
 }
 
-void _addReplyStringToList(redisClient *c, char *s, size_t len) {
-    robj *tail;
-
-    if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
-
-    if (listLength(c->reply) == 0) {
-        // 为字符串创建字符串对象并追加到回复链表末尾
-        robj *o = createStringObject(s,len);
-
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += getStringObjectSdsUsedMemory(o);
-    } else {
-        tail = listNodeValue(listLast(c->reply));
-
-        /* Append to this object when possible. */
-        if (tail->ptr != NULL && tail->encoding == REDIS_ENCODING_RAW &&
-            sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES)
-        {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
-            tail = dupLastObjectIfNeeded(c->reply);
-            // 将字符串拼接到一个 SDS 之后
-            tail->ptr = sdscatlen(tail->ptr,s,len);
-            c->reply_bytes += zmalloc_size_sds(tail->ptr);
-        } else {
-            // 为字符串创建字符串对象并追加到回复链表末尾
-            robj *o = createStringObject(s,len);
-
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += getStringObjectSdsUsedMemory(o);
-        }
-    }
-    asyncCloseClientOnOutputBufferLimitReached(c);
+// 和 _addReplyObjectToList 类似，但会负责 SDS 的释放功能
+void _addReplySdsToList(redisClient *c, sds s) {
+    _addReplyStringToList(c,s,sdslen(s));
+    sdsfree(s);
 }
 
 /* -----------------------------------------------------------------------------
@@ -480,42 +505,46 @@ void addReplyStatusFormat(redisClient *c, const char *fmt, ...) {
     sdsfree(s);
 }
 
-/* Adds an empty object to the reply list that will contain the multi bulk
+/* Adds an empty node to the reply list that will contain the multi bulk
  * length, which is not known when this function is called. */
-// 当发送 Multi Bulk 回复时，先创建一个空的链表，之后再用实际的回复填充它
+// 当发送 Multi Bulk 回复时，先创建一个空的节点，之后再用实际的回复填充它
 void *addDeferredMultiBulkLength(redisClient *c) {
     /* Note that we install the write event here even if the object is not
      * ready to be sent, since we are sure that before returning to the
      * event loop setDeferredMultiBulkLength() will be called. */
     if (prepareClientToWrite(c) != REDIS_OK) return NULL;
-    listAddNodeTail(c->reply,createObject(REDIS_STRING,NULL));
+    listAddNodeTail(c->reply,NULL);
     return listLast(c->reply);
 }
 
-/* Populate the length object and try gluing it to the next chunk. */
+/* Populate the length node: the length is moved in front of the next block
+ * when there is room for it, otherwise a block of the exact size is used. */
 // 设置 Multi Bulk 回复的长度
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length) {
     listNode *ln = (listNode*)node;
-    robj *len, *next;
+    clientReplyBlock *next, *b;
+    char lenstr[128];
+    size_t lenstr_len;
 
     /* Abort when *node is NULL (see addDeferredMultiBulkLength). */
     if (node == NULL) return;
 
-    len = listNodeValue(ln);
-    len->ptr = sdscatprintf(sdsempty(),"*%ld\r\n",length);
-    len->encoding = REDIS_ENCODING_RAW; /* in case it was an EMBSTR. */
-    c->reply_bytes += zmalloc_size_sds(len->ptr);
-    if (ln->next != NULL) {
-        next = listNodeValue(ln->next);
-
-        /* Only glue when the next node is non-NULL (an sds in this case) */
-        if (next->ptr != NULL) {
-            c->reply_bytes -= zmalloc_size_sds(len->ptr);
-            c->reply_bytes -= getStringObjectSdsUsedMemory(next);
-            len->ptr = sdscatlen(len->ptr,next->ptr,sdslen(next->ptr));
-            c->reply_bytes += zmalloc_size_sds(len->ptr);
-            listDelNode(c->reply,ln->next);
-        }
+    lenstr_len = snprintf(lenstr,sizeof(lenstr),"*%ld\r\n",length);
+
+    /* Prepend the length to the next block if possible. */
+    // 如果下一个回复块有足够的空间，那么将长度放到它的开头
+    next = ln->next ? listNodeValue(ln->next) : NULL;
+    if (next && next->size - next->used >= lenstr_len) {
+        memmove(next->buf+lenstr_len,next->buf,next->used);
+        memcpy(next->buf,lenstr,lenstr_len);
+        next->used += lenstr_len;
+        listDelNode(c->reply,ln);
+    } else {
+        b = replyBlockCreate(lenstr_len);
+        memcpy(b->buf,lenstr,lenstr_len);
+        b->used = lenstr_len;
+        listNodeValue(ln) = b;
+        c->reply_bytes += zmalloc_size(b);
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
@@ -692,11 +721,11 @@ void copyClientOutputBuffer(redisClient *dst, redisClient *src) {
  * TCP 连接 accept 处理器
  */
 #define MAX_ACCEPTS_PER_CALL 1000
-static void acceptCommonHandler(int fd, int flags) {
+static void acceptCommonHandler(int fd, int flags, int socket_ready) {
 
     // 创建客户端
     redisClient *c;
-    if ((c = createClient(fd)) == NULL) {
+    if ((c = createClientGeneric(fd,socket_ready)) == NULL) {
         redisLog(REDIS_WARNING,
             "Error registering fd event for the new client: %s (fd=%d)",
             strerror(errno),fd);
@@ -752,7 +781,7 @@ void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         redisLog(REDIS_VERBOSE,"Accepted %s:%d", cip, cport);
         // 为客户端创建客户端状态（redisClient）
-        acceptCommonHandler(cfd,0);
+        acceptCommonHandler(cfd,0,0);
     }
 }
 
@@ -776,7 +805,187 @@ void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
         }
         redisLog(REDIS_VERBOSE,"Accepted connection to %s", server.unixsocket);
         // 为本地客户端创建客户端状态
-        acceptCommonHandler(cfd,REDIS_UNIX_SOCKET);
+        acceptCommonHandler(cfd,REDIS_UNIX_SOCKET,0);
+    }
+}
+
+/* ------------------------------ Accept threads ----------------------------
+ *
+ * accept 线程
+ *
+ * During reconnect storms tens of thousands of connections may arrive at
+ * the same time, and accepting them dominates the main thread. When
+ * server.accept_threads is greater than zero every thread has its own set of
+ * SO_REUSEPORT listening sockets for the configured addresses, so the kernel
+ * balances the new connections among the threads. A thread accepts the
+ * connections and configures the sockets (non blocking, TCP_NODELAY,
+ * keepalive), then queues them and wakes up the event loop through a pipe:
+ * only the creation of the client happens in the main thread.
+ *
+ * 当 server.accept_threads 大于 0 时，每个线程都有一组使用 SO_REUSEPORT
+ * 打开的监听套接字，由内核将新连接分配给各个线程。
+ * 线程负责 accept 新连接并设置套接字的选项，
+ * 然后将套接字放入队列，并通过管道唤醒事件循环，
+ * 主线程只负责为新连接创建客户端。 */
+
+typedef struct acceptThread {
+    pthread_t thread;
+    int fd[REDIS_BINDADDR_MAX];     /* Listening sockets of this thread. */
+    int count;                      /* Used slots in fd[]. */
+    char neterr[ANET_ERR_LEN];      /* Error buffer for anet calls. */
+} acceptThread;
+
+static struct {
+    acceptThread *threads;
+    int numthreads;
+    pthread_mutex_t mutex;
+    list *queue;                    /* Accepted sockets, as (void*)(long)fd */
+    int pipe[2];                    /* Used to wake up the event loop. */
+} acceptors;
+
+void *acceptThreadMain(void *arg) {
+    acceptThread *t = arg;
+    struct pollfd pfd[REDIS_BINDADDR_MAX];
+    sigset_t sigset;
+    int j;
+
+    /* Make sure only the main thread receives the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    for (j = 0; j < t->count; j++) {
+        pfd[j].fd = t->fd[j];
+        pfd[j].events = POLLIN;
+    }
+
+    while(1) {
+        if (poll(pfd,t->count,-1) == -1) {
+            if (errno == EINTR) continue;
+            redisLog(REDIS_WARNING,"Accept thread poll(): %s",
+                strerror(errno));
+            return NULL;
+        }
+
+        for (j = 0; j < t->count; j++) {
+            int cport, cfd, accepted = 0, max = MAX_ACCEPTS_PER_CALL;
+            char cip[REDIS_IP_STR_LEN], token = 'x';
+
+            if (pfd[j].revents & POLLNVAL) return NULL; /* Closed. */
+            if (!(pfd[j].revents & POLLIN)) continue;
+
+            while(max--) {
+                // accept 客户端连接，并设置套接字的选项
+                cfd = anetTcpAccept(t->neterr,pfd[j].fd,cip,sizeof(cip),&cport);
+                if (cfd == ANET_ERR) {
+                    if (errno != EWOULDBLOCK)
+                        redisLog(REDIS_WARNING,
+                            "Accepting client connection: %s", t->neterr);
+                    break;
+                }
+                anetNonBlock(NULL,cfd);
+                anetEnableTcpNoDelay(NULL,cfd);
+                if (server.tcpkeepalive)
+                    anetKeepAlive(NULL,cfd,server.tcpkeepalive);
+                redisLog(REDIS_VERBOSE,"Accepted %s:%d", cip, cport);
+
+                pthread_mutex_lock(&acceptors.mutex);
+                listAddNodeTail(acceptors.queue,(void*)(long)cfd);
+                pthread_mutex_unlock(&acceptors.mutex);
+                accepted++;
+            }
+
+            /* Wake up the event loop once per batch. If the pipe is full a
+             * wake up is already pending, so the error can be ignored. */
+            if (accepted && write(acceptors.pipe[1],&token,1) == -1) {
+                /* Nothing to do. */
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Called by the event loop when the accept threads queued new sockets:
+ * create the clients. */
+// 为 accept 线程接受的新连接创建客户端
+void acceptThreadsNotifyHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
+    char buf[64];
+    list *accepted;
+    listNode *ln;
+
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(privdata);
+    REDIS_NOTUSED(mask);
+
+    while (read(fd,buf,sizeof(buf)) > 0);
+
+    pthread_mutex_lock(&acceptors.mutex);
+    accepted = acceptors.queue;
+    acceptors.queue = listCreate();
+    pthread_mutex_unlock(&acceptors.mutex);
+
+    while ((ln = listFirst(accepted)) != NULL) {
+        acceptCommonHandler((long)listNodeValue(ln),0,1);
+        listDelNode(accepted,ln);
+    }
+    listRelease(accepted);
+}
+
+/* Start server.accept_threads accept threads. The first one uses the
+ * sockets in server.ipfd, already opened with SO_REUSEPORT by
+ * listenToPort(), the others open their own listening sockets for the
+ * same addresses.
+ *
+ * 启动 server.accept_threads 个 accept 线程。
+ * 第一个线程使用 server.ipfd 中的套接字，其他线程打开各自的监听套接字。 */
+void acceptThreadsInit(void) {
+    int j, numthreads = server.accept_threads;
+
+    if (numthreads > REDIS_ACCEPT_THREADS_MAX)
+        numthreads = REDIS_ACCEPT_THREADS_MAX;
+
+    pthread_mutex_init(&acceptors.mutex,NULL);
+    acceptors.queue = listCreate();
+    acceptors.threads = zcalloc(sizeof(acceptThread)*numthreads);
+    if (pipe(acceptors.pipe) == -1 ||
+        anetNonBlock(NULL,acceptors.pipe[0]) == ANET_ERR ||
+        anetNonBlock(NULL,acceptors.pipe[1]) == ANET_ERR ||
+        aeCreateFileEvent(server.el,acceptors.pipe[0],AE_READABLE,
+            acceptThreadsNotifyHandler,NULL) == AE_ERR)
+    {
+        redisLog(REDIS_WARNING,"Fatal: Can't initialize the accept threads.");
+        exit(1);
+    }
+
+    for (j = 0; j < numthreads; j++) {
+        acceptThread *t = acceptors.threads+j;
+
+        if (j == 0) {
+            memcpy(t->fd,server.ipfd,sizeof(int)*server.ipfd_count);
+            t->count = server.ipfd_count;
+        } else if (listenToPort(server.port,t->fd,&t->count) == REDIS_ERR) {
+            exit(1);
+        }
+        if (pthread_create(&t->thread,NULL,acceptThreadMain,t) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't create an accept thread.");
+            exit(1);
+        }
+        acceptors.numthreads++;
+    }
+    redisLog(REDIS_NOTICE,"Accepting connections with %d threads",
+        acceptors.numthreads);
+}
+
+/* Close the listening sockets opened by the accept threads. The sockets of
+ * the first thread are the ones in server.ipfd, closed by the caller. */
+// 关闭 accept 线程的监听套接字
+void acceptThreadsCloseListeners(void) {
+    int j, k;
+
+    for (j = 1; j < acceptors.numthreads; j++) {
+        acceptThread *t = acceptors.threads+j;
+
+        for (k = 0; k < t->count; k++) close(t->fd[k]);
     }
 }
 
@@ -935,6 +1144,13 @@ void freeClient(redisClient *c) {
      * we lost the connection with the master. */
     if (c->flags & REDIS_MASTER) replicationHandleMasterDisconnection();
 
+    /* Remove from the list of clients waiting for the AOF fsync. */
+    if (c->flags & REDIS_AOF_WAIT) {
+        ln = listSearchKey(server.clients_waiting_aof,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_waiting_aof,ln);
+    }
+
     /* If this client was scheduled for async freeing we need to remove it
      * from the queue. */
     if (c->flags & REDIS_CLOSE_ASAP) {
@@ -987,74 +1203,100 @@ void freeClientsInAsyncFreeQueue(void) {
  */
 void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     redisClient *c = privdata;
-    int nwritten = 0, totwritten = 0, objlen;
-    size_t objmem;
-    robj *o;
+    ssize_t nwritten = 0, totwritten = 0;
     REDIS_NOTUSED(el);
     REDIS_NOTUSED(mask);
 
+    /* With AOF group commit, nothing is sent until the last write command
+     * of the client is durable: the write handler is installed again by
+     * the AOF code once the fsync is done. */
+    // 客户端的写命令还没有被 fsync 到 AOF 文件，暂时不发送回复
+    if (aofClientMustWait(c)) {
+        aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+        if (!(c->flags & REDIS_AOF_WAIT)) {
+            c->flags |= REDIS_AOF_WAIT;
+            listAddNodeTail(server.clients_waiting_aof,c);
+        }
+        return;
+    }
+
     // 一直循环，直到回复缓冲区为空
     // 或者指定条件满足为止
     while(c->bufpos > 0 || listLength(c->reply)) {
+        struct iovec iov[REDIS_REPLY_IOV_MAX];
+        int iovcnt = 0;
+        size_t iovbytes = 0, offset = c->sentlen;
+        listIter li;
+        listNode *ln;
 
+        /* Gather c->buf and the reply blocks in a single writev() call.
+         * c->sentlen is used to handle short writes: it is the amount of
+         * bytes already sent of c->buf, or of the first block when c->buf
+         * is empty.
+         *
+         * 使用一次 writev() 写入 c->buf 和多个回复块。
+         * c->sentlen 是用来处理 short write 的，
+         * 它记录了 c->buf （c->buf 为空时是第一个回复块）中已经写入的字节数。 */
         if (c->bufpos > 0) {
+            iov[iovcnt].iov_base = c->buf+c->sentlen;
+            iov[iovcnt].iov_len = c->bufpos-c->sentlen;
+            iovbytes += iov[iovcnt].iov_len;
+            iovcnt++;
+            offset = 0;
+        }
+        listRewind(c->reply,&li);
+        while(iovcnt < REDIS_REPLY_IOV_MAX &&
+              iovbytes < REDIS_MAX_WRITE_PER_EVENT &&
+              (ln = listNext(&li)) != NULL)
+        {
+            clientReplyBlock *b = listNodeValue(ln);
 
-            // c->bufpos > 0
-
-            // 写入内容到套接字
-            // c->sentlen 是用来处理 short write 的
-            // 当出现 short write ，导致写入未能一次完成时，
-            // c->buf+c->sentlen 就会偏移到正确（未写入）内容的位置上。
-            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-            // 出错则跳出
-            if (nwritten <= 0) break;
-            // 成功写入则更新写入计数器变量
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            // 如果缓冲区中的内容已经全部写入完毕
-            // 那么清空客户端的两个计数器变量
-            if (c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
+            if (b->used > offset) {
+                iov[iovcnt].iov_base = b->buf+offset;
+                iov[iovcnt].iov_len = b->used-offset;
+                iovbytes += iov[iovcnt].iov_len;
+                iovcnt++;
             }
-        } else {
-
-            // listLength(c->reply) != 0
+            offset = 0;
+        }
 
-            // 取出位于链表最前面的对象
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-            objmem = getStringObjectSdsUsedMemory(o);
+        // 写入内容到套接字
+        nwritten = writev(fd,iov,iovcnt);
+        // 出错则跳出
+        if (nwritten <= 0) break;
+        // 成功写入则更新写入计数器变量
+        totwritten += nwritten;
 
-            // 略过空对象
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->reply_bytes -= objmem;
-                continue;
-            }
+        /* Consume the bytes written, starting from c->buf. */
+        // 如果 c->buf 中的内容已经全部写入完毕，那么清空它
+        if (c->bufpos > 0) {
+            size_t left = c->bufpos-c->sentlen;
 
-            // 写入内容到套接字
-            // c->sentlen 是用来处理 short write 的
-            // 当出现 short write ，导致写入未能一次完成时，
-            // c->buf+c->sentlen 就会偏移到正确（未写入）内容的位置上。
-            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
-            // 写入出错则跳出
-            if (nwritten <= 0) break;
-            // 成功写入则更新写入计数器变量
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If we fully sent the object on head go to the next one */
-            // 如果缓冲区内容全部写入完毕，那么删除已写入完毕的节点
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
+            if ((size_t)nwritten < left) {
+                c->sentlen += nwritten;
+                nwritten = 0;
+            } else {
+                nwritten -= left;
+                c->bufpos = 0;
                 c->sentlen = 0;
-                c->reply_bytes -= objmem;
             }
         }
+        // 删除已经全部写入的回复块
+        while(nwritten > 0) {
+            clientReplyBlock *b = listNodeValue(listFirst(c->reply));
+            size_t left = b->used-c->sentlen;
+
+            if ((size_t)nwritten < left) {
+                c->sentlen += nwritten;
+                nwritten = 0;
+                break;
+            }
+            nwritten -= left;
+            c->sentlen = 0;
+            c->reply_bytes -= zmalloc_size(b);
+            listDelNode(c->reply,listFirst(c->reply));
+        }
+
         /* Note that we avoid to send more than REDIS_MAX_WRITE_PER_EVENT
          * bytes, in a single threaded server it's a good idea to serve
          * other clients as well, even if a very large request comes from
@@ -1243,6 +1485,8 @@ int processMultibulkBuffer(redisClient *c) {
     char *newline = NULL;
     int pos = 0, ok;
     long long ll;
+    // 命令的全部协议是否都在这次调用中从缓冲区开头读入
+    int whole = c->multibulklen == 0;
 
     // 读入命令的参数个数
     // 比如 *3\r\n$3\r\nSET\r\n... 将令 c->multibulklen = 3
@@ -1364,6 +1608,7 @@ int processMultibulkBuffer(redisClient *c) {
                  * avoiding a large copy of data. */
                 sdsrange(c->querybuf,pos,-1);
                 pos = 0;
+                whole = 0;
                 qblen = sdslen(c->querybuf);
                 /* Hint the sds library about the amount of bytes this string is
                  * going to contain. */
@@ -1397,6 +1642,7 @@ int processMultibulkBuffer(redisClient *c) {
                  * likely... */
                 c->querybuf = sdsMakeRoomFor(c->querybuf,c->bulklen+2);
                 pos = 0;
+                whole = 0;
             } else {
                 c->argv[c->argc++] =
                     createStringObject(c->querybuf+pos,c->bulklen);
@@ -1411,6 +1657,16 @@ int processMultibulkBuffer(redisClient *c) {
         }
     }
 
+    /* If the whole command was parsed from the head of the buffer, keep
+     * its bytes there until it is executed, so that they can be propagated
+     * to the AOF as they are. processInputBuffer() trims them later. */
+    // 命令的原始协议完整地位于缓冲区开头，保留它们直到命令执行完毕
+    if (c->multibulklen == 0 && whole) {
+        c->querybuf_cmdlen = pos;
+        c->querybuf_argv = c->argv;
+        return REDIS_OK;
+    }
+
     /* Trim to pos */
     // 从 querybuf 中删除已被读取的内容
     if (pos) sdsrange(c->querybuf,pos,-1);
@@ -1482,6 +1738,13 @@ void processInputBuffer(redisClient *c) {
             if (processCommand(c) == REDIS_OK)
                 resetClient(c);
         }
+
+        // 删除已经执行的命令的原始协议
+        if (c->querybuf_cmdlen) {
+            sdsrange(c->querybuf,c->querybuf_cmdlen,-1);
+            c->querybuf_cmdlen = 0;
+            c->querybuf_argv = NULL;
+        }
     }
 }
 
@@ -1835,6 +2098,7 @@ void rewriteClientCommandVector(redisClient *c, int argc, ...) {
     // 用新参数替换
     c->argv = argv;
     c->argc = argc;
+    c->querybuf_argv = NULL;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     redisAssertWithInfo(c,NULL,c->cmd != NULL);
     va_end(ap);
@@ -1849,6 +2113,7 @@ void rewriteClientCommandArgument(redisClient *c, int i, robj *newval) {
     redisAssertWithInfo(c,NULL,i < c->argc);
     oldval = c->argv[i];
     c->argv[i] = newval;
+    c->querybuf_argv = NULL;
     incrRefCount(newval);
     decrRefCount(oldval);
 
@@ -1859,20 +2124,17 @@ void rewriteClientCommandArgument(redisClient *c, int i, robj *newval) {
     }
 }
 
-/* This function returns the number of bytes that Redis is virtually
- * using to store the reply still not read by the client.
- * It is "virtual" since the reply output list may contain objects that
- * are shared and are not really using additional memory.
+/* This function returns the number of bytes that Redis is using to store
+ * the reply still not read by the client.
  *
- * 函数返回客用于保存目前仍未返回给客户端的回复的虚拟大小（以字节为单位）。
- * 之所以说是虚拟大小，因为回复列表中可能有包含共享的对象。
+ * 函数返回用于保存目前仍未返回给客户端的回复的内存大小（以字节为单位）。
  *
- * The function returns the total sum of the length of all the objects
- * stored in the output list, plus the memory used to allocate every
- * list node. The static reply buffer is not taken into account since it
- * is allocated anyway.
+ * The function returns the total size of the blocks allocated for the
+ * output list, plus the memory used to allocate every list node. The
+ * static reply buffer is not taken into account since it is allocated
+ * anyway.
  *
- * 函数返回回复列表中所包含的全部对象的体积总和，
+ * 函数返回回复链表中所有回复块所分配的内存总和，
  * 加上列表节点所分配的空间。
  * 静态回复缓冲区不会被计算在内，因为它总是会被分配的。
  *
@@ -1884,9 +2146,7 @@ void rewriteClientCommandArgument(redisClient *c, int i, robj *newval) {
  * 这个函数目前的主要作用就是用来强制客户端输出长度限制。
  */
 unsigned long getClientOutputBufferMemoryUsage(redisClient *c) {
-    unsigned long list_item_size = sizeof(listNode)+sizeof(robj);
-
-    return c->reply_bytes + (list_item_size*listLength(c->reply));
+    return c->reply_bytes + (sizeof(listNode)*listLength(c->reply));
 }
 
 /* Get the class of a client, used in order to enforce limits to different
@@ -30,7 +30,12 @@ robj *createObject(int type, void *ptr) {
     o->refcount = 1;
 
     //把lru设置为当前时钟时间
-    o->lru = LRU_CLOCK();
+    //LFU策略下则设置为初始的访问计数器
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+        o->lru = (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL;
+    } else {
+        o->lru = LRU_CLOCK();
+    }
     return 0;
 }
 
@@ -51,7 +56,11 @@ robj *createEmbeddedStringObject(char *ptr, size_t len) {
     o->encoding = REDIS_ENCODING_EMBSTR;
     o->ptr = sh+1;
     o->refcount = 1;
-    o->lru = LRU_CLOCK();
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+        o->lru = (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL;
+    } else {
+        o->lru = LRU_CLOCK();
+    }
 
     sh->len = len;
     sh->free = 0;
@@ -285,11 +294,26 @@ void freeHashObject(robj *o) {
     }
 }
 
+/* Set a special refcount in the object to make it "shared":
+ * incrRefCount and decrRefCount() will test for this special refcount
+ * and will not touch the object. This way it is free to access shared
+ * objects such as small integers from different threads without any
+ * mutex.
+ *
+ * 将对象设置为共享对象，
+ * incrRefCount 和 decrRefCount 不会修改共享对象的引用计数。 */
+robj *makeObjectShared(robj *o) {
+    redisAssert(o->refcount == 1);
+    o->refcount = REDIS_SHARED_REFCOUNT;
+    return o;
+}
+
 /*
  * 为对象的引用计数增一
  */
 void incrRefCount(robj *o) {
-    o->refcount++;
+    // 共享对象的引用计数永远不变
+    if (o->refcount != REDIS_SHARED_REFCOUNT) o->refcount++;
 }
 
 /*
@@ -299,6 +323,12 @@ void incrRefCount(robj *o) {
  */
 void decrRefCount(robj *o) {
 
+    /* Shared objects are never released, and their refcount is never
+     * modified, so that the lazy free thread can release aggregates
+     * referencing them without racing with the main thread. */
+    // 共享对象不会被释放
+    if (o->refcount == REDIS_SHARED_REFCOUNT) return;
+
     if (o->refcount <= 0) redisPanic("decrRefCount against refcount <= 0");
 
     // 释放对象
@@ -788,6 +818,128 @@ unsigned long long estimateObjectIdleTime(robj *o) {
     }
 }
 
+/* ----------------------------- LFU counter -------------------------------
+ *
+ * In LFU mode the lru field of the object holds a logarithmic access counter
+ * (8 bits) and the time, in minutes, of the last counter decrement (16 bits).
+ *
+ * LFU 模式下，对象的 lru 属性保存的是一个 8 位的对数访问计数器，
+ * 以及计数器最后一次衰减的时间（分钟精度，16 位）。
+ *
+ * The counter is not incremented at every access: the probability of an
+ * increment is 1/(old_value*lfu_log_factor+1), so with the default factor
+ * of 10 the 255 limit is reached only after about one million hits.
+ *
+ * 计数器的增长是概率性的，当前值越大，增长的可能性越小，
+ * 因此 8 位就足以区分冷热程度相差几个数量级的键。
+ *
+ * The counter is decremented by one for every lfu_decay_time minutes
+ * elapsed since the last decrement, so keys that were hot in the past but
+ * are no longer accessed can eventually be evicted.
+ *
+ * 计数器每经过 lfu_decay_time 分钟就减一，
+ * 这样过去很热门但现在不再被访问的键最终也可以被淘汰。 */
+
+/* Return the current time in minutes, just taking the least significant
+ * 16 bits. The returned time is suitable to be stored as LDT (last decrement
+ * time) for the LFU implementation. */
+// 返回分钟精度的当前时间的低 16 位
+unsigned long LFUGetTimeInMinutes(void) {
+    return (server.unixtime/60) & 65535;
+}
+
+/* Given an object last decrement time, compute the minimum number of minutes
+ * that elapsed since the last decrement. Handle overflow (ldt greater than
+ * the current 16 bits minutes time) considering the time as wrapping
+ * exactly once. */
+// 计算距离计数器上次衰减经过了多少分钟，处理时间回绕的情况
+static unsigned long LFUTimeElapsed(unsigned long ldt) {
+    unsigned long now = LFUGetTimeInMinutes();
+    if (now >= ldt) return now-ldt;
+    return 65535-ldt+now;
+}
+
+/* Logarithmically increment a counter. The greater is the current counter
+ * value the less likely is that it gets really incremented. Saturate it
+ * at 255. */
+// 以对数方式增加计数器的值，计数器在 255 时饱和
+uint8_t LFULogIncr(uint8_t counter) {
+    double r, baseval, p;
+
+    if (counter == 255) return 255;
+    r = (double)rand()/RAND_MAX;
+    baseval = counter - REDIS_LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    p = 1.0/(baseval*server.lfu_log_factor+1);
+    if (r < p) counter++;
+    return counter;
+}
+
+/* If the object decrement time is reached decrement the LFU counter but
+ * do not update the LFU fields of the object, we update the access time
+ * and counter in an explicit way when the object is really accessed.
+ * The counter is decremented by one for every lfu_decay_time minutes
+ * elapsed. Return the object frequency counter.
+ *
+ * 根据经过的时间对计数器进行衰减，并返回衰减后的计数器值。
+ * 函数不会修改对象本身，对象的 LFU 数据只在被真正访问时更新。
+ *
+ * This function is used in order to scan the dataset for the best object
+ * to fit: as we check for the candidate, we incrementally decrement the
+ * counter of the scanned objects if needed. */
+unsigned long LFUDecrAndReturn(robj *o) {
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long num_periods = server.lfu_decay_time ?
+                                LFUTimeElapsed(ldt) / server.lfu_decay_time : 0;
+
+    if (num_periods)
+        counter = (num_periods > counter) ? 0 : counter - num_periods;
+    return counter;
+}
+
+/* Update the LFU data of an object on access: first decay the counter if
+ * needed, then increment it logarithmically, finally store the current
+ * time as the last decrement time.
+ *
+ * 在对象被访问时更新它的 LFU 数据。
+ *
+ * This is called by updateCommandKeysLFU() for every key a command
+ * accesses when an LFU policy is configured. */
+void updateLFU(robj *o) {
+    unsigned long counter = LFUDecrAndReturn(o);
+
+    counter = LFULogIncr(counter);
+    o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+}
+
+/* Called by call() before executing a command when an LFU policy is
+ * configured: count an access for every existing key of the command.
+ *
+ * 在 LFU 策略下，由 call() 在执行命令之前调用，为命令访问的每个键增加访问计数。
+ *
+ * The key lookup functions of db.c are not part of this tree, so the keys
+ * are found using the key specification of the command instead. Like the
+ * LRU clock refresh of lookupKey(), nothing is done while a child is saving
+ * the dataset, to avoid copy-on-write of the pages of the objects. */
+void updateCommandKeysLFU(redisClient *c) {
+    int *keys, numkeys, j;
+
+    if (server.rdb_child_pid != -1 || server.aof_child_pid != -1) return;
+
+    keys = getKeysFromCommand(c->cmd,c->argv,c->argc,&numkeys);
+    for (j = 0; j < numkeys; j++) {
+        dictEntry *de = dictFind(c->db->dict,c->argv[keys[j]]->ptr);
+        robj *o;
+
+        if (de == NULL) continue;
+        o = dictGetVal(de);
+        // 共享对象被多个键使用，不记录它的访问频率
+        if (o->refcount != REDIS_SHARED_REFCOUNT) updateLFU(o);
+    }
+    getKeysFreeResult(keys);
+}
+
 /* This is a helper function for the OBJECT command. We need to lookup keys
  * without any modification of LRU or other parameters.
  *
@@ -833,8 +985,26 @@ void objectCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
+        // LFU 策略下 lru 属性保存的不是访问时间
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is selected, idle time not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
         addReplyLongLong(c,estimateObjectIdleTime(o)/1000);
+
+    // 返回对象的对数访问频率计数器
+    } else if (!strcasecmp(c->argv[1]->ptr,"freq") && c->argc == 3) {
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+                == NULL) return;
+        if (!REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is not selected, access frequency not tracked. Please note that when switching between policies at runtime LRU and LFU data will take some time to adjust.");
+            return;
+        }
+        /* LFUDecrAndReturn should be called in case the key has not been
+         * accessed for a long time, because we update the access time only
+         * when the key is read or overwritten. */
+        addReplyLongLong(c,LFUDecrAndReturn(o));
     } else {
-        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime)");
+        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime|freq)");
     }
 }
@@ -10,6 +10,7 @@
 #include <sys/wait.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
 /*
  * 将长度为len的字符数组p写入到rdb中
@@ -217,34 +218,149 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
 }
 
 
+/* ---------------------------- Compression codecs -------------------------- */
+
+/* Strings longer than 20 bytes can be saved compressed. Historically the
+ * only codec was LZF, encoded as REDIS_RDB_ENC_LZF. Other codecs are saved
+ * with the REDIS_RDB_ENC_CODEC encoding, followed by one byte with the
+ * codec id, then by the compressed and uncompressed lengths and the
+ * compressed data, exactly like LZF:
+ *
+ * 除了 LZF 之外的压缩算法使用 REDIS_RDB_ENC_CODEC 编码保存，
+ * 编码之后是一个字节的压缩算法 id ，格式如下：
+ *
+ * [ENCVAL|REDIS_RDB_ENC_CODEC][codec id][clen][len][compressed data]
+ *
+ * LZ4 and zstd are only available when Redis is compiled with USE_LZ4 and
+ * USE_ZSTD respectively. Loading a string compressed with a codec that is
+ * not compiled in fails. */
+
+static size_t rdbLzfCompress(const void *in, size_t inlen, void *out, size_t outlen) {
+    return lzf_compress(in,inlen,out,outlen);
+}
+
+static size_t rdbLzfDecompress(const void *in, size_t inlen, void *out, size_t outlen) {
+    return lzf_decompress(in,inlen,out,outlen);
+}
+
+#ifdef USE_LZ4
+#include <lz4.h>
+
+static size_t rdbLz4Compress(const void *in, size_t inlen, void *out, size_t outlen) {
+    int n = LZ4_compress_default(in,out,inlen,outlen);
+    return n > 0 ? (size_t)n : 0;
+}
+
+static size_t rdbLz4Decompress(const void *in, size_t inlen, void *out, size_t outlen) {
+    int n = LZ4_decompress_safe(in,out,inlen,outlen);
+    return n > 0 ? (size_t)n : 0;
+}
+#endif
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+
+static size_t rdbZstdCompress(const void *in, size_t inlen, void *out, size_t outlen) {
+    size_t n = ZSTD_compress(out,outlen,in,inlen,REDIS_RDB_ZSTD_LEVEL);
+    return ZSTD_isError(n) ? 0 : n;
+}
+
+static size_t rdbZstdDecompress(const void *in, size_t inlen, void *out, size_t outlen) {
+    size_t n = ZSTD_decompress(out,outlen,in,inlen);
+    return ZSTD_isError(n) ? 0 : n;
+}
+#endif
+
+/* Codecs table, indexed by codec id. Codecs not compiled in have NULL
+ * methods. */
+// 压缩算法表，以压缩算法 id 为索引
+static rdbCodec rdbCodecTable[REDIS_RDB_CODEC_NUM] = {
+    {"lzf",rdbLzfCompress,rdbLzfDecompress},
+#ifdef USE_LZ4
+    {"lz4",rdbLz4Compress,rdbLz4Decompress},
+#else
+    {"lz4",NULL,NULL},
+#endif
+#ifdef USE_ZSTD
+    {"zstd",rdbZstdCompress,rdbZstdDecompress}
+#else
+    {"zstd",NULL,NULL}
+#endif
+};
+
+/* Return the codec with the specified id, or NULL if the id is unknown or
+ * the codec is not compiled in. */
+// 根据 id 返回压缩算法，算法不存在或者没有被编译时返回 NULL
+rdbCodec *rdbGetCodec(int id) {
+    if (id < 0 || id >= REDIS_RDB_CODEC_NUM) return NULL;
+    if (rdbCodecTable[id].compress == NULL) return NULL;
+    return rdbCodecTable+id;
+}
+
+/* Return the id of the codec with the specified name (case insensitive),
+ * or -1 if there is no such codec compiled in. Used to parse the
+ * rdbcompression-codec configuration directive. */
+int rdbCodecByName(const char *name) {
+    int j;
+
+    for (j = 0; j < REDIS_RDB_CODEC_NUM; j++) {
+        if (!strcasecmp(rdbCodecTable[j].name,name) && rdbGetCodec(j))
+            return j;
+    }
+    return -1;
+}
+
 /*
- * 尝试对输入字符串 s 进行压缩，
+ * 尝试使用压缩算法 codec 对输入字符串 s 进行压缩，
  * 如果压缩成功，那么将压缩后的字符串保存到 rdb 中。
  *
+ * LZF compressed strings are saved with the old REDIS_RDB_ENC_LZF encoding,
+ * so the default codec does not change how strings are encoded. This does
+ * not make the file readable by older versions of Redis, since it is still
+ * saved as REDIS_RDB_VERSION 7 with RESIZEDB opcodes.
+ *
  * 函数在成功时返回保存压缩后的 s 所需的字节数，
  * 压缩失败或者内存不足时返回 0 ，
  * 写入失败时返回 -1 。
  */
-int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+int rdbSaveCompressedStringObject(rio *rdb, unsigned char *s, size_t len, int codec) {
+    rdbCodec *c = rdbGetCodec(codec);
     size_t comprlen, outlen;
     unsigned char byte;
     int n, nwritten = 0;
     void *out;
 
+    // 压缩算法没有被编译，使用 LZF
+    if (c == NULL) {
+        codec = REDIS_RDB_CODEC_LZF;
+        c = rdbGetCodec(codec);
+    }
+
     // 压缩字符串
     if (len <= 4) return 0;
     outlen = len-4;
     if ((out = zmalloc(outlen+1)) == NULL) return 0;
-    comprlen = lzf_compress(s, len, out, outlen);
+    comprlen = c->compress(s, len, out, outlen);
     if (comprlen == 0) {
         zfree(out);
         return 0;
     }
 
-    // 写入类型，说明这是一个 LZF 压缩字符串
-    byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
-    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
-    nwritten += n;
+    // 写入类型，说明这是一个被压缩的字符串
+    if (codec == REDIS_RDB_CODEC_LZF) {
+        byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
+        if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
+        nwritten += n;
+    } else {
+        byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_CODEC;
+        if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
+        nwritten += n;
+
+        // 写入压缩算法 id
+        byte = codec;
+        if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
+        nwritten += n;
+    }
 
     // 写入字符串压缩后的长度
     if ((n = rdbSaveLen(rdb,comprlen)) == -1) goto writeerr;
@@ -267,9 +383,25 @@ writeerr:
     return -1;
 }
 
+/* Read the codec id following a REDIS_RDB_ENC_CODEC encoding byte.
+ * Returns -1 on read error or if the codec is not available. */
+// 读入 REDIS_RDB_ENC_CODEC 之后的压缩算法 id
+static int rdbLoadCodecId(rio *rdb) {
+    unsigned char byte;
+
+    if (rioRead(rdb,&byte,1) == 0) return -1;
+    if (rdbGetCodec(byte) == NULL) {
+        redisLog(REDIS_WARNING,
+            "RDB string compressed with codec %d, not compiled in this "
+            "Redis instance", (int)byte);
+        return -1;
+    }
+    return byte;
+}
 
-// 从 rdb 中载入被 LZF 压缩的字符串，解压它，并创建相应的字符串对象。
-robj *rdbLoadLzfStringObject(rio *rdb) {
+// 从 rdb 中载入被压缩的字符串，解压它，并创建相应的字符串对象。
+robj *rdbLoadCompressedStringObject(rio *rdb, int codec) {
+    rdbCodec *codecp = rdbGetCodec(codec);
     unsigned int len, clen;
     unsigned char *c = NULL;
     sds val = NULL;
@@ -287,7 +419,7 @@ robj *rdbLoadLzfStringObject(rio *rdb) {
     if (rioRead(rdb,c,clen) == 0) goto err;
 
     // 解压缓存，得出字符串
-    if (lzf_decompress(c,clen,val,len) == 0) goto err;
+    if (codecp->decompress(c,clen,val,len) != len) goto err;
     zfree(c);
 
     // 创建字符串对象
@@ -320,13 +452,14 @@ int rdbSaveRawString(rio *rdb, unsigned char *s, size_t len) {
         }
     }
 
-    // 如果字符串长度大于 20 ，并且服务器开启了 LZF 压缩，
-    // 那么在保存字符串到数据库之前，先对字符串进行 LZF 压缩。
+    // 如果字符串长度大于 20 ，并且服务器开启了压缩，
+    // 那么在保存字符串到数据库之前，先使用配置的压缩算法对字符串进行压缩。
  
     if (server.rdb_compression && len > 20) {
 
         // 尝试压缩
-        n = rdbSaveLzfStringObject(rdb,s,len);
+        n = rdbSaveCompressedStringObject(rdb,s,len,
+                server.rdb_compression_codec);
 
         if (n == -1) return -1;
         if (n > 0) return n;
@@ -413,7 +546,7 @@ int rdbSaveStringObject(rio *rdb, robj *obj) {
  * encode 不为 0 时，它指定了字符串所使用的编码。
  */ 
 robj *rdbGenericLoadStringObject(rio *rdb, int encode) {
-    int isencoded;
+    int isencoded, codec;
     uint32_t len;
     sds val;
 
@@ -433,7 +566,12 @@ robj *rdbGenericLoadStringObject(rio *rdb, int encode) {
 
         // LZF 压缩
         case REDIS_RDB_ENC_LZF:
-            return rdbLoadLzfStringObject(rdb);
+            return rdbLoadCompressedStringObject(rdb,REDIS_RDB_CODEC_LZF);
+
+        // 其他算法压缩
+        case REDIS_RDB_ENC_CODEC:
+            if ((codec = rdbLoadCodecId(rdb)) == -1) return NULL;
+            return rdbLoadCompressedStringObject(rdb,codec);
 
         default:
             redisPanic("Unknown RDB encoding type");
@@ -444,6 +582,17 @@ robj *rdbGenericLoadStringObject(rio *rdb, int encode) {
 
     // 执行到这里，说明这个字符串即没有被压缩，也不是整数
     // 那么直接从 rdb 中读入它
+
+    /* When the file is memory mapped create the sds straight from the
+     * mapped pages: no need to zero the buffer before reading into it. */
+    // 如果文件被映射到内存，那么直接使用映射的内存创建字符串
+    if (len && rioIsMmap(rdb)) {
+        const void *p = rioReadInPlace(rdb,len);
+
+        if (p == NULL) return NULL;
+        return createObject(REDIS_STRING,sdsnewlen(p,len));
+    }
+
     val = sdsnewlen(NULL,len);
     if (len && rioRead(rdb,val,len) == 0) {
         sdsfree(val);
@@ -453,6 +602,75 @@ robj *rdbGenericLoadStringObject(rio *rdb, int encode) {
     return createObject(REDIS_STRING,val);
 }
 
+/* Load a string holding a serialized blob (ziplist, intset, zipmap) into a
+ * buffer allocated with zmalloc(), storing its length in '*lenp'.
+ *
+ * 载入一个保存着序列化数据（ziplist 、 intset 或者 zipmap）的字符串，
+ * 并将它保存到 zmalloc() 分配的缓冲区中。
+ *
+ * The blob is read, or decompressed, directly into its final allocation
+ * instead of going through an intermediate string object. When the file is
+ * memory mapped the data is copied straight from the mapped pages.
+ *
+ * Returns NULL on error. */
+static unsigned char *rdbLoadBlob(rio *rdb, size_t *lenp) {
+    int isencoded, codec;
+    uint32_t len, clen;
+    unsigned char *blob;
+    const void *p;
+
+    if ((len = rdbLoadLen(rdb,&isencoded)) == REDIS_RDB_LENERR) return NULL;
+
+    if (isencoded && (len == REDIS_RDB_ENC_LZF || len == REDIS_RDB_ENC_CODEC)) {
+        unsigned char *c = NULL;
+
+        if (len == REDIS_RDB_ENC_LZF) {
+            codec = REDIS_RDB_CODEC_LZF;
+        } else if ((codec = rdbLoadCodecId(rdb)) == -1) {
+            return NULL;
+        }
+
+        // 压缩的数据，直接解压到最终的缓冲区中
+        if ((clen = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
+        if ((p = rioReadInPlace(rdb,clen)) == NULL) {
+            if (rioIsMmap(rdb)) return NULL;
+            c = zmalloc(clen);
+            if (rioRead(rdb,c,clen) == 0) {
+                zfree(c);
+                return NULL;
+            }
+            p = c;
+        }
+        blob = zmalloc(len);
+        if (rdbGetCodec(codec)->decompress(p,clen,blob,len) != len) {
+            zfree(c);
+            zfree(blob);
+            return NULL;
+        }
+        zfree(c);
+    } else if (isencoded) {
+        /* Integer encoded: never the case for real blobs, but handle it. */
+        robj *aux = rdbLoadIntegerObject(rdb,len,0);
+
+        if (aux == NULL) return NULL;
+        len = sdslen(aux->ptr);
+        blob = zmalloc(len);
+        memcpy(blob,aux->ptr,len);
+        decrRefCount(aux);
+    } else {
+        blob = zmalloc(len);
+        if ((p = rioReadInPlace(rdb,len)) != NULL) {
+            memcpy(blob,p,len);
+        } else if (rioIsMmap(rdb) || (len && rioRead(rdb,blob,len) == 0)) {
+            zfree(blob);
+            return NULL;
+        }
+    }
+    *lenp = len;
+    return blob;
+}
+
 robj *rdbLoadStringObject(rio *rdb) {
     return rdbGenericLoadStringObject(rdb,0);
 }
@@ -771,40 +989,324 @@ int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val,
     return 1;
 }
 
-//把数据库保存到磁盘上
-int rdbSave(char *filename) {
+/* ---------------------------- Segmented saving ----------------------------
+ *
+ * 多线程保存分段 RDB 文件
+ *
+ * When server.rdb_save_threads is greater than one, rdbSave() writes the
+ * keyspace as a sequence of independent segments instead of a single
+ * stream of key-value pairs. The buckets of every DB hash table are split
+ * into ranges of REDIS_RDB_SEGMENT_BUCKETS buckets, and the ranges are
+ * taken by the saving threads, that serialize them into memory, compress
+ * every REDIS_RDB_SEGMENT_SIZE bytes of output as a segment, and append the
+ * segment to the file.
+ *
+ * 当 server.rdb_save_threads 大于 1 时， rdbSave() 将键空间保存为多个独立的段。
+ * 每个数据库哈希表的桶被划分为多个范围，由多个线程分别序列化和压缩，
+ * 每个段被追加到文件中。
+ *
+ * Segments are written in the order they are completed, and their offsets
+ * are stored in an index after the last segment, so that the loader can
+ * read and decode them in parallel:
+ *
+ * 段按照完成的顺序写入，它们的偏移量被保存在最后一个段之后的索引中，
+ * 这样载入程序就可以并行地读取和解码它们：
+ *
+ * [SEGMENTED]
+ * [SELECTDB][dbid][RESIZEDB][size][expires] ... for every non empty DB
+ * [SEGMENT] ... [SEGMENT]
+ * [SEGINDEX][count][offset 0] ... [offset count-1][index offset]
+ * [EOF][crc64]
+ *
+ * All the offsets are 64 bit little endian integers. The file can also be
+ * loaded serially, in that case the segments are just loaded one after the
+ * other.
+ *
+ * The threads only read the keyspace: this is safe since the saving child
+ * (or the main thread during SAVE) does not modify it meanwhile, and the
+ * rehashing steps that lookups may perform are disabled for the duration
+ * of the save. */
+
+/* A range of buckets of a DB hash table, serialized by a saving thread. */
+typedef struct rdbSaveRange {
+    int dbid;
+    int table;
+    unsigned long start, end;
+} rdbSaveRange;
+
+/* State shared by the saving threads. */
+static struct {
+    pthread_mutex_t mutex;      /* Protects the fields below and the file. */
+    rio *rdb;                   /* Output file. */
+    rdbSaveRange *ranges;       /* Work to do. */
+    int nranges;
+    int next;                   /* Next range to serialize. */
+    off_t *offsets;             /* Offsets of the segments written so far. */
+    int nsegments;
+    int err;                    /* Set on write errors. */
+    long long now;
+} rdbSavers;
+
+/* Compress and append to the file the payload of a segment of DB 'dbid'.
+ * The sds is consumed. Returns 0 on success, -1 on error. */
+static int rdbSaveSegment(int dbid, sds payload) {
+    size_t len = sdslen(payload), clen = 0;
+    unsigned char codec = REDIS_RDB_SEGMENT_RAW, *out = NULL;
+    uint64_t crc = 0, clen64, len64;
+    rdbCodec *c;
+    rio *rdb = rdbSavers.rdb;
+    int retval = -1;
+
+    if (server.rdb_checksum) crc = crc64(0,(unsigned char*)payload,len);
+    memrev64ifbe(&crc);
+
+    // 使用配置的压缩算法压缩段数据，压缩失败时保存原始数据
+    if (server.rdb_compression &&
+        (c = rdbGetCodec(server.rdb_compression_codec)) != NULL)
+    {
+        out = zmalloc(len);
+        clen = c->compress(payload,len,out,len-1);
+        if (clen) codec = server.rdb_compression_codec;
+    }
+    if (codec == REDIS_RDB_SEGMENT_RAW) clen = len;
+    clen64 = clen;
+    len64 = len;
+    memrev64ifbe(&clen64);
+    memrev64ifbe(&len64);
+
+    pthread_mutex_lock(&rdbSavers.mutex);
+    if (rdbSavers.err) goto done;
+    rdbSavers.offsets = zrealloc(rdbSavers.offsets,
+        sizeof(off_t)*(rdbSavers.nsegments+1));
+    rdbSavers.offsets[rdbSavers.nsegments++] = rioTell(rdb);
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_SEGMENT) == -1 ||
+        rdbSaveLen(rdb,dbid) == -1 ||
+        rdbWriteRaw(rdb,&codec,1) == -1 ||
+        rdbWriteRaw(rdb,&clen64,8) == -1 ||
+        rdbWriteRaw(rdb,&len64,8) == -1 ||
+        rdbWriteRaw(rdb,&crc,8) == -1 ||
+        rdbWriteRaw(rdb,(codec == REDIS_RDB_SEGMENT_RAW) ? (void*)payload :
+                                                          (void*)out,clen) == -1)
+    {
+        rdbSavers.err = 1;
+        goto done;
+    }
+    retval = 0;
+
+done:
+    pthread_mutex_unlock(&rdbSavers.mutex);
+    zfree(out);
+    sdsfree(payload);
+    return retval;
+}
+
+void *rdbSaveWorkerMain(void *arg) {
+    sds payload = NULL;
+
+    REDIS_NOTUSED(arg);
+
+    while(1) {
+        rdbSaveRange *range;
+        redisDb *db;
+        dictht *ht;
+        unsigned long idx;
+        rio r;
+
+        // 取出下一个要序列化的范围
+        pthread_mutex_lock(&rdbSavers.mutex);
+        if (rdbSavers.err || rdbSavers.next == rdbSavers.nranges) {
+            pthread_mutex_unlock(&rdbSavers.mutex);
+            break;
+        }
+        range = rdbSavers.ranges+rdbSavers.next++;
+        pthread_mutex_unlock(&rdbSavers.mutex);
+
+        db = server.db+range->dbid;
+        ht = &db->dict->ht[range->table];
+        rioInitWithBuffer(&r,sdsempty());
+        for (idx = range->start; idx < range->end; idx++) {
+            dictEntry *de;
+
+            for (de = ht->table[idx]; de; de = de->next) {
+                sds keystr = dictGetKey(de);
+                robj key;
+
+                initStaticStringObject(key,keystr);
+                if (rdbSaveKeyValuePair(&r,&key,dictGetVal(de),
+                        getExpire(db,&key),rdbSavers.now) == -1) goto werr;
+            }
+
+            // 段已经足够大，或者范围已经处理完毕，那么写入段
+            if (sdslen(r.io.buffer.ptr) >= REDIS_RDB_SEGMENT_SIZE ||
+                (idx == range->end-1 && sdslen(r.io.buffer.ptr)))
+            {
+                if (rdbSaveType(&r,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
+                payload = r.io.buffer.ptr;
+                rioInitWithBuffer(&r,sdsempty());
+                if (rdbSaveSegment(range->dbid,payload) == -1) goto werr;
+            }
+        }
+        sdsfree(r.io.buffer.ptr);
+        continue;
+
+werr:
+        sdsfree(r.io.buffer.ptr);
+        pthread_mutex_lock(&rdbSavers.mutex);
+        rdbSavers.err = 1;
+        pthread_mutex_unlock(&rdbSavers.mutex);
+        break;
+    }
+    return NULL;
+}
+
+/* Suspend / resume the rehashing steps of the non empty DBs. */
+static void rdbSaveSegmentsPauseRehashing(int pause) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (dictSize(db->dict) == 0) continue;
+        db->dict->iterators += pause ? 1 : -1;
+        db->expires->iterators += pause ? 1 : -1;
+    }
+}
+
+/* Write the keyspace into 'rdb' as a segmented RDB using
+ * server.rdb_save_threads threads. Called by rdbSave() after the header.
+ * Returns 0 on success, -1 on error. */
+static int rdbSaveSegments(rio *rdb, long long now) {
+    pthread_t threads[REDIS_RDB_SAVE_MAX_THREADS];
+    int nthreads = server.rdb_save_threads, started = 0, j, table;
+    int retval = -1;
+    uint64_t off;
+
+    if (nthreads > REDIS_RDB_SAVE_MAX_THREADS)
+        nthreads = REDIS_RDB_SAVE_MAX_THREADS;
+
+    pthread_mutex_init(&rdbSavers.mutex,NULL);
+    rdbSavers.rdb = rdb;
+    rdbSavers.ranges = NULL;
+    rdbSavers.nranges = 0;
+    rdbSavers.next = 0;
+    rdbSavers.offsets = NULL;
+    rdbSavers.nsegments = 0;
+    rdbSavers.err = 0;
+    rdbSavers.now = now;
+
+    /* Write the size of every DB, and split the hash tables in ranges.
+     * Rehashing steps are disabled while the threads read the DBs. */
+    // 写入每个数据库的大小，并将哈希表划分为多个范围
+    rdbSaveSegmentsPauseRehashing(1);
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+        uint32_t db_size, expires_size;
+
+        if (dictSize(db->dict) == 0) continue;
+
+        db_size = (dictSize(db->dict) < REDIS_RDB_LENERR) ?
+                  dictSize(db->dict) : REDIS_RDB_LENERR-1;
+        expires_size = (dictSize(db->expires) < REDIS_RDB_LENERR) ?
+                       dictSize(db->expires) : REDIS_RDB_LENERR-1;
+        if (rdbSaveType(rdb,REDIS_RDB_OPCODE_SELECTDB) == -1) goto werr;
+        if (rdbSaveLen(rdb,j) == -1) goto werr;
+        if (rdbSaveType(rdb,REDIS_RDB_OPCODE_RESIZEDB) == -1) goto werr;
+        if (rdbSaveLen(rdb,db_size) == -1) goto werr;
+        if (rdbSaveLen(rdb,expires_size) == -1) goto werr;
+
+        for (table = 0; table <= 1; table++) {
+            unsigned long size = db->dict->ht[table].size, start;
+
+            for (start = 0; start < size; start += REDIS_RDB_SEGMENT_BUCKETS) {
+                rdbSaveRange *range;
+
+                rdbSavers.ranges = zrealloc(rdbSavers.ranges,
+                    sizeof(rdbSaveRange)*(rdbSavers.nranges+1));
+                range = rdbSavers.ranges+rdbSavers.nranges++;
+                range->dbid = j;
+                range->table = table;
+                range->start = start;
+                range->end = (size-start > REDIS_RDB_SEGMENT_BUCKETS) ?
+                             start+REDIS_RDB_SEGMENT_BUCKETS : size;
+            }
+        }
+    }
+
+    // 创建保存线程，并等待它们完成
+    for (j = 0; j < nthreads; j++) {
+        if (pthread_create(&threads[j],NULL,rdbSaveWorkerMain,NULL) != 0) {
+            redisLog(REDIS_WARNING,"Can't create RDB saving thread: %s",
+                strerror(errno));
+            rdbSavers.err = 1;
+            break;
+        }
+        started++;
+    }
+    for (j = 0; j < started; j++) pthread_join(threads[j],NULL);
+    if (rdbSavers.err) goto werr;
+
+    /* Write the index of the segments. */
+    // 写入段的索引
+    off = rioTell(rdb);
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_SEGINDEX) == -1) goto werr;
+    if (rdbSaveLen(rdb,rdbSavers.nsegments) == -1) goto werr;
+    for (j = 0; j < rdbSavers.nsegments; j++) {
+        uint64_t o = rdbSavers.offsets[j];
+
+        memrev64ifbe(&o);
+        if (rdbWriteRaw(rdb,&o,8) == -1) goto werr;
+    }
+    memrev64ifbe(&off);
+    if (rdbWriteRaw(rdb,&off,8) == -1) goto werr;
+
+    redisLog(REDIS_VERBOSE,"RDB saved as %d segments by %d threads",
+        rdbSavers.nsegments, nthreads);
+    retval = 0;
+
+werr:
+    rdbSaveSegmentsPauseRehashing(0);
+    zfree(rdbSavers.ranges);
+    zfree(rdbSavers.offsets);
+    pthread_mutex_destroy(&rdbSavers.mutex);
+    return retval;
+}
+
+/* Produce a dump of the whole dataset in RDB format into 'rdb', from the
+ * magic string to the checksum. If 'segmented' is true the keys are saved
+ * by the segment writer threads (see rdbSaveSegments()).
+ *
+ * 将整个数据集以 RDB 格式写入 rdb ，从开头的魔数一直到最后的校验和。
+ *
+ * Used by rdbSave(), and by the AOF rewrite to write the RDB preamble.
+ * Returns REDIS_ERR on write errors, with errno set. */
+int rdbSaveRio(rio *rdb, int segmented) {
     dictIterator *di = NULL;
     dictEntry *de;
-    char tmpfile[256];
     char magic[10];
     int j;
     long long now = mstime();
-    FILE *fp;
-    rio rdb;
+    uint32_t db_size, expires_size;
     uint64_t cksum;
 
-    // 创建临时文件
-    snprintf(tmpfile,256,"temp-%d.rdb", (int) getpid());
-    fp = fopen(tmpfile,"w");
-    if (!fp) {
-        redisLog(REDIS_WARNING, "Failed opening .rdb for saving: %s",
-            strerror(errno));
-        return REDIS_ERR;
-    }
-
-    // 初始化 I/O
-    rioInitWithFile(&rdb,fp);
-
-    // 设置校验和函数
-    if (server.rdb_checksum)
-        rdb.update_cksum = rioGenericUpdateChecksum;
+    /* Set the checksum function, unless the caller installed its own
+     * callback, that must then update the checksum itself (see
+     * rewriteAppendOnlyFile()). */
+    // 设置校验和函数，调用者已经设置了回调函数时不覆盖它
+    if (server.rdb_checksum && rdb->update_cksum == NULL)
+        rdb->update_cksum = rioGenericUpdateChecksum;
 
     // 写入 RDB 版本号
     snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
-    if (rdbWriteRaw(&rdb,magic,9) == -1) goto werr;
+    if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
 
-    // 遍历所有数据库
-    for (j = 0; j < server.dbnum; j++) {
+    // 使用多个线程保存分段 RDB ，魔数之后的 SEGMENTED 标记让载入程序识别分段文件
+    if (segmented &&
+        (rdbSaveType(rdb,REDIS_RDB_OPCODE_SEGMENTED) == -1 ||
+         rdbSaveSegments(rdb,now) == -1))
+        goto werr;
+
+    // 遍历所有数据库，保存分段 RDB 时跳过
+    for (j = 0; j < server.dbnum && !segmented; j++) {
 
         // 指向数据库
         redisDb *db = server.db+j;
@@ -817,17 +1319,29 @@ int rdbSave(char *filename) {
 
         // 创建键空间迭代器
         di = dictGetSafeIterator(d);
-        if (!di) {
-            fclose(fp);
-            return REDIS_ERR;
-        }
+        if (!di) return REDIS_ERR;
 
         /* Write the SELECT DB opcode 
          *
          * 写入 DB 选择器
          */
-        if (rdbSaveType(&rdb,REDIS_RDB_OPCODE_SELECTDB) == -1) goto werr;
-        if (rdbSaveLen(&rdb,j) == -1) goto werr;
+        if (rdbSaveType(rdb,REDIS_RDB_OPCODE_SELECTDB) == -1) goto werr;
+        if (rdbSaveLen(rdb,j) == -1) goto werr;
+
+        /* Write the RESIZE DB opcode. The sizes are just a hint used by the
+         * loader to expand the hash tables once instead of rehashing over
+         * and over while keys are added. Sizes are capped since
+         * REDIS_RDB_LENERR is not a valid length.
+         *
+         * 写入数据库的大小，载入时用于预先扩展字典，避免反复 rehash
+         */
+        db_size = (dictSize(db->dict) < REDIS_RDB_LENERR) ?
+                  dictSize(db->dict) : REDIS_RDB_LENERR-1;
+        expires_size = (dictSize(db->expires) < REDIS_RDB_LENERR) ?
+                       dictSize(db->expires) : REDIS_RDB_LENERR-1;
+        if (rdbSaveType(rdb,REDIS_RDB_OPCODE_RESIZEDB) == -1) goto werr;
+        if (rdbSaveLen(rdb,db_size) == -1) goto werr;
+        if (rdbSaveLen(rdb,expires_size) == -1) goto werr;
 
         /* Iterate this DB writing every entry 
          *
@@ -845,7 +1359,7 @@ int rdbSave(char *filename) {
             expire = getExpire(db,&key);
 
             // 保存键值对数据
-            if (rdbSaveKeyValuePair(&rdb,&key,o,expire,now) == -1) goto werr;
+            if (rdbSaveKeyValuePair(rdb,&key,o,expire,now) == -1) goto werr;
         }
         dictReleaseIterator(di);
     }
@@ -855,19 +1369,82 @@ int rdbSave(char *filename) {
      *
      * 写入 EOF 代码
      */
-    if (rdbSaveType(&rdb,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
+    if (rdbSaveType(rdb,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
 
     /* CRC64 checksum. It will be zero if checksum computation is disabled, the
      * loading code skips the check in this case. 
      *
      * CRC64 校验和。
      *
-     * 如果校验和功能已关闭，那么 rdb.cksum 将为 0 ，
+     * 如果校验和功能已关闭，那么 rdb->cksum 将为 0 ，
      * 在这种情况下， RDB 载入时会跳过校验和检查。
      */
-    cksum = rdb.cksum;
+    cksum = rdb->cksum;
     memrev64ifbe(&cksum);
-    rioWrite(&rdb,&cksum,8);
+    if (rioWrite(rdb,&cksum,8) == 0) goto werr;
+    return REDIS_OK;
+
+werr:
+    if (di) dictReleaseIterator(di);
+    return REDIS_ERR;
+}
+
+//把数据库保存到磁盘上
+int rdbSave(char *filename) {
+    char tmpfile[256];
+    FILE *fp;
+    rio rdb, raw;
+    int writebehind = server.save_write_behind;
+    int segmented = server.rdb_save_threads > 1, layered = 0;
+
+    // 创建临时文件
+    snprintf(tmpfile,256,"temp-%d.rdb", (int) getpid());
+    fp = fopen(tmpfile,"w");
+    if (!fp) {
+        redisLog(REDIS_WARNING, "Failed opening .rdb for saving: %s",
+            strerror(errno));
+        return REDIS_ERR;
+    }
+
+    // 初始化 I/O ，如果可能的话，由写线程异步写入文件
+    if (!writebehind ||
+        rioInitWithWriteBehind(&rdb,fileno(fp),server.save_direct_io) == REDIS_ERR)
+    {
+        writebehind = 0;
+        rioInitWithFile(&rdb,fp);
+    }
+
+    /* Compress the whole file: the RDB stream is written through a block
+     * compression layer, after a magic string that tells the loader to
+     * stack the same layer. The segment index of segmented files refers to
+     * file offsets, so compressed files are never segmented. */
+    // 压缩整个文件：在文件 rio 之上叠加一个压缩层
+    if (server.rdb_stream_compression) {
+        if (rioWrite(&rdb,REDIS_RDB_STREAM_MAGIC,9) == 0) goto werr;
+        raw = rdb;
+        rioInitWithCompression(&rdb,&raw,server.rdb_compression_codec);
+        layered = 1;
+        segmented = 0;
+    }
+
+    // 写入整个数据集
+    if (rdbSaveRio(&rdb,segmented) == REDIS_ERR) goto werr;
+
+    // 写入压缩层的最后一个块，之后直接使用文件 rio
+    if (layered) {
+        if (rioFinishLayer(&rdb) == 0) goto werr;
+        rioFreeLayer(&rdb);
+        rdb = raw;
+        layered = 0;
+    }
+
+    /* Wait for the writer thread to write everything, then give the file
+     * back to stdio. */
+    // 等待写线程写入所有数据
+    if (writebehind) {
+        if (rioFlush(&rdb) == 0) goto werr;
+        rioFreeWriteBehind(&rdb);
+    }
 
     /* Make sure data will not remain on the OS's output buffers */
     // 冲洗缓存，确保数据已写入磁盘
@@ -901,6 +1478,11 @@ int rdbSave(char *filename) {
     return REDIS_OK;
 
 werr:
+    if (layered) {
+        rioFreeLayer(&rdb);
+        rdb = raw;
+    }
+    if (writebehind) rioFreeWriteBehind(&rdb);
     // 关闭文件
     fclose(fp);
     // 删除文件
@@ -908,8 +1490,6 @@ werr:
 
     redisLog(REDIS_WARNING,"Write error saving DB on disk: %s", strerror(errno));
 
-    if (di) dictReleaseIterator(di);
-
     return REDIS_ERR;
 }
 
@@ -919,7 +1499,12 @@ int rdbSaveBackground(char *filename) {
     long long start;
 
     // 如果 BGSAVE 已经在执行，那么出错
-    if (server.rdb_child_pid != -1) return REDIS_ERR;
+    if (server.rdb_child_pid != -1 || server.rdb_snapshot_in_progress)
+        return REDIS_ERR;
+
+    /* Save from a thread of this process instead of forking, if enabled. */
+    // 使用后台线程代替子进程进行保存
+    if (server.rdb_forkless) return snapshotStart(filename);
 
     // 记录 BGSAVE 执行前的数据库被修改次数
     server.dirty_before_bgsave = server.dirty;
@@ -1272,15 +1857,13 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
                rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
     {
-        // 载入字符串对象
-        robj *aux = rdbLoadStringObject(rdb);
+        // 将序列化数据直接载入到对象最终使用的缓冲区中
+        unsigned char *blob = rdbLoadBlob(rdb,&len);
 
-        if (aux == NULL) return NULL;
+        if (blob == NULL) return NULL;
 
         o = createObject(REDIS_STRING,NULL); /* string is just placeholder */
-        o->ptr = zmalloc(sdslen(aux->ptr));
-        memcpy(o->ptr,aux->ptr,sdslen(aux->ptr));
-        decrRefCount(aux);
+        o->ptr = blob;
 
         /* Fix the object encoding, and make sure to convert the encoded
          * data type into the base type if accordingly to the current
@@ -1446,58 +2029,1048 @@ void rdbLoadProgressCallback(rio *r, const void *buf, size_t len) {
     }
 }
 
-//将给定 rdb 中保存的数据载入到数据库中。
-int rdbLoad(char *filename) {
-    uint32_t dbid;
-    int type, rdbver;
-    redisDb *db = server.db+0;
-    char buf[1024];
-    long long expiretime, now = mstime();
-    FILE *fp;
-    rio rdb;
+/* Initialize the rio used to load the RDB file 'fp'. If server.rdb_load_mmap
+ * is true the file is mapped in memory and read sequentially from the
+ * mapping, skipping the stdio buffering layer, otherwise (or if mmap()
+ * fails, for instance because the file is empty) stdio is used.
+ *
+ * Mapping is off by default: if the file is truncated while mapped, or the
+ * disk returns an I/O error, reading the mapping raises SIGBUS and the
+ * server crashes instead of reporting a short read like stdio does.
+ *
+ * 初始化用于载入 RDB 文件的 rio ，在可能的情况下将文件映射到内存中。
+ * 这个选项默认关闭：映射期间文件被截断或者磁盘出错时，
+ * 读取映射会触发 SIGBUS ，而不是像 stdio 那样返回读取错误。 */
+static void rdbLoadOpenRio(rio *rdb, FILE *fp) {
+    struct stat sb;
+    void *map;
 
-    // 打开 rdb 文件
-    if ((fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
+    if (server.rdb_load_mmap && fstat(fileno(fp),&sb) != -1 &&
+        sb.st_size > 0)
+    {
+        map = mmap(NULL,sb.st_size,PROT_READ,MAP_PRIVATE,fileno(fp),0);
+        if (map != MAP_FAILED) {
+            /* The file is read once from start to end: let the kernel
+             * read ahead aggressively and drop the pages behind us. */
+            madvise(map,sb.st_size,MADV_SEQUENTIAL);
+            rioInitWithMmap(rdb,map,sb.st_size);
+            // 从文件的当前偏移量开始读取，载入 AOF 文件的 RDB 前言时用到
+            rdb->io.map.pos = ftello(fp);
+            return;
+        }
+        redisLog(REDIS_NOTICE,"Can't mmap() the RDB file, using stdio: %s",
+            strerror(errno));
+    }
+    rioInitWithFile(rdb,fp);
+}
 
-    // 初始化写入流
-    rioInitWithFile(&rdb,fp);
-    rdb.update_cksum = rdbLoadProgressCallback;
-    rdb.max_processing_chunk = server.loading_process_events_interval_bytes;
-    if (rioRead(&rdb,buf,9) == 0) goto eoferr;
-    buf[9] = '\0';
+/* Release the resources used to load the RDB file, including the
+ * decompression layer of compressed files. */
+// 关闭 RDB 文件，释放解压层，如果文件被映射到内存，那么解除映射
+static void rdbLoadCloseFile(rio *rdb, FILE *fp) {
+    if (rioIsLayer(rdb)) {
+        rio *next = rdb->io.layer.next;
 
-    // 检查版本号
-    if (memcmp(buf,"REDIS",5) != 0) {
-        fclose(fp);
-        redisLog(REDIS_WARNING,"Wrong signature trying to load DB from file");
-        errno = EINVAL;
-        return REDIS_ERR;
+        rioFreeLayer(rdb);
+        rdb = next;
     }
-    rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > REDIS_RDB_VERSION) {
-        fclose(fp);
-        redisLog(REDIS_WARNING,"Can't handle RDB format version %d",rdbver);
-        errno = EINVAL;
-        return REDIS_ERR;
+    if (rioIsMmap(rdb))
+        munmap((void*)rdb->io.map.base,rdb->io.map.len);
+    fclose(fp);
+}
+
+/* Called when the RDB payload was loaded. For RDB files the file is closed
+ * and the server exits the loading state. For the RDB preamble of an AOF
+ * file the caller is still loading the AOF tail, so the file is left open
+ * and positioned right after the RDB payload.
+ *
+ * RDB 数据载入完毕时调用。如果载入的是 AOF 文件的 RDB 前言，
+ * 那么不关闭文件，而是将文件的偏移量设置到 RDB 数据之后，以便继续载入 AOF 命令。 */
+static void rdbLoadDone(rio *rdb, FILE *fp, int preamble) {
+    if (!preamble) {
+        rdbLoadCloseFile(rdb,fp);
+        stopLoading();
+        return;
     }
+    if (rioIsMmap(rdb)) {
+        fseeko(fp,rdb->io.map.pos,SEEK_SET);
+        munmap((void*)rdb->io.map.base,rdb->io.map.len);
+    }
+}
 
-    // 将服务器状态调整到开始载入状态
-    startLoading(fp);
-    while(1) {
-        robj *key, *val;
-        expiretime = -1;
+/* ----------------------------- Parallel loading ---------------------------
+ *
+ * 多线程载入 RDB 文件
+ *
+ * When server.rdb_load_threads is greater than one, rdbLoad() splits the
+ * work in a pipeline:
+ *
+ * 1) The main thread reads the file, handling opcodes (SELECTDB, RESIZEDB,
+ *    expire times) and copying the still serialized key and value of every
+ *    record into a buffer, without decoding them. Records are grouped in
+ *    batches of RDB_LOAD_BATCH_SIZE.
+ *
+ *    主线程读取文件，处理各种操作码，并将每个键值对未经解码的数据复制到缓冲区中。
+ *
+ * 2) N worker threads decode the records of a batch (LZF decompression,
+ *    object creation, encoding conversions) reading from the buffers.
+ *
+ *    N 个工作线程从缓冲区中解码键值对。
+ *
+ * 3) The main thread adds the decoded objects to the DBs, in file order,
+ *    while the workers decode the next batch.
+ *
+ *    主线程按文件中的顺序将解码后的键值对添加到数据库中，
+ *    同时工作线程解码下一批键值对。
+ *
+ * Decoding objects only reads configuration parameters from the server
+ * structure, allocates via the thread safe zmalloc, and may reference shared
+ * integers, whose refcount is never modified: so the workers can safely run
+ * it concurrently. The keyspace is only touched by the main thread. */
+
+#define RDB_LOAD_BATCH_SIZE 1024
+
+/* A key-value record read from the RDB file. */
+typedef struct rdbLoadRecord {
+    int dbid;               /* DB the key belongs to. */
+    int type;               /* RDB type of the value. */
+    long long expiretime;   /* Expire time in ms, or -1. */
+    sds raw;                /* Serialized key and value. */
+    robj *key, *val;        /* Decoded by the worker threads. */
+} rdbLoadRecord;
+
+typedef struct rdbLoadBatch {
+    rdbLoadRecord rec[RDB_LOAD_BATCH_SIZE];
+    int count;
+} rdbLoadBatch;
+
+/* State shared by the main thread and the decoding threads. */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;   /* Signaled when a new batch is ready. */
+    pthread_cond_t done_cond;   /* Signaled when a worker is done. */
+    rdbLoadBatch *batch;        /* Batch to decode. */
+    unsigned long generation;   /* Incremented for every new batch. */
+    int nthreads;               /* Number of decoding threads. */
+    int done;                   /* Threads done with the current batch. */
+    int quit;                   /* Set to terminate the threads. */
+} rdbLoaders;
+
+/* Append 'len' bytes read from 'rdb' to the sds pointed by 'dst'.
+ * Returns 0 on success, -1 on short read. */
+static int rdbCopyBytes(rio *rdb, sds *dst, size_t len) {
+    sds s = sdsMakeRoomFor(*dst,len);
+
+    *dst = s;
+    if (len && rioRead(rdb,s+sdslen(s),len) == 0) return -1;
+    sdsIncrLen(s,len);
+    return 0;
+}
 
-        /* Read type. 
-         *
-         * 读入类型指示，决定该如何读入之后跟着的数据。
-         *
-         * 这个指示可以是 rdb.h 中定义的所有以
-         * REDIS_RDB_TYPE_* 为前缀的常量的其中一个
-         * 或者所有以 REDIS_RDB_OPCODE_* 为前缀的常量的其中一个
-         */
-        if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+/* Like rdbLoadLen(), but the bytes read are also appended to 'dst'. */
+static uint32_t rdbCopyLen(rio *rdb, sds *dst, int *isencoded) {
+    unsigned char b;
+    uint32_t len;
+    int type;
 
-        // 读入过期时间值
+    if (isencoded) *isencoded = 0;
+    if (rdbCopyBytes(rdb,dst,1) == -1) return REDIS_RDB_LENERR;
+    b = (*dst)[sdslen(*dst)-1];
+    type = (b&0xC0)>>6;
+
+    if (type == REDIS_RDB_ENCVAL) {
+        if (isencoded) *isencoded = 1;
+        return b&0x3F;
+    } else if (type == REDIS_RDB_6BITLEN) {
+        return b&0x3F;
+    } else if (type == REDIS_RDB_14BITLEN) {
+        if (rdbCopyBytes(rdb,dst,1) == -1) return REDIS_RDB_LENERR;
+        return ((b&0x3F)<<8)|(unsigned char)(*dst)[sdslen(*dst)-1];
+    } else {
+        if (rdbCopyBytes(rdb,dst,4) == -1) return REDIS_RDB_LENERR;
+        memcpy(&len,*dst+sdslen(*dst)-4,4);
+        return ntohl(len);
+    }
+}
+
+/* Copy a serialized string, in any of its encodings, to 'dst'. */
+static int rdbCopyString(rio *rdb, sds *dst) {
+    int isencoded;
+    uint32_t len, clen;
+
+    if ((len = rdbCopyLen(rdb,dst,&isencoded)) == REDIS_RDB_LENERR) return -1;
+    if (!isencoded) return rdbCopyBytes(rdb,dst,len);
+
+    switch(len) {
+    case REDIS_RDB_ENC_INT8: return rdbCopyBytes(rdb,dst,1);
+    case REDIS_RDB_ENC_INT16: return rdbCopyBytes(rdb,dst,2);
+    case REDIS_RDB_ENC_INT32: return rdbCopyBytes(rdb,dst,4);
+    case REDIS_RDB_ENC_CODEC:
+        // 压缩算法 id ，之后的格式和 LZF 相同
+        if (rdbCopyBytes(rdb,dst,1) == -1) return -1;
+        /* Fall through. */
+    case REDIS_RDB_ENC_LZF:
+        // 压缩后的长度和压缩前的长度，然后是压缩数据
+        if ((clen = rdbCopyLen(rdb,dst,NULL)) == REDIS_RDB_LENERR) return -1;
+        if (rdbCopyLen(rdb,dst,NULL) == REDIS_RDB_LENERR) return -1;
+        return rdbCopyBytes(rdb,dst,clen);
+    default:
+        return -1;
+    }
+}
+
+/* Copy a serialized double (see rdbSaveDoubleValue()) to 'dst'. */
+static int rdbCopyDouble(rio *rdb, sds *dst) {
+    unsigned char len;
+
+    if (rdbCopyBytes(rdb,dst,1) == -1) return -1;
+    len = (*dst)[sdslen(*dst)-1];
+    if (len >= 253) return 0; /* NaN, +inf, -inf. */
+    return rdbCopyBytes(rdb,dst,len);
+}
+
+/* Copy the serialized value of type 'rdbtype' to 'dst', without decoding
+ * it. The layout follows rdbLoadObject(). Returns 0 on success, -1 on
+ * error. */
+static int rdbCopyObject(rio *rdb, int rdbtype, sds *dst) {
+    uint32_t len;
+
+    switch(rdbtype) {
+    case REDIS_RDB_TYPE_STRING:
+    case REDIS_RDB_TYPE_HASH_ZIPMAP:
+    case REDIS_RDB_TYPE_LIST_ZIPLIST:
+    case REDIS_RDB_TYPE_SET_INTSET:
+    case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+    case REDIS_RDB_TYPE_HASH_ZIPLIST:
+        return rdbCopyString(rdb,dst);
+    case REDIS_RDB_TYPE_LIST:
+    case REDIS_RDB_TYPE_SET:
+        if ((len = rdbCopyLen(rdb,dst,NULL)) == REDIS_RDB_LENERR) return -1;
+        while(len--)
+            if (rdbCopyString(rdb,dst) == -1) return -1;
+        return 0;
+    case REDIS_RDB_TYPE_ZSET:
+        if ((len = rdbCopyLen(rdb,dst,NULL)) == REDIS_RDB_LENERR) return -1;
+        while(len--) {
+            if (rdbCopyString(rdb,dst) == -1) return -1;
+            if (rdbCopyDouble(rdb,dst) == -1) return -1;
+        }
+        return 0;
+    case REDIS_RDB_TYPE_HASH:
+        if ((len = rdbCopyLen(rdb,dst,NULL)) == REDIS_RDB_LENERR) return -1;
+        while(len--) {
+            if (rdbCopyString(rdb,dst) == -1) return -1;
+            if (rdbCopyString(rdb,dst) == -1) return -1;
+        }
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/* Read the next key-value record from 'rdb' into 'rec', handling the
+ * opcodes found before it. '*dbid' is the currently selected DB.
+ *
+ * 从 rdb 中读入下一个键值对的原始数据，并处理它之前的操作码。
+ *
+ * Returns 1 if a record was read, 0 on the EOF opcode, -1 on error. */
+static int rdbLoadReadRecord(rio *rdb, uint32_t *dbid, rdbLoadRecord *rec) {
+    long long expiretime;
+    int type;
+
+    while(1) {
+        expiretime = -1;
+        if ((type = rdbLoadType(rdb)) == -1) return -1;
+
+        if (type == REDIS_RDB_OPCODE_EXPIRETIME) {
+            if ((expiretime = rdbLoadTime(rdb)) == -1) return -1;
+            if ((type = rdbLoadType(rdb)) == -1) return -1;
+            expiretime *= 1000;
+        } else if (type == REDIS_RDB_OPCODE_EXPIRETIME_MS) {
+            if ((expiretime = rdbLoadMillisecondTime(rdb)) == -1) return -1;
+            if ((type = rdbLoadType(rdb)) == -1) return -1;
+        }
+
+        if (type == REDIS_RDB_OPCODE_EOF) return 0;
+
+        if (type == REDIS_RDB_OPCODE_SELECTDB) {
+            if ((*dbid = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+            if (*dbid >= (unsigned)server.dbnum) {
+                redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
+                exit(1);
+            }
+            continue;
+        }
+
+        if (type == REDIS_RDB_OPCODE_RESIZEDB) {
+            uint32_t db_size, expires_size;
+            redisDb *db = server.db+*dbid;
+
+            if ((db_size = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+                return -1;
+            if ((expires_size = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+                return -1;
+            dictExpand(db->dict,db_size);
+            dictExpand(db->expires,expires_size);
+            continue;
+        }
+
+        if (!rdbIsObjectType(type)) return -1;
+        break;
+    }
+
+    rec->dbid = *dbid;
+    rec->type = type;
+    rec->expiretime = expiretime;
+    rec->key = rec->val = NULL;
+    rec->raw = sdsempty();
+    if (rdbCopyString(rdb,&rec->raw) == -1 ||
+        rdbCopyObject(rdb,type,&rec->raw) == -1)
+    {
+        sdsfree(rec->raw);
+        rec->raw = NULL;
+        return -1;
+    }
+    return 1;
+}
+
+/* Decode the key and value of a record. Called by the worker threads. */
+static void rdbLoadDecodeRecord(rdbLoadRecord *rec) {
+    rio r;
+
+    rioInitWithBuffer(&r,rec->raw);
+    rec->key = rdbLoadStringObject(&r);
+    if (rec->key) rec->val = rdbLoadObject(rec->type,&r);
+    sdsfree(rec->raw);
+    rec->raw = NULL;
+}
+
+void *rdbLoadWorkerMain(void *arg) {
+    int id = (long) arg, j;
+    unsigned long seen = 0;
+    sigset_t sigset;
+
+    /* Make sure only the main thread receives the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    while(1) {
+        rdbLoadBatch *b;
+
+        // 等待新的批次
+        pthread_mutex_lock(&rdbLoaders.mutex);
+        while (rdbLoaders.generation == seen && !rdbLoaders.quit)
+            pthread_cond_wait(&rdbLoaders.work_cond,&rdbLoaders.mutex);
+        if (rdbLoaders.quit) {
+            pthread_mutex_unlock(&rdbLoaders.mutex);
+            return NULL;
+        }
+        seen = rdbLoaders.generation;
+        b = rdbLoaders.batch;
+        pthread_mutex_unlock(&rdbLoaders.mutex);
+
+        // 每个线程解码编号为 id, id+N, id+2N ... 的键值对
+        for (j = id; j < b->count; j += rdbLoaders.nthreads)
+            rdbLoadDecodeRecord(b->rec+j);
+
+        pthread_mutex_lock(&rdbLoaders.mutex);
+        rdbLoaders.done++;
+        pthread_cond_signal(&rdbLoaders.done_cond);
+        pthread_mutex_unlock(&rdbLoaders.mutex);
+    }
+}
+
+/* Hand a batch to the worker threads. */
+static void rdbLoadDispatchBatch(rdbLoadBatch *b) {
+    pthread_mutex_lock(&rdbLoaders.mutex);
+    rdbLoaders.batch = b;
+    rdbLoaders.done = 0;
+    rdbLoaders.generation++;
+    pthread_cond_broadcast(&rdbLoaders.work_cond);
+    pthread_mutex_unlock(&rdbLoaders.mutex);
+}
+
+/* Wait for the worker threads to decode the last dispatched batch. */
+static void rdbLoadWaitBatch(void) {
+    pthread_mutex_lock(&rdbLoaders.mutex);
+    while (rdbLoaders.done < rdbLoaders.nthreads)
+        pthread_cond_wait(&rdbLoaders.done_cond,&rdbLoaders.mutex);
+    pthread_mutex_unlock(&rdbLoaders.mutex);
+}
+
+/* Add a decoded record to its DB. Returns REDIS_ERR if the record could
+ * not be decoded. */
+static int rdbLoadInsertRecord(rdbLoadRecord *rec, long long now) {
+    redisDb *db = server.db+rec->dbid;
+
+    if (rec->key == NULL || rec->val == NULL) {
+        if (rec->key) decrRefCount(rec->key);
+        return REDIS_ERR;
+    }
+
+    /* Already expired keys are not loaded by masters, exactly like
+     * in the serial loader. */
+    // 如果服务器为主节点的话，那么不载入已经过期的键
+    if (server.masterhost == NULL && rec->expiretime != -1 &&
+        rec->expiretime < now)
+    {
+        decrRefCount(rec->key);
+        decrRefCount(rec->val);
+        return REDIS_OK;
+    }
+
+    dbAdd(db,rec->key,rec->val);
+    if (rec->expiretime != -1) setExpire(db,rec->key,rec->expiretime);
+    decrRefCount(rec->key);
+    return REDIS_OK;
+}
+
+/* Add the decoded records of a batch to the DBs, in file order.
+ * Returns REDIS_ERR if some record could not be decoded. */
+static int rdbLoadInsertBatch(rdbLoadBatch *b, long long now) {
+    int j, retval = REDIS_OK;
+
+    for (j = 0; j < b->count; j++)
+        if (rdbLoadInsertRecord(b->rec+j,now) == REDIS_ERR) retval = REDIS_ERR;
+    b->count = 0;
+    return retval;
+}
+
+/* Load the body of the RDB file using the decoding threads: this is called
+ * by rdbLoad() after the header was read. The function returns REDIS_OK on
+ * success, and exits the process on errors like the serial loader does.
+ *
+ * 使用多个线程载入 RDB 文件的主体，在 rdbLoad() 读入文件头之后调用。 */
+static int rdbLoadParallel(rio *rdb, FILE *fp, int rdbver, int preamble) {
+    pthread_t threads[REDIS_RDB_LOAD_MAX_THREADS];
+    rdbLoadBatch *batches[2], *cur, *prev = NULL;
+    uint32_t dbid = 0;
+    long long now = mstime();
+    int j, eof = 0, err = 0;
+
+    rdbLoaders.nthreads = server.rdb_load_threads;
+    if (rdbLoaders.nthreads > REDIS_RDB_LOAD_MAX_THREADS)
+        rdbLoaders.nthreads = REDIS_RDB_LOAD_MAX_THREADS;
+    pthread_mutex_init(&rdbLoaders.mutex,NULL);
+    pthread_cond_init(&rdbLoaders.work_cond,NULL);
+    pthread_cond_init(&rdbLoaders.done_cond,NULL);
+    rdbLoaders.batch = NULL;
+    rdbLoaders.generation = 0;
+    rdbLoaders.done = 0;
+    rdbLoaders.quit = 0;
+
+    for (j = 0; j < rdbLoaders.nthreads; j++) {
+        if (pthread_create(&threads[j],NULL,rdbLoadWorkerMain,
+                           (void*)(long)j) != 0)
+        {
+            redisLog(REDIS_WARNING,"Fatal: Can't create RDB loading threads.");
+            exit(1);
+        }
+    }
+    redisLog(REDIS_NOTICE,"Loading RDB using %d decoding threads",
+        rdbLoaders.nthreads);
+
+    batches[0] = zmalloc(sizeof(rdbLoadBatch));
+    batches[1] = zmalloc(sizeof(rdbLoadBatch));
+    batches[0]->count = batches[1]->count = 0;
+    cur = batches[0];
+
+    while(!eof) {
+        int retval;
+
+        /* Read the next batch while the workers decode the previous one. */
+        // 在工作线程解码上一批键值对的同时，读入下一批
+        while (cur->count < RDB_LOAD_BATCH_SIZE) {
+            retval = rdbLoadReadRecord(rdb,&dbid,cur->rec+cur->count);
+            if (retval == -1) {
+                err = 1;
+                eof = 1;
+                break;
+            } else if (retval == 0) {
+                eof = 1;
+                break;
+            }
+            cur->count++;
+        }
+
+        // 等待上一批解码完毕，然后开始解码这一批，并添加上一批键值对到数据库
+        if (prev) rdbLoadWaitBatch();
+        if (cur->count) rdbLoadDispatchBatch(cur);
+        if (prev && rdbLoadInsertBatch(prev,now) == REDIS_ERR) err = 1;
+        prev = cur->count ? cur : NULL;
+        cur = (cur == batches[0]) ? batches[1] : batches[0];
+    }
+    if (prev) {
+        rdbLoadWaitBatch();
+        if (rdbLoadInsertBatch(prev,now) == REDIS_ERR) err = 1;
+    }
+
+    /* Terminate the threads. */
+    pthread_mutex_lock(&rdbLoaders.mutex);
+    rdbLoaders.quit = 1;
+    pthread_cond_broadcast(&rdbLoaders.work_cond);
+    pthread_mutex_unlock(&rdbLoaders.mutex);
+    for (j = 0; j < rdbLoaders.nthreads; j++) pthread_join(threads[j],NULL);
+    zfree(batches[0]);
+    zfree(batches[1]);
+
+    if (err) goto eoferr;
+
+    /* Verify the checksum if RDB version is >= 5 */
+    if (rdbver >= 5 && server.rdb_checksum) {
+        uint64_t cksum, expected = rdb->cksum;
+
+        if (rioRead(rdb,&cksum,8) == 0) goto eoferr;
+        memrev64ifbe(&cksum);
+        if (cksum == 0) {
+            redisLog(REDIS_WARNING,"RDB file was saved with checksum disabled: no check performed.");
+        } else if (cksum != expected) {
+            redisLog(REDIS_WARNING,"Wrong RDB checksum. Aborting now.");
+            exit(1);
+        }
+    }
+
+    rdbLoadDone(rdb,fp,preamble);
+    return REDIS_OK;
+
+eoferr: /* unexpected end of file is handled here with a fatal exit */
+    redisLog(REDIS_WARNING,"Short read or OOM loading DB. Unrecoverable error, aborting now.");
+    exit(1);
+    return REDIS_ERR; /* Just to avoid warning */
+}
+
+/* ---------------------------- Segmented loading ---------------------------
+ *
+ * 载入分段 RDB 文件
+ *
+ * Segments (see rdbSaveSegments()) are self contained: they can be loaded
+ * one after the other by the serial loader, or read, decompressed and
+ * decoded by different threads, using the index at the end of the file to
+ * locate them. In the latter case the main thread only adds the decoded
+ * keys to the DBs. */
+
+/* Read the rest of a segment from 'rdb', after the SEGMENT opcode, verify
+ * the checksum of its uncompressed payload, and initialize 'payload' to
+ * read the payload. The DB of the segment is stored in '*dbid'.
+ *
+ * 读入段的其余部分，检查段数据的校验和，并初始化用于读取段数据的 payload 。
+ *
+ * When 'rdb' is in memory and the segment is not compressed the payload is
+ * read in place. Otherwise it is read or decompressed into a buffer that is
+ * stored in '*buf', and must be released with zfree() once the payload was
+ * decoded ('*buf' is set to NULL if there is nothing to release).
+ *
+ * Returns 0 on success, -1 on error. */
+static int rdbLoadSegmentPayload(rio *rdb, uint32_t *dbid, rio *payload,
+                                 unsigned char **buf)
+{
+    unsigned char codec;
+    uint64_t clen, len, crc;
+    const void *p;
+    unsigned char *c = NULL, *out = NULL;
+
+    *buf = NULL;
+    if ((*dbid = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+    if (*dbid >= (unsigned)server.dbnum) {
+        redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
+        exit(1);
+    }
+    if (rioRead(rdb,&codec,1) == 0) return -1;
+    if (rioRead(rdb,&clen,8) == 0) return -1;
+    if (rioRead(rdb,&len,8) == 0) return -1;
+    if (rioRead(rdb,&crc,8) == 0) return -1;
+    memrev64ifbe(&clen);
+    memrev64ifbe(&len);
+    memrev64ifbe(&crc);
+
+    /* Lengths that don't fit in memory, or a segment longer than what is
+     * left in the mapping, mean a corrupted file. */
+    // 检查段的长度
+    if (clen > SIZE_MAX || len > SIZE_MAX) return -1;
+    if (rioIsMmap(rdb) && clen > rdb->io.map.len - rdb->io.map.pos)
+        return -1;
+
+    // 读入段数据，数据在内存中时直接使用它
+    if ((p = rioReadInPlace(rdb,clen)) == NULL) {
+        if (rioIsMmap(rdb)) return -1;
+        c = zmalloc(clen);
+        if (clen && rioRead(rdb,c,clen) == 0) goto err;
+        p = c;
+    }
+
+    // 解压段数据
+    if (codec == REDIS_RDB_SEGMENT_RAW) {
+        if (clen != len) goto err;
+        out = c;
+        c = NULL;
+    } else {
+        rdbCodec *codecp = rdbGetCodec(codec);
+
+        if (codecp == NULL) {
+            redisLog(REDIS_WARNING,
+                "RDB segment compressed with codec %d, not compiled in "
+                "this Redis instance", (int)codec);
+            goto err;
+        }
+        out = zmalloc(len);
+        if (codecp->decompress(p,clen,out,len) != len) goto err;
+        zfree(c);
+        c = NULL;
+        p = out;
+    }
+
+    // 比对段数据的校验和
+    if (crc && server.rdb_checksum &&
+        crc64(0,(const unsigned char*)p,len) != crc)
+    {
+        redisLog(REDIS_WARNING,"Wrong RDB segment checksum. Aborting now.");
+        exit(1);
+    }
+    rioInitWithMmap(payload,p,len);
+    *buf = out;
+    return 0;
+
+err:
+    zfree(c);
+    zfree(out);
+    return -1;
+}
+
+/* Decode the next key-value pair of a segment payload into 'rec'.
+ * Returns 1 if a pair was decoded, 0 at the end of the segment, -1 on
+ * error. */
+static int rdbLoadSegmentRecord(rio *r, uint32_t dbid, rdbLoadRecord *rec) {
+    int type;
+
+    rec->dbid = dbid;
+    rec->expiretime = -1;
+    rec->raw = NULL;
+    rec->key = rec->val = NULL;
+    if ((type = rdbLoadType(r)) == -1) return -1;
+    if (type == REDIS_RDB_OPCODE_EXPIRETIME_MS) {
+        if ((rec->expiretime = rdbLoadMillisecondTime(r)) == -1) return -1;
+        if ((type = rdbLoadType(r)) == -1) return -1;
+    }
+    if (type == REDIS_RDB_OPCODE_EOF) return 0;
+    if (!rdbIsObjectType(type)) return -1;
+
+    rec->type = type;
+    if ((rec->key = rdbLoadStringObject(r)) == NULL) return -1;
+    if ((rec->val = rdbLoadObject(type,r)) == NULL) {
+        decrRefCount(rec->key);
+        rec->key = NULL;
+        return -1;
+    }
+    return 1;
+}
+
+/* Load a whole segment in the serial loader, after the SEGMENT opcode was
+ * read. Returns 0 on success, -1 on error. */
+static int rdbLoadSegment(rio *rdb, long long now) {
+    rdbLoadRecord rec;
+    uint32_t dbid;
+    unsigned char *buf;
+    rio r;
+    int retval;
+
+    if (rdbLoadSegmentPayload(rdb,&dbid,&r,&buf) == -1) return -1;
+    while ((retval = rdbLoadSegmentRecord(&r,dbid,&rec)) == 1)
+        rdbLoadInsertRecord(&rec,now);
+    zfree(buf);
+    return retval;
+}
+
+/* Skip the index of a segmented RDB file, after the SEGINDEX opcode. */
+static int rdbLoadSkipSegmentIndex(rio *rdb) {
+    uint32_t count, j;
+    char buf[8];
+
+    if ((count = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return -1;
+    /* The offsets of the segments, then the offset of the index. */
+    for (j = 0; j <= count; j++)
+        if (rioRead(rdb,buf,8) == 0) return -1;
+    return 0;
+}
+
+/* The segments decoded by a thread. */
+typedef struct rdbLoadSegmentResult {
+    rdbLoadRecord *rec;
+    long count;
+    size_t bytes;           /* Size of the segment in the file. */
+    int err;
+} rdbLoadSegmentResult;
+
+/* State shared by the main thread and the segment decoding threads. */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t ready_cond;  /* Signaled when a segment is decoded. */
+    pthread_cond_t space_cond;  /* Signaled when a segment is consumed. */
+    int fd;                     /* RDB file. */
+    const char *map;            /* RDB file mapping, or NULL. */
+    off_t *offsets;             /* Segments offsets, from the index. */
+    int count;                  /* Number of segments. */
+    off_t indexoff;             /* Offset of the index. */
+    int next;                   /* Next segment to decode. */
+    int max_ready;              /* Decoded segments waiting at most. */
+    list *ready;                /* Decoded segments. */
+    int quit;
+} rdbSegLoaders;
+
+/* Return true if the RDB file 'fp' is segmented, that is, if the SEGMENTED
+ * opcode follows the magic string. */
+// 检查 RDB 文件是否为分段文件
+static int rdbLoadIsSegmented(FILE *fp) {
+    unsigned char type;
+
+    return pread(fileno(fp),&type,1,9) == 1 &&
+           type == REDIS_RDB_OPCODE_SEGMENTED;
+}
+
+/* Read the index of a segmented RDB file. Returns REDIS_ERR if the index
+ * is not valid. */
+static int rdbLoadSegmentIndex(FILE *fp) {
+    int fd = fileno(fp);
+    struct stat sb;
+    unsigned char trailer[17];
+    uint64_t indexoff;
+    uint32_t count, j;
+    sds index;
+    rio r;
+
+    // 文件结尾：索引偏移量（8 字节）、 EOF 和校验和（8 字节）
+    if (fstat(fd,&sb) == -1 || sb.st_size < 9+17) return REDIS_ERR;
+    if (pread(fd,trailer,17,sb.st_size-17) != 17) return REDIS_ERR;
+    if (trailer[8] != REDIS_RDB_OPCODE_EOF) return REDIS_ERR;
+    memcpy(&indexoff,trailer,8);
+    memrev64ifbe(&indexoff);
+    if (indexoff < 9 || indexoff >= (uint64_t)sb.st_size-17) return REDIS_ERR;
+
+    index = sdsnewlen(NULL,sb.st_size-17-indexoff);
+    if (pread(fd,index,sdslen(index),indexoff) != (ssize_t)sdslen(index))
+        goto err;
+    rioInitWithBuffer(&r,index);
+    if (rdbLoadType(&r) != REDIS_RDB_OPCODE_SEGINDEX) goto err;
+    if ((count = rdbLoadLen(&r,NULL)) == REDIS_RDB_LENERR) goto err;
+    if (r.io.buffer.pos + (off_t)count*8 != (off_t)sdslen(index)) goto err;
+
+    rdbSegLoaders.offsets = zmalloc(sizeof(off_t)*(count+1));
+    for (j = 0; j < count; j++) {
+        uint64_t o;
+
+        rioRead(&r,&o,8);
+        memrev64ifbe(&o);
+        if (o < 9 || o >= indexoff ||
+            (j > 0 && o <= (uint64_t)rdbSegLoaders.offsets[j-1]))
+        {
+            zfree(rdbSegLoaders.offsets);
+            goto err;
+        }
+        rdbSegLoaders.offsets[j] = o;
+    }
+    rdbSegLoaders.offsets[count] = indexoff;
+    rdbSegLoaders.count = count;
+    rdbSegLoaders.indexoff = indexoff;
+    rdbSegLoaders.fd = fd;
+    sdsfree(index);
+    return REDIS_OK;
+
+err:
+    sdsfree(index);
+    return REDIS_ERR;
+}
+
+/* Read, decompress and decode the segment 'j'. When the file is memory
+ * mapped the segment is decoded in place, directly from the mapping.
+ *
+ * 读入、解压并解码第 j 个段，文件被映射到内存时直接从映射中解码。 */
+static rdbLoadSegmentResult *rdbLoadDecodeSegment(int j) {
+    rdbLoadSegmentResult *res = zmalloc(sizeof(*res));
+    off_t start = rdbSegLoaders.offsets[j];
+    size_t len = rdbSegLoaders.offsets[j+1]-start, nread = 0;
+    long size = 0;
+    uint32_t dbid;
+    unsigned char *raw = NULL, *buf;
+    rio r, payload;
+    int retval;
+
+    res->rec = NULL;
+    res->count = 0;
+    res->bytes = len;
+    res->err = 1;
+
+    // 读入段的原始数据，文件被映射到内存时不需要读入
+    if (rdbSegLoaders.map) {
+        rioInitWithMmap(&r,rdbSegLoaders.map+start,len);
+    } else {
+        raw = zmalloc(len);
+        while (nread < len) {
+            ssize_t n = pread(rdbSegLoaders.fd,raw+nread,len-nread,start+nread);
+
+            if (n <= 0) {
+                zfree(raw);
+                return res;
+            }
+            nread += n;
+        }
+        rioInitWithMmap(&r,raw,len);
+    }
+
+    if (rdbLoadType(&r) != REDIS_RDB_OPCODE_SEGMENT ||
+        rdbLoadSegmentPayload(&r,&dbid,&payload,&buf) == -1)
+    {
+        zfree(raw);
+        return res;
+    }
+
+    // 解码段中的所有键值对
+    while(1) {
+        if (res->count == size) {
+            size = size ? size*2 : 256;
+            res->rec = zrealloc(res->rec,sizeof(rdbLoadRecord)*size);
+        }
+        retval = rdbLoadSegmentRecord(&payload,dbid,res->rec+res->count);
+        if (retval != 1) break;
+        res->count++;
+    }
+    if (retval == 0) res->err = 0;
+    zfree(buf);
+    zfree(raw);
+    return res;
+}
+
+void *rdbLoadSegmentWorkerMain(void *arg) {
+    sigset_t sigset;
+
+    REDIS_NOTUSED(arg);
+
+    /* Make sure only the main thread receives the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    while(1) {
+        rdbLoadSegmentResult *res;
+        int j;
+
+        // 等待缓冲区有空位，然后取出下一个要解码的段
+        pthread_mutex_lock(&rdbSegLoaders.mutex);
+        while ((int)listLength(rdbSegLoaders.ready) >= rdbSegLoaders.max_ready &&
+               !rdbSegLoaders.quit)
+            pthread_cond_wait(&rdbSegLoaders.space_cond,&rdbSegLoaders.mutex);
+        if (rdbSegLoaders.quit || rdbSegLoaders.next == rdbSegLoaders.count) {
+            pthread_mutex_unlock(&rdbSegLoaders.mutex);
+            return NULL;
+        }
+        j = rdbSegLoaders.next++;
+        pthread_mutex_unlock(&rdbSegLoaders.mutex);
+
+        res = rdbLoadDecodeSegment(j);
+
+        pthread_mutex_lock(&rdbSegLoaders.mutex);
+        listAddNodeTail(rdbSegLoaders.ready,res);
+        pthread_cond_signal(&rdbSegLoaders.ready_cond);
+        pthread_mutex_unlock(&rdbSegLoaders.mutex);
+    }
+}
+
+/* Load a segmented RDB file using the decoding threads. Called by rdbLoad()
+ * after the header was read and the index was found by
+ * rdbLoadSegmentIndex(). Exits the process on errors like the serial
+ * loader does.
+ *
+ * 使用多个线程载入分段 RDB 文件。 */
+static int rdbLoadSegmentsParallel(rio *rdb, FILE *fp) {
+    pthread_t threads[REDIS_RDB_LOAD_MAX_THREADS];
+    uint32_t dbid = 0;
+    long long now = mstime();
+    size_t loaded = 0;
+    int j, nthreads = server.rdb_load_threads, type;
+
+    if (nthreads > REDIS_RDB_LOAD_MAX_THREADS)
+        nthreads = REDIS_RDB_LOAD_MAX_THREADS;
+
+    /* Handle the DB sizes before the first segment. */
+    // 处理第一个段之前的数据库大小信息
+    while(1) {
+        if ((type = rdbLoadType(rdb)) == -1) goto eoferr;
+        if (type == REDIS_RDB_OPCODE_SEGMENT ||
+            type == REDIS_RDB_OPCODE_SEGINDEX) break;
+        if (type == REDIS_RDB_OPCODE_SEGMENTED) continue;
+        if (type == REDIS_RDB_OPCODE_SELECTDB) {
+            if ((dbid = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+                goto eoferr;
+            if (dbid >= (unsigned)server.dbnum) {
+                redisLog(REDIS_WARNING,"FATAL: Data file was created with a Redis server configured to handle more than %d databases. Exiting\n", server.dbnum);
+                exit(1);
+            }
+        } else if (type == REDIS_RDB_OPCODE_RESIZEDB) {
+            uint32_t db_size, expires_size;
+
+            if ((db_size = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+                goto eoferr;
+            if ((expires_size = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR)
+                goto eoferr;
+            dictExpand(server.db[dbid].dict,db_size);
+            dictExpand(server.db[dbid].expires,expires_size);
+        } else {
+            goto eoferr;
+        }
+    }
+
+    pthread_mutex_init(&rdbSegLoaders.mutex,NULL);
+    pthread_cond_init(&rdbSegLoaders.ready_cond,NULL);
+    pthread_cond_init(&rdbSegLoaders.space_cond,NULL);
+    rdbSegLoaders.map = rioIsMmap(rdb) ? rdb->io.map.base : NULL;
+    rdbSegLoaders.next = 0;
+    rdbSegLoaders.max_ready = nthreads*2;
+    rdbSegLoaders.ready = listCreate();
+    rdbSegLoaders.quit = 0;
+
+    for (j = 0; j < nthreads; j++) {
+        if (pthread_create(&threads[j],NULL,rdbLoadSegmentWorkerMain,NULL) != 0) {
+            redisLog(REDIS_WARNING,"Fatal: Can't create RDB loading threads.");
+            exit(1);
+        }
+    }
+    redisLog(REDIS_NOTICE,"Loading %d RDB segments using %d threads",
+        rdbSegLoaders.count, nthreads);
+
+    /* Add the decoded segments to the DBs as they become available. */
+    // 将解码完毕的段添加到数据库中
+    for (j = 0; j < rdbSegLoaders.count; j++) {
+        rdbLoadSegmentResult *res;
+        listNode *ln;
+        long i;
+
+        pthread_mutex_lock(&rdbSegLoaders.mutex);
+        while (listLength(rdbSegLoaders.ready) == 0)
+            pthread_cond_wait(&rdbSegLoaders.ready_cond,&rdbSegLoaders.mutex);
+        ln = listFirst(rdbSegLoaders.ready);
+        res = ln->value;
+        listDelNode(rdbSegLoaders.ready,ln);
+        pthread_cond_signal(&rdbSegLoaders.space_cond);
+        pthread_mutex_unlock(&rdbSegLoaders.mutex);
+
+        if (res->err) goto eoferr;
+        for (i = 0; i < res->count; i++)
+            rdbLoadInsertRecord(res->rec+i,now);
+        loaded += res->bytes;
+        zfree(res->rec);
+        zfree(res);
+
+        updateCachedTime();
+        if (server.masterhost && server.repl_state == REDIS_REPL_TRANSFER)
+            replicationSendNewlineToMaster();
+        loadingProgress(loaded);
+        processEventsWhileBlocked();
+    }
+
+    /* Terminate the threads. */
+    pthread_mutex_lock(&rdbSegLoaders.mutex);
+    rdbSegLoaders.quit = 1;
+    pthread_cond_broadcast(&rdbSegLoaders.space_cond);
+    pthread_mutex_unlock(&rdbSegLoaders.mutex);
+    for (j = 0; j < nthreads; j++) pthread_join(threads[j],NULL);
+    listRelease(rdbSegLoaders.ready);
+    zfree(rdbSegLoaders.offsets);
+
+    /* Segments have their own checksums, already verified by the threads,
+     * so the checksum of the whole file is not computed. */
+    rdbLoadDone(rdb,fp,0);
+    return REDIS_OK;
+
+eoferr: /* unexpected end of file is handled here with a fatal exit */
+    redisLog(REDIS_WARNING,"Short read or OOM loading DB. Unrecoverable error, aborting now.");
+    exit(1);
+    return REDIS_ERR; /* Just to avoid warning */
+}
+
+/* Load the RDB payload starting at the current offset of 'fp'.
+ *
+ * 从 fp 的当前偏移量开始载入 RDB 数据。
+ *
+ * When 'preamble' is true the payload is the RDB preamble of an AOF file:
+ * the caller already entered the loading state, the file is not closed,
+ * and on success it is positioned after the payload (see rdbLoadDone()).
+ * Preambles are never compressed nor segmented. */
+static int rdbLoadFile(FILE *fp, int preamble) {
+    uint32_t dbid;
+    int type, rdbver;
+    redisDb *db = server.db+0;
+    char buf[1024];
+    long long expiretime, now = mstime();
+    rio rdb, raw;
+
+    // 初始化读入流，优先使用内存映射
+    rdbLoadOpenRio(&rdb,fp);
+    rdb.update_cksum = rdbLoadProgressCallback;
+    rdb.max_processing_chunk = server.loading_process_events_interval_bytes;
+    if (rioRead(&rdb,buf,9) == 0) goto eoferr;
+
+    /* The whole file is compressed: read the RDB stream through a
+     * decompression layer. The checksum covers the uncompressed stream. */
+    // 整个文件被压缩，在文件 rio 之上叠加解压层，然后读入真正的版本号
+    if (!preamble && memcmp(buf,REDIS_RDB_STREAM_MAGIC,9) == 0) {
+        raw = rdb;
+        raw.update_cksum = NULL;
+        rioInitWithCompression(&rdb,&raw,REDIS_RDB_CODEC_LZF);
+        rdb.update_cksum = rdbLoadProgressCallback;
+        rdb.max_processing_chunk = server.loading_process_events_interval_bytes;
+        if (rioRead(&rdb,buf,9) == 0) goto eoferr;
+    }
+    buf[9] = '\0';
+
+    // 检查版本号
+    if (memcmp(buf,"REDIS",5) != 0) {
+        rdbLoadDone(&rdb,fp,preamble);
+        redisLog(REDIS_WARNING,"Wrong signature trying to load DB from file");
+        errno = EINVAL;
+        return REDIS_ERR;
+    }
+    rdbver = atoi(buf+5);
+    if (rdbver < 1 || rdbver > REDIS_RDB_VERSION) {
+        rdbLoadDone(&rdb,fp,preamble);
+        redisLog(REDIS_WARNING,"Can't handle RDB format version %d",rdbver);
+        errno = EINVAL;
+        return REDIS_ERR;
+    }
+
+    // 将服务器状态调整到开始载入状态
+    if (!preamble) startLoading(fp);
+
+    /* Use threads to decode the objects. Segmented files, that are never
+     * preambles nor compressed as a whole, are loaded a segment at a time
+     * using the index at the end of the file. If the index is not valid
+     * they are loaded serially, since the parallel record loader does
+     * not handle segments.
+     *
+     * 使用多个线程解码对象，分段 RDB 文件以段为单位并行载入，
+     * 段索引无效时串行载入。 */
+    if (server.rdb_load_threads > 1) {
+        if (preamble || rioIsLayer(&rdb) || !rdbLoadIsSegmented(fp))
+            return rdbLoadParallel(&rdb,fp,rdbver,preamble);
+        if (rdbLoadSegmentIndex(fp) == REDIS_OK)
+            return rdbLoadSegmentsParallel(&rdb,fp);
+        redisLog(REDIS_WARNING,
+            "Invalid RDB segment index, loading the segments serially");
+    }
+
+    while(1) {
+        robj *key, *val;
+        expiretime = -1;
+
+        /* Read type. 
+         *
+         * 读入类型指示，决定该如何读入之后跟着的数据。
+         *
+         * 这个指示可以是 rdb.h 中定义的所有以
+         * REDIS_RDB_TYPE_* 为前缀的常量的其中一个
+         * 或者所有以 REDIS_RDB_OPCODE_* 为前缀的常量的其中一个
+         */
+        if ((type = rdbLoadType(&rdb)) == -1) goto eoferr;
+
+        // 读入过期时间值
         if (type == REDIS_RDB_OPCODE_EXPIRETIME) {
 
             // 以秒计算的过期时间
@@ -1557,6 +3130,39 @@ int rdbLoad(char *filename) {
             continue;
         }
 
+        /* Handle RESIZEDB opcode: expand the hash tables of the current DB
+         * to the number of keys it is going to contain.
+         *
+         * 读入数据库大小，预先扩展字典
+         */
+        if (type == REDIS_RDB_OPCODE_RESIZEDB) {
+            uint32_t db_size, expires_size;
+
+            if ((db_size = rdbLoadLen(&rdb,NULL)) == REDIS_RDB_LENERR)
+                goto eoferr;
+            if ((expires_size = rdbLoadLen(&rdb,NULL)) == REDIS_RDB_LENERR)
+                goto eoferr;
+            dictExpand(db->dict,db_size);
+            dictExpand(db->expires,expires_size);
+            continue;
+        }
+
+        /* The marker, the segments and the index of the segments of a
+         * segmented RDB file. The marker and the index are only used by
+         * the parallel loader.
+         *
+         * 分段 RDB 文件的标记、段以及段索引，标记和段索引只在并行载入时使用
+         */
+        if (type == REDIS_RDB_OPCODE_SEGMENTED) continue;
+        if (type == REDIS_RDB_OPCODE_SEGMENT) {
+            if (rdbLoadSegment(&rdb,now) == -1) goto eoferr;
+            continue;
+        }
+        if (type == REDIS_RDB_OPCODE_SEGINDEX) {
+            if (rdbLoadSkipSegmentIndex(&rdb) == -1) goto eoferr;
+            continue;
+        }
+
         /* Read key 
          *
          * 读入键
@@ -1620,11 +3226,8 @@ int rdbLoad(char *filename) {
         }
     }
 
-    // 关闭 RDB 
-    fclose(fp);
-
-    // 服务器从载入状态中退出
-    stopLoading();
+    // 关闭 RDB ，服务器从载入状态中退出
+    rdbLoadDone(&rdb,fp,preamble);
 
     return REDIS_OK;
 
@@ -1634,6 +3237,23 @@ eoferr: /* unexpected end of file is handled here with a fatal exit */
     return REDIS_ERR; /* Just to avoid warning */
 }
 
+//将给定 rdb 中保存的数据载入到数据库中。
+int rdbLoad(char *filename) {
+    FILE *fp;
+
+    // 打开 rdb 文件
+    if ((fp = fopen(filename,"r")) == NULL) return REDIS_ERR;
+    return rdbLoadFile(fp,0);
+}
+
+/* Load the RDB preamble of an AOF file. 'fp' must be positioned at the
+ * start of the preamble, and the server must be already in the loading
+ * state. On success 'fp' is positioned at the start of the AOF tail. */
+// 载入 AOF 文件的 RDB 前言，成功之后 fp 指向 AOF 命令的开头
+int rdbLoadAofPreamble(FILE *fp) {
+    return rdbLoadFile(fp,1);
+}
+
 //处理 BGSAVE 完成时发送的信号、
 void backgroundSaveDoneHandler(int exitcode, int bysignal) {
 
@@ -1678,7 +3298,7 @@ void saveCommand(redisClient *c) {
 
     // BGSAVE 已经在执行中，不能再执行 SAVE
     // 否则将产生竞争条件
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_snapshot_in_progress) {
         addReplyError(c,"Background save already in progress");
         return;
     }
@@ -1694,7 +3314,7 @@ void saveCommand(redisClient *c) {
 void bgsaveCommand(redisClient *c) {
 
     // 不能重复执行 BGSAVE
-    if (server.rdb_child_pid != -1) {
+    if (server.rdb_child_pid != -1 || server.rdb_snapshot_in_progress) {
         addReplyError(c,"Background save already in progress");
 
     // 不能在 BGREWRITEAOF 正在运行时执行
@@ -12,7 +12,7 @@
  *
  * RDB 的版本，当新版本不向旧版本兼容时，增一
  */
-#define REDIS_RDB_VERSION 6
+#define REDIS_RDB_VERSION 7
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -59,6 +59,35 @@
 #define REDIS_RDB_ENC_INT16 1       /* 16 bit signed integer */
 #define REDIS_RDB_ENC_INT32 2       /* 32 bit signed integer */
 #define REDIS_RDB_ENC_LZF 3         /* string compressed with FASTLZ */
+#define REDIS_RDB_ENC_CODEC 4       /* string compressed, codec id follows */
+
+/* Compression codecs. The id is saved after REDIS_RDB_ENC_CODEC, with the
+ * exception of LZF that uses REDIS_RDB_ENC_LZF for compatibility.
+ *
+ * 压缩算法的 id ，保存在 REDIS_RDB_ENC_CODEC 之后。
+ * LZF 为了兼容旧版本，使用 REDIS_RDB_ENC_LZF 编码。 */
+#define REDIS_RDB_CODEC_LZF 0
+#define REDIS_RDB_CODEC_LZ4 1
+#define REDIS_RDB_CODEC_ZSTD 2
+#define REDIS_RDB_CODEC_NUM 3
+
+/* Magic string starting RDB files compressed as a whole: the rest of the
+ * file is a rio compression layer stream containing a plain RDB file.
+ * Older versions refuse it as an unknown RDB version. */
+// 整个文件被压缩的 RDB 文件的开头，之后是压缩层的数据流
+#define REDIS_RDB_STREAM_MAGIC "REDISZ001"
+
+/* zstd compression level used when saving. */
+#define REDIS_RDB_ZSTD_LEVEL 3
+
+/* A compression codec. Both methods return the number of bytes written
+ * to 'out', or 0 if the output does not fit in 'outlen' bytes or the input
+ * is corrupted. */
+typedef struct rdbCodec {
+    char *name;
+    size_t (*compress)(const void *in, size_t inlen, void *out, size_t outlen);
+    size_t (*decompress)(const void *in, size_t inlen, void *out, size_t outlen);
+} rdbCodec;
 
 /* Dup object types to RDB object types. Only reason is readability (are we
  * dealing with RDB types or with in-memory object types?).
@@ -91,6 +120,14 @@
  *
  * 数据库特殊操作标识符
  */
+// 分段 RDB 的标记，紧跟在文件开头的魔数之后
+#define REDIS_RDB_OPCODE_SEGMENTED 248
+// 分段 RDB 的段索引，之后是段的数量、每个段的偏移量和索引自身的偏移量
+#define REDIS_RDB_OPCODE_SEGINDEX 249
+// 分段 RDB 中的一个段，之后是段头和（可能被压缩的）段数据
+#define REDIS_RDB_OPCODE_SEGMENT 250
+// 数据库的键数量和带过期时间的键数量，载入时用于预先扩展字典（RDB 版本 7）
+#define REDIS_RDB_OPCODE_RESIZEDB 251
 // 以 MS 计算的过期时间
 #define REDIS_RDB_OPCODE_EXPIRETIME_MS 252
 // 以秒计算的过期时间
@@ -100,6 +137,17 @@
 // 数据库的结尾（但不是 RDB 文件的结尾）
 #define REDIS_RDB_OPCODE_EOF        255
 
+/* Segmented RDB files (see rdbSaveSegments() in rdb.c).
+ *
+ * The file starts with the SEGMENTED opcode right after the magic string.
+ * A segment is: [SEGMENT][dbid][codec][clen][len][crc64][clen bytes]
+ * where codec is a REDIS_RDB_CODEC_* id or REDIS_RDB_SEGMENT_RAW, clen and
+ * len are 64 bit little endian integers, and the uncompressed payload is a
+ * sequence of key-value pairs terminated by the EOF opcode. */
+#define REDIS_RDB_SEGMENT_RAW 255           /* Segment not compressed. */
+#define REDIS_RDB_SEGMENT_SIZE (1024*1024*4) /* Payload size target. */
+#define REDIS_RDB_SEGMENT_BUCKETS 65536     /* Buckets per work unit. */
+
 int rdbSaveType(rio *rdb, unsigned char type);
 int rdbLoadType(rio *rdb);
 int rdbSaveTime(rio *rdb, time_t t);
@@ -109,9 +157,11 @@ uint32_t rdbLoadLen(rio *rdb, int *isencoded);
 int rdbSaveObjectType(rio *rdb, robj *o);
 int rdbLoadObjectType(rio *rdb);
 int rdbLoad(char *filename);
+int rdbLoadAofPreamble(FILE *fp);
 int rdbSaveBackground(char *filename);
 void rdbRemoveTempFile(pid_t childpid);
 int rdbSave(char *filename);
+int rdbSaveRio(rio *rdb, int segmented);
 int rdbSaveObject(rio *rdb, robj *o);
 off_t rdbSavedObjectLen(robj *o);
 off_t rdbSavedObjectPages(robj *o);
@@ -119,5 +169,9 @@ robj *rdbLoadObject(int type, rio *rdb);
 void backgroundSaveDoneHandler(int exitcode, int bysignal);
 int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime, long long now);
 robj *rdbLoadStringObject(rio *rdb);
+rdbCodec *rdbGetCodec(int id);
+int rdbCodecByName(const char *name);
+int rdbSaveCompressedStringObject(rio *rdb, unsigned char *s, size_t len, int codec);
+robj *rdbLoadCompressedStringObject(rio *rdb, int codec);
 
 #endif
@@ -149,169 +149,171 @@ struct redisCommand *commandTable;
  *    使得在集群模式下，一个被标示为 importing 的槽可以接收这命令。
  */
 struct redisCommand redisCommandTable[] = {
-    {"get",getCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"set",setCommand,-3,"wm",0,NULL,1,1,1,0,0},
-    {"setnx",setnxCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"setex",setexCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"psetex",psetexCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"strlen",strlenCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"del",delCommand,-2,"w",0,NULL,1,-1,1,0,0},
-    {"exists",existsCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"getbit",getbitCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"setrange",setrangeCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"getrange",getrangeCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"substr",getrangeCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"incr",incrCommand,2,"wm",0,NULL,1,1,1,0,0},
-    {"decr",decrCommand,2,"wm",0,NULL,1,1,1,0,0},
-    {"mget",mgetCommand,-2,"r",0,NULL,1,-1,1,0,0},
-    {"rpush",rpushCommand,-3,"wm",0,NULL,1,1,1,0,0},
-    {"lpush",lpushCommand,-3,"wm",0,NULL,1,1,1,0,0},
-    {"rpushx",rpushxCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"lpushx",lpushxCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"linsert",linsertCommand,5,"wm",0,NULL,1,1,1,0,0},
-    {"rpop",rpopCommand,2,"w",0,NULL,1,1,1,0,0},
-    {"lpop",lpopCommand,2,"w",0,NULL,1,1,1,0,0},
-    {"brpop",brpopCommand,-3,"ws",0,NULL,1,1,1,0,0},
-    {"brpoplpush",brpoplpushCommand,4,"wms",0,NULL,1,2,1,0,0},
-    {"blpop",blpopCommand,-3,"ws",0,NULL,1,-2,1,0,0},
-    {"llen",llenCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"lindex",lindexCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"lset",lsetCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"lrange",lrangeCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"ltrim",ltrimCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"lrem",lremCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"rpoplpush",rpoplpushCommand,3,"wm",0,NULL,1,2,1,0,0},
-    {"sadd",saddCommand,-3,"wm",0,NULL,1,1,1,0,0},
-    {"srem",sremCommand,-3,"w",0,NULL,1,1,1,0,0},
-    {"smove",smoveCommand,4,"w",0,NULL,1,2,1,0,0},
-    {"sismember",sismemberCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"scard",scardCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"spop",spopCommand,2,"wRs",0,NULL,1,1,1,0,0},
-    {"srandmember",srandmemberCommand,-2,"rR",0,NULL,1,1,1,0,0},
-    {"sinter",sinterCommand,-2,"rS",0,NULL,1,-1,1,0,0},
-    {"sinterstore",sinterstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
-    {"sunion",sunionCommand,-2,"rS",0,NULL,1,-1,1,0,0},
-    {"sunionstore",sunionstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
-    {"sdiff",sdiffCommand,-2,"rS",0,NULL,1,-1,1,0,0},
-    {"sdiffstore",sdiffstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0},
-    {"smembers",sinterCommand,2,"rS",0,NULL,1,1,1,0,0},
-    {"sscan",sscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
-    {"zadd",zaddCommand,-4,"wm",0,NULL,1,1,1,0,0},
-    {"zincrby",zincrbyCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"zrem",zremCommand,-3,"w",0,NULL,1,1,1,0,0},
-    {"zremrangebyscore",zremrangebyscoreCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"zremrangebyrank",zremrangebyrankCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"zremrangebylex",zremrangebylexCommand,4,"w",0,NULL,1,1,1,0,0},
-    {"zunionstore",zunionstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
-    {"zinterstore",zinterstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0},
-    {"zrange",zrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrangebyscore",zrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrevrangebyscore",zrevrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrangebylex",zrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zrevrangebylex",zrevrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zcount",zcountCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"zlexcount",zlexcountCommand,4,"r",0,NULL,1,1,1,0,0},
-    {"zrevrange",zrevrangeCommand,-4,"r",0,NULL,1,1,1,0,0},
-    {"zcard",zcardCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"zscore",zscoreCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"zrank",zrankCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"zrevrank",zrevrankCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"zscan",zscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
-    {"hset",hsetCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"hsetnx",hsetnxCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"hget",hgetCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"hmset",hmsetCommand,-4,"wm",0,NULL,1,1,1,0,0},
-    {"hmget",hmgetCommand,-3,"r",0,NULL,1,1,1,0,0},
-    {"hincrby",hincrbyCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"hincrbyfloat",hincrbyfloatCommand,4,"wm",0,NULL,1,1,1,0,0},
-    {"hdel",hdelCommand,-3,"w",0,NULL,1,1,1,0,0},
-    {"hlen",hlenCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"hkeys",hkeysCommand,2,"rS",0,NULL,1,1,1,0,0},
-    {"hvals",hvalsCommand,2,"rS",0,NULL,1,1,1,0,0},
-    {"hgetall",hgetallCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"hexists",hexistsCommand,3,"r",0,NULL,1,1,1,0,0},
-    {"hscan",hscanCommand,-3,"rR",0,NULL,1,1,1,0,0},
-    {"incrby",incrbyCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"decrby",decrbyCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"incrbyfloat",incrbyfloatCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"getset",getsetCommand,3,"wm",0,NULL,1,1,1,0,0},
-    {"mset",msetCommand,-3,"wm",0,NULL,1,-1,2,0,0},
-    {"msetnx",msetnxCommand,-3,"wm",0,NULL,1,-1,2,0,0},
-    {"randomkey",randomkeyCommand,1,"rR",0,NULL,0,0,0,0,0},
-    {"select",selectCommand,2,"rl",0,NULL,0,0,0,0,0},
-    {"move",moveCommand,3,"w",0,NULL,1,1,1,0,0},
-    {"rename",renameCommand,3,"w",0,NULL,1,2,1,0,0},
-    {"renamenx",renamenxCommand,3,"w",0,NULL,1,2,1,0,0},
-    {"expire",expireCommand,3,"w",0,NULL,1,1,1,0,0},
-    {"expireat",expireatCommand,3,"w",0,NULL,1,1,1,0,0},
-    {"pexpire",pexpireCommand,3,"w",0,NULL,1,1,1,0,0},
-    {"pexpireat",pexpireatCommand,3,"w",0,NULL,1,1,1,0,0},
-    {"keys",keysCommand,2,"rS",0,NULL,0,0,0,0,0},
-    {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0},
-    {"dbsize",dbsizeCommand,1,"r",0,NULL,0,0,0,0,0},
-    {"auth",authCommand,2,"rslt",0,NULL,0,0,0,0,0},
-    {"ping",pingCommand,1,"rt",0,NULL,0,0,0,0,0},
-    {"echo",echoCommand,2,"r",0,NULL,0,0,0,0,0},
-    {"save",saveCommand,1,"ars",0,NULL,0,0,0,0,0},
-    {"bgsave",bgsaveCommand,1,"ar",0,NULL,0,0,0,0,0},
-    {"bgrewriteaof",bgrewriteaofCommand,1,"ar",0,NULL,0,0,0,0,0},
-    {"shutdown",shutdownCommand,-1,"arlt",0,NULL,0,0,0,0,0},
-    {"lastsave",lastsaveCommand,1,"rR",0,NULL,0,0,0,0,0},
-    {"type",typeCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"multi",multiCommand,1,"rs",0,NULL,0,0,0,0,0},
-    {"exec",execCommand,1,"sM",0,NULL,0,0,0,0,0},
-    {"discard",discardCommand,1,"rs",0,NULL,0,0,0,0,0},
-    {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0},
-    {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0},
-    {"replconf",replconfCommand,-1,"arslt",0,NULL,0,0,0,0,0},
-    {"flushdb",flushdbCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"flushall",flushallCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"sort",sortCommand,-2,"wm",0,sortGetKeys,1,1,1,0,0},
-    {"info",infoCommand,-1,"rlt",0,NULL,0,0,0,0,0},
-    {"monitor",monitorCommand,1,"ars",0,NULL,0,0,0,0,0},
-    {"ttl",ttlCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"pttl",pttlCommand,2,"r",0,NULL,1,1,1,0,0},
-    {"persist",persistCommand,2,"w",0,NULL,1,1,1,0,0},
-    {"slaveof",slaveofCommand,3,"ast",0,NULL,0,0,0,0,0},
-    {"debug",debugCommand,-2,"as",0,NULL,0,0,0,0,0},
-    {"config",configCommand,-2,"art",0,NULL,0,0,0,0,0},
-    {"subscribe",subscribeCommand,-2,"rpslt",0,NULL,0,0,0,0,0},
-    {"unsubscribe",unsubscribeCommand,-1,"rpslt",0,NULL,0,0,0,0,0},
-    {"psubscribe",psubscribeCommand,-2,"rpslt",0,NULL,0,0,0,0,0},
-    {"punsubscribe",punsubscribeCommand,-1,"rpslt",0,NULL,0,0,0,0,0},
-    {"publish",publishCommand,3,"pltr",0,NULL,0,0,0,0,0},
-    {"pubsub",pubsubCommand,-2,"pltrR",0,NULL,0,0,0,0,0},
-    {"watch",watchCommand,-2,"rs",0,NULL,1,-1,1,0,0},
-    {"unwatch",unwatchCommand,1,"rs",0,NULL,0,0,0,0,0},
-    {"cluster",clusterCommand,-2,"ar",0,NULL,0,0,0,0,0},
-    {"restore",restoreCommand,-4,"awm",0,NULL,1,1,1,0,0},
-    {"restore-asking",restoreCommand,-4,"awmk",0,NULL,1,1,1,0,0},
-    {"migrate",migrateCommand,-6,"aw",0,NULL,0,0,0,0,0},
-    {"asking",askingCommand,1,"r",0,NULL,0,0,0,0,0},
-    {"readonly",readonlyCommand,1,"r",0,NULL,0,0,0,0,0},
-    {"readwrite",readwriteCommand,1,"r",0,NULL,0,0,0,0,0},
-    {"dump",dumpCommand,2,"ar",0,NULL,1,1,1,0,0},
-    {"object",objectCommand,-2,"r",0,NULL,2,2,2,0,0},
-    {"client",clientCommand,-2,"ar",0,NULL,0,0,0,0,0},
-    {"eval",evalCommand,-3,"s",0,evalGetKeys,0,0,0,0,0},
-    {"evalsha",evalShaCommand,-3,"s",0,evalGetKeys,0,0,0,0,0},
-    {"slowlog",slowlogCommand,-2,"r",0,NULL,0,0,0,0,0},
-    {"script",scriptCommand,-2,"ras",0,NULL,0,0,0,0,0},
-    {"time",timeCommand,1,"rR",0,NULL,0,0,0,0,0},
-    {"bitop",bitopCommand,-4,"wm",0,NULL,2,-1,1,0,0},
-    {"bitcount",bitcountCommand,-2,"r",0,NULL,1,1,1,0,0},
-    {"bitpos",bitposCommand,-3,"r",0,NULL,1,1,1,0,0},
-    {"wait",waitCommand,3,"rs",0,NULL,0,0,0,0,0},
-    {"pfselftest",pfselftestCommand,1,"r",0,NULL,0,0,0,0,0},
-    {"pfadd",pfaddCommand,-2,"wm",0,NULL,1,1,1,0,0},
-    {"pfcount",pfcountCommand,-2,"w",0,NULL,1,1,1,0,0},
-    {"pfmerge",pfmergeCommand,-2,"wm",0,NULL,1,-1,1,0,0},
-    {"pfdebug",pfdebugCommand,-3,"w",0,NULL,0,0,0,0,0}
+    {"get",getCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"set",setCommand,-3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"setnx",setnxCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"setex",setexCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"psetex",psetexCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"strlen",strlenCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"del",delCommand,-2,"w",0,NULL,1,-1,1,0,0,NULL},
+    {"unlink",unlinkCommand,-2,"w",0,NULL,1,-1,1,0,0,NULL},
+    {"exists",existsCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"getbit",getbitCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"setrange",setrangeCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"getrange",getrangeCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"substr",getrangeCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"incr",incrCommand,2,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"decr",decrCommand,2,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"mget",mgetCommand,-2,"r",0,NULL,1,-1,1,0,0,NULL},
+    {"rpush",rpushCommand,-3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"lpush",lpushCommand,-3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"rpushx",rpushxCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"lpushx",lpushxCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"linsert",linsertCommand,5,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"rpop",rpopCommand,2,"w",0,NULL,1,1,1,0,0,NULL},
+    {"lpop",lpopCommand,2,"w",0,NULL,1,1,1,0,0,NULL},
+    {"brpop",brpopCommand,-3,"ws",0,NULL,1,1,1,0,0,NULL},
+    {"brpoplpush",brpoplpushCommand,4,"wms",0,NULL,1,2,1,0,0,NULL},
+    {"blpop",blpopCommand,-3,"ws",0,NULL,1,-2,1,0,0,NULL},
+    {"llen",llenCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"lindex",lindexCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"lset",lsetCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"lrange",lrangeCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"ltrim",ltrimCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"lrem",lremCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"rpoplpush",rpoplpushCommand,3,"wm",0,NULL,1,2,1,0,0,NULL},
+    {"sadd",saddCommand,-3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"srem",sremCommand,-3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"smove",smoveCommand,4,"w",0,NULL,1,2,1,0,0,NULL},
+    {"sismember",sismemberCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"scard",scardCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"spop",spopCommand,2,"wRs",0,NULL,1,1,1,0,0,NULL},
+    {"srandmember",srandmemberCommand,-2,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"sinter",sinterCommand,-2,"rS",0,NULL,1,-1,1,0,0,NULL},
+    {"sinterstore",sinterstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"sunion",sunionCommand,-2,"rS",0,NULL,1,-1,1,0,0,NULL},
+    {"sunionstore",sunionstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"sdiff",sdiffCommand,-2,"rS",0,NULL,1,-1,1,0,0,NULL},
+    {"sdiffstore",sdiffstoreCommand,-3,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"smembers",sinterCommand,2,"rS",0,NULL,1,1,1,0,0,NULL},
+    {"sscan",sscanCommand,-3,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"zadd",zaddCommand,-4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"zincrby",zincrbyCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"zrem",zremCommand,-3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"zremrangebyscore",zremrangebyscoreCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"zremrangebyrank",zremrangebyrankCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"zremrangebylex",zremrangebylexCommand,4,"w",0,NULL,1,1,1,0,0,NULL},
+    {"zunionstore",zunionstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0,NULL},
+    {"zinterstore",zinterstoreCommand,-4,"wm",0,zunionInterGetKeys,0,0,0,0,0,NULL},
+    {"zrange",zrangeCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrangebyscore",zrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrangebyscore",zrevrangebyscoreCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrangebylex",zrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrangebylex",zrevrangebylexCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zcount",zcountCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zlexcount",zlexcountCommand,4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrange",zrevrangeCommand,-4,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zcard",zcardCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zscore",zscoreCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrank",zrankCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zrevrank",zrevrankCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"zscan",zscanCommand,-3,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"hset",hsetCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"hsetnx",hsetnxCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"hget",hgetCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"hmset",hmsetCommand,-4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"hmget",hmgetCommand,-3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"hincrby",hincrbyCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"hincrbyfloat",hincrbyfloatCommand,4,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"hdel",hdelCommand,-3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"hlen",hlenCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"hkeys",hkeysCommand,2,"rS",0,NULL,1,1,1,0,0,NULL},
+    {"hvals",hvalsCommand,2,"rS",0,NULL,1,1,1,0,0,NULL},
+    {"hgetall",hgetallCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"hexists",hexistsCommand,3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"hscan",hscanCommand,-3,"rR",0,NULL,1,1,1,0,0,NULL},
+    {"incrby",incrbyCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"decrby",decrbyCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"incrbyfloat",incrbyfloatCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"getset",getsetCommand,3,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"mset",msetCommand,-3,"wm",0,NULL,1,-1,2,0,0,NULL},
+    {"msetnx",msetnxCommand,-3,"wm",0,NULL,1,-1,2,0,0,NULL},
+    {"randomkey",randomkeyCommand,1,"rR",0,NULL,0,0,0,0,0,NULL},
+    {"select",selectCommand,2,"rl",0,NULL,0,0,0,0,0,NULL},
+    {"move",moveCommand,3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"rename",renameCommand,3,"w",0,NULL,1,2,1,0,0,NULL},
+    {"renamenx",renamenxCommand,3,"w",0,NULL,1,2,1,0,0,NULL},
+    {"expire",expireCommand,3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"expireat",expireatCommand,3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"pexpire",pexpireCommand,3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"pexpireat",pexpireatCommand,3,"w",0,NULL,1,1,1,0,0,NULL},
+    {"keys",keysCommand,2,"rS",0,NULL,0,0,0,0,0,NULL},
+    {"scan",scanCommand,-2,"rR",0,NULL,0,0,0,0,0,NULL},
+    {"dbsize",dbsizeCommand,1,"r",0,NULL,0,0,0,0,0,NULL},
+    {"auth",authCommand,2,"rslt",0,NULL,0,0,0,0,0,NULL},
+    {"ping",pingCommand,1,"rt",0,NULL,0,0,0,0,0,NULL},
+    {"echo",echoCommand,2,"r",0,NULL,0,0,0,0,0,NULL},
+    {"save",saveCommand,1,"ars",0,NULL,0,0,0,0,0,NULL},
+    {"bgsave",bgsaveCommand,1,"ar",0,NULL,0,0,0,0,0,NULL},
+    {"bgrewriteaof",bgrewriteaofCommand,1,"ar",0,NULL,0,0,0,0,0,NULL},
+    {"shutdown",shutdownCommand,-1,"arlt",0,NULL,0,0,0,0,0,NULL},
+    {"lastsave",lastsaveCommand,1,"rR",0,NULL,0,0,0,0,0,NULL},
+    {"type",typeCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"multi",multiCommand,1,"rs",0,NULL,0,0,0,0,0,NULL},
+    {"exec",execCommand,1,"sM",0,NULL,0,0,0,0,0,NULL},
+    {"discard",discardCommand,1,"rs",0,NULL,0,0,0,0,0,NULL},
+    {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0,NULL},
+    {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0,NULL},
+    {"replconf",replconfCommand,-1,"arslt",0,NULL,0,0,0,0,0,NULL},
+    {"flushdb",flushdbCommand,1,"w",0,NULL,0,0,0,0,0,NULL},
+    {"flushall",flushallCommand,1,"w",0,NULL,0,0,0,0,0,NULL},
+    {"sort",sortCommand,-2,"wm",0,sortGetKeys,1,1,1,0,0,NULL},
+    {"info",infoCommand,-1,"rlt",0,NULL,0,0,0,0,0,NULL},
+    {"monitor",monitorCommand,1,"ars",0,NULL,0,0,0,0,0,NULL},
+    {"ttl",ttlCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"pttl",pttlCommand,2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"persist",persistCommand,2,"w",0,NULL,1,1,1,0,0,NULL},
+    {"slaveof",slaveofCommand,3,"ast",0,NULL,0,0,0,0,0,NULL},
+    {"debug",debugCommand,-2,"as",0,NULL,0,0,0,0,0,NULL},
+    {"config",configCommand,-2,"art",0,NULL,0,0,0,0,0,NULL},
+    {"subscribe",subscribeCommand,-2,"rpslt",0,NULL,0,0,0,0,0,NULL},
+    {"unsubscribe",unsubscribeCommand,-1,"rpslt",0,NULL,0,0,0,0,0,NULL},
+    {"psubscribe",psubscribeCommand,-2,"rpslt",0,NULL,0,0,0,0,0,NULL},
+    {"punsubscribe",punsubscribeCommand,-1,"rpslt",0,NULL,0,0,0,0,0,NULL},
+    {"publish",publishCommand,3,"pltr",0,NULL,0,0,0,0,0,NULL},
+    {"pubsub",pubsubCommand,-2,"pltrR",0,NULL,0,0,0,0,0,NULL},
+    {"watch",watchCommand,-2,"rs",0,NULL,1,-1,1,0,0,NULL},
+    {"unwatch",unwatchCommand,1,"rs",0,NULL,0,0,0,0,0,NULL},
+    {"cluster",clusterCommand,-2,"ar",0,NULL,0,0,0,0,0,NULL},
+    {"restore",restoreCommand,-4,"awm",0,NULL,1,1,1,0,0,NULL},
+    {"restore-asking",restoreCommand,-4,"awmk",0,NULL,1,1,1,0,0,NULL},
+    {"migrate",migrateCommand,-6,"aw",0,NULL,0,0,0,0,0,NULL},
+    {"asking",askingCommand,1,"r",0,NULL,0,0,0,0,0,NULL},
+    {"readonly",readonlyCommand,1,"r",0,NULL,0,0,0,0,0,NULL},
+    {"readwrite",readwriteCommand,1,"r",0,NULL,0,0,0,0,0,NULL},
+    {"dump",dumpCommand,2,"ar",0,NULL,1,1,1,0,0,NULL},
+    {"object",objectCommand,-2,"r",0,NULL,2,2,2,0,0,NULL},
+    {"client",clientCommand,-2,"ar",0,NULL,0,0,0,0,0,NULL},
+    {"eval",evalCommand,-3,"s",0,evalGetKeys,0,0,0,0,0,NULL},
+    {"evalsha",evalShaCommand,-3,"s",0,evalGetKeys,0,0,0,0,0,NULL},
+    {"slowlog",slowlogCommand,-2,"r",0,NULL,0,0,0,0,0,NULL},
+    {"latency",latencyCommand,-2,"arslt",0,NULL,0,0,0,0,0,NULL},
+    {"script",scriptCommand,-2,"ras",0,NULL,0,0,0,0,0,NULL},
+    {"time",timeCommand,1,"rR",0,NULL,0,0,0,0,0,NULL},
+    {"bitop",bitopCommand,-4,"wm",0,NULL,2,-1,1,0,0,NULL},
+    {"bitcount",bitcountCommand,-2,"r",0,NULL,1,1,1,0,0,NULL},
+    {"bitpos",bitposCommand,-3,"r",0,NULL,1,1,1,0,0,NULL},
+    {"wait",waitCommand,3,"rs",0,NULL,0,0,0,0,0,NULL},
+    {"pfselftest",pfselftestCommand,1,"r",0,NULL,0,0,0,0,0,NULL},
+    {"pfadd",pfaddCommand,-2,"wm",0,NULL,1,1,1,0,0,NULL},
+    {"pfcount",pfcountCommand,-2,"w",0,NULL,1,1,1,0,0,NULL},
+    {"pfmerge",pfmergeCommand,-2,"wm",0,NULL,1,-1,1,0,0,NULL},
+    {"pfdebug",pfdebugCommand,-3,"w",0,NULL,0,0,0,0,0,NULL}
 };
 
-struct evictionPoolEntry *evictionPoolAlloc(void);
+struct evictionPoolEntry *evictionPoolAlloc(int size);
 
 /*============================ Utility functions ============================ */
 
@@ -623,6 +625,16 @@ dictType keylistDictType = {
     dictListDestructor          /* val destructor */
 };
 
+/* Keys set of a fork-less snapshot (see snapshot.c): sds keys, no values. */
+dictType snapshotKeysDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    NULL                        /* val destructor */
+};
+
 /* Cluster nodes hash table, mapping nodes addresses 1.2.3.4:6379 to
  * clusterNode structures. */
 dictType clusterNodesDictType = {
@@ -724,9 +736,11 @@ int incrementallyRehash(int dbid) {
  * to play well with copy-on-write (otherwise when a resize happens lots of
  * memory pages are copied). The goal of this function is to update the ability
  * for dict.c to resize the hash tables accordingly to the fact we have o not
- * running childs. */
+ * running childs. Resizing is also disabled while a fork-less snapshot is in
+ * progress, since its thread expects every key to stay in its bucket. */
 void updateDictResizePolicy(void) {
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
+    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1 &&
+        !server.rdb_snapshot_in_progress)
         dictEnableResize();
     else
         dictDisableResize();
@@ -764,8 +778,13 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
 
         // 传播过期命令
         propagateExpire(db,keyobj);
-        // 从数据库中删除该键
-        dbDelete(db,keyobj);
+        // 如果有快照正在进行，先保存键的旧值
+        snapshotPreserveKey(db,keyobj);
+        // 从数据库中删除该键，值可能会被交给后台线程释放
+        if (server.lazyfree_lazy_expire)
+            dbAsyncDelete(db,keyobj);
+        else
+            dbDelete(db,keyobj);
         // 发送事件
         notifyKeyspaceEvent(REDIS_NOTIFY_EXPIRED,
             "expired",keyobj,db->id);
@@ -780,6 +799,54 @@ int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now) {
     }
 }
 
+/* Return the number of keys sampled per loop by activeExpireCycle() at the
+ * given effort level. */
+// 返回在给定工作量等级下，每次循环抽样的键数量
+static unsigned long activeExpireLookupsPerLoop(int effort) {
+    unsigned long lookups = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP*effort/
+                            ACTIVE_EXPIRE_CYCLE_EFFORT_NEUTRAL;
+
+    return lookups ? lookups : 1;
+}
+
+/* Update the estimated stale keys ratio of 'db' with the result of the
+ * cycle that just visited it ('expired' keys found among 'sampled' keys in
+ * all its sampling rounds), and move the effort level of the DB up or down
+ * by one step.
+ *
+ * 根据本次周期对数据库的抽样结果更新过期键比例估计，并调整数据库的工作量等级。
+ *
+ * The effort only depends on the expired ratio measured by the cycle, not
+ * on the size of the DB: a large DB whose keys expire slowly finds few
+ * expired keys per sample and does not need more effort, while a DB where
+ * many sampled keys are already expired is lagging behind. */
+void activeExpireUpdateEffort(redisDb *db, long long expired,
+                              long long sampled)
+{
+    double ratio;
+
+    if (sampled == 0) return;
+    ratio = (double)expired/sampled;
+
+    /* Exponential moving average of the sampled expired fraction. */
+    // 对抽样得出的过期比例计算指数移动平均
+    db->expire_stale_ratio = db->expire_stale_ratio*0.7 + ratio*0.3;
+
+    if (ratio > 0.25) {
+        if (db->expire_effort < server.active_expire_effort_max)
+            db->expire_effort++;
+    } else if (ratio < 0.05) {
+        if (db->expire_effort > server.active_expire_effort_min)
+            db->expire_effort--;
+    }
+}
+
+/* Return the estimated number of expired keys still in 'db'. */
+// 返回数据库中估计的已过期但未被删除的键数量
+long long activeExpireEstimatedBacklog(redisDb *db) {
+    return (long long)(db->expire_stale_ratio*dictSize(db->expires));
+}
+
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
@@ -837,7 +904,27 @@ void activeExpireCycle(int type) {
     // 默认每次处理的数据库数量
     unsigned int dbs_per_call = REDIS_DBCRON_DBS_PER_CALL;
     // 函数开始的时间
-    long long start = ustime(), timelimit;
+    long long start = ustime(), timelimit, fast_duration;
+    // 所有数据库中最高的工作量等级，决定本次调用的时间预算
+    int effort = server.active_expire_effort_min, time_perc;
+
+    /* Keep every DB effort within the configured bounds, and use the
+     * highest one to compute the time budget of this call. */
+    for (j = 0; j < (unsigned)server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (db->expire_effort > server.active_expire_effort_max)
+            db->expire_effort = server.active_expire_effort_max;
+        if (db->expire_effort < server.active_expire_effort_min)
+            db->expire_effort = server.active_expire_effort_min;
+        if (db->expire_effort > effort) effort = db->expire_effort;
+    }
+    fast_duration = (long long)ACTIVE_EXPIRE_CYCLE_FAST_DURATION*effort/
+                    ACTIVE_EXPIRE_CYCLE_EFFORT_NEUTRAL;
+    time_perc = ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC*effort/
+                ACTIVE_EXPIRE_CYCLE_EFFORT_NEUTRAL;
+    if (time_perc > ACTIVE_EXPIRE_CYCLE_MAX_TIME_PERC)
+        time_perc = ACTIVE_EXPIRE_CYCLE_MAX_TIME_PERC;
 
     // 快速模式
     if (type == ACTIVE_EXPIRE_CYCLE_FAST) {
@@ -847,7 +934,7 @@ void activeExpireCycle(int type) {
         // 如果上次函数没有触发 timelimit_exit ，那么不执行处理
         if (!timelimit_exit) return;
         // 如果距离上次执行未够一定时间，那么不执行处理
-        if (start < last_fast_cycle + ACTIVE_EXPIRE_CYCLE_FAST_DURATION*2) return;
+        if (start < last_fast_cycle + fast_duration*2) return;
         // 运行到这里，说明执行快速处理，记录当前时间
         last_fast_cycle = start;
     }
@@ -875,7 +962,8 @@ void activeExpireCycle(int type) {
      * microseconds we can spend in this function. */
     // 函数处理的微秒时间上限
     // ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC 默认为 25 ，也即是 25 % 的 CPU 时间
-    timelimit = 1000000*ACTIVE_EXPIRE_CYCLE_SLOW_TIME_PERC/server.hz/100;
+    // 时间百分比会根据工作量等级进行调整
+    timelimit = 1000000*time_perc/server.hz/100;
     timelimit_exit = 0;
     if (timelimit <= 0) timelimit = 1;
 
@@ -883,11 +971,14 @@ void activeExpireCycle(int type) {
     // 那么最多只能运行 FAST_DURATION 微秒
     // 默认值为 1000 （微秒）
     if (type == ACTIVE_EXPIRE_CYCLE_FAST)
-        timelimit = ACTIVE_EXPIRE_CYCLE_FAST_DURATION; /* in microseconds. */
+        timelimit = fast_duration; /* in microseconds. */
 
     // 遍历数据库
     for (j = 0; j < dbs_per_call; j++) {
         int expired;
+        unsigned long lookups = 0;
+        // 本次周期在这个数据库中删除的键数量和抽样的键数量
+        long long cycle_expired = 0, cycle_sampled = 0;
         // 指向要处理的数据库
         redisDb *db = server.db+(current_db % server.dbnum);
 
@@ -898,6 +989,27 @@ void activeExpireCycle(int type) {
         // 那么下次会直接从下个 DB 开始处理
         current_db++;
 
+        /* With the expire timer wheel there is no need to sample: just
+         * pop the keys in the buckets that are due.
+         *
+         * Every key with an expire has at least one entry in the wheel once
+         * setExpire() feeds it, so if the wheel holds fewer entries than
+         * db->expires some keys are not indexed: in that case we still run
+         * the sampling loop below, otherwise those keys would only be
+         * expired lazily. */
+        // 使用时间轮时，直接处理已经到期的桶，无须随机抽样
+        // 如果时间轮的索引项少于带过期时间的键，说明有键没有被索引，
+        // 这时仍然需要执行下面的随机抽样
+        if (db->expire_wheel) {
+            long long wheel_expired = 0;
+
+            if (expireWheelProcess(db,start,timelimit,&wheel_expired)) {
+                timelimit_exit = 1;
+                return;
+            }
+            if (db->expire_wheel->entries >= dictSize(db->expires)) continue;
+        }
+
         /* Continue to expire if at the end of the cycle more than 25%
          * of the keys were expired. */
         do {
@@ -910,6 +1022,8 @@ void activeExpireCycle(int type) {
             // 如果该数量为 0 ，直接跳过这个数据库
             if ((num = dictSize(db->expires)) == 0) {
                 db->avg_ttl = 0;
+                db->expire_stale_ratio = 0;
+                db->expire_effort = server.active_expire_effort_min;
                 break;
             }
             // 获取数据库中键值对的数量
@@ -937,9 +1051,9 @@ void activeExpireCycle(int type) {
             // 总共处理的键计数器
             ttl_samples = 0;
 
-            // 每次最多只能检查 LOOKUPS_PER_LOOP 个键
-            if (num > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP)
-                num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
+            // 每次最多只能检查 lookups 个键，这个值由数据库的工作量等级决定
+            lookups = activeExpireLookupsPerLoop(db->expire_effort);
+            if (num > lookups) num = lookups;
 
             // 开始遍历数据库
             while (num--) {
@@ -972,6 +1086,9 @@ void activeExpireCycle(int type) {
                 db->avg_ttl = (db->avg_ttl+avg_ttl)/2;
             }
 
+            cycle_expired += expired;
+            cycle_sampled += ttl_samples;
+
             /* We can't block forever here even if there are many keys to
              * expire. So after a given amount of milliseconds return to the
              * caller waiting for the other active expire cycle. */
@@ -992,13 +1109,19 @@ void activeExpireCycle(int type) {
             }
 
             // 已经超时了，返回
-            if (timelimit_exit) return;
+            if (timelimit_exit) break;
 
             /* We don't repeat the cycle if there are less than 25% of keys
              * found expired in the current DB. */
             // 如果已删除的过期键占当前总数据库带过期时间的键数量的 25 %
             // 那么不再遍历
-        } while (expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4);
+        } while ((unsigned long)expired > lookups/4);
+
+        /* Feed the adaptive effort controller with the expired ratio
+         * measured in this DB by the cycle. */
+        // 根据本次周期的抽样结果调整数据库的工作量等级
+        activeExpireUpdateEffort(db,cycle_expired,cycle_sampled);
+        if (timelimit_exit) return;
     }
 }
 
@@ -1182,6 +1305,9 @@ void clientsCron(void) {
         // 根据情况，缩小客户端查询缓冲区的大小
         if (clientsCronResizeQueryBuffer(c)) continue;
     }
+
+    // 释放回复块池中闲置的块
+    replyBlockPoolTrim();
 }
 
 /* This function handles 'background' operations we are required to do
@@ -1195,15 +1321,23 @@ void databasesCron(void) {
     /* Expire keys by random sampling. Not required for slaves
      * as master will synthesize DELs for us. */
     // 如果服务器不是从服务器，那么执行主动过期键清除
-    if (server.active_expire_enabled && server.masterhost == NULL)
+    if (server.active_expire_enabled && server.masterhost == NULL) {
+        int locked = snapshotLockKeyspace();
+
         // 清除模式为 CYCLE_SLOW ，这个模式会尽量多清除过期键
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_SLOW);
+        if (locked) snapshotUnlockKeyspace();
+    }
 
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
-     * as will cause a lot of copy-on-write of memory pages. */
+     * as will cause a lot of copy-on-write of memory pages. A fork-less
+     * snapshot needs the keys to stay in their buckets, so rehashing is
+     * also suspended while it is in progress. */
     // 在没有 BGSAVE 或者 BGREWRITEAOF 执行时，对哈希表进行 rehash
-    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1) {
+    if (server.rdb_child_pid == -1 && server.aof_child_pid == -1 &&
+        !server.rdb_snapshot_in_progress)
+    {
         /* We use global counters so if we stop the computation at a given
          * DB we'll be able to start from the successive in the next
          * cron loop iteration. */
@@ -1395,11 +1529,15 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     // 如果 BGSAVE 和 BGREWRITEAOF 都没有在执行
     // 并且有一个 BGREWRITEAOF 在等待，那么执行 BGREWRITEAOF
     if (server.rdb_child_pid == -1 && server.aof_child_pid == -1 &&
-        server.aof_rewrite_scheduled)
+        !server.rdb_snapshot_in_progress && server.aof_rewrite_scheduled)
     {
         rewriteAppendOnlyFileBackground();
     }
 
+    /* Check if a fork-less snapshot terminated. */
+    // 检查不使用 fork 的快照是否已经完成
+    if (server.rdb_snapshot_in_progress) snapshotCheckDone();
+
     /* Check if a background saving or AOF rewrite in progress terminated. */
     // 检查 BGSAVE 或者 BGREWRITEAOF 是否已经执行完毕
     if (server.rdb_child_pid != -1 || server.aof_child_pid != -1) {
@@ -1444,6 +1582,7 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
              * REDIS_BGSAVE_RETRY_DELAY seconds already elapsed. */
             // 检查是否有某个保存条件已经满足了
             if (server.dirty >= sp->changes &&
+                !server.rdb_snapshot_in_progress &&
                 server.unixtime-server.lastsave > sp->seconds &&
                 (server.unixtime-server.lastbgsave_try >
                  REDIS_BGSAVE_RETRY_DELAY ||
@@ -1543,8 +1682,12 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     /* Run a fast expire cycle (the called function will return
      * ASAP if a fast cycle is not needed). */
     // 执行一次快速的主动过期检查
-    if (server.active_expire_enabled && server.masterhost == NULL)
+    if (server.active_expire_enabled && server.masterhost == NULL) {
+        int locked = snapshotLockKeyspace();
+
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_FAST);
+        if (locked) snapshotUnlockKeyspace();
+    }
 
     /* Send all the slaves an ACK request if at least one client blocked
      * during the previous event loop iteration. */
@@ -1577,6 +1720,26 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     /* Call the Redis Cluster before sleep function. */
     // 在进入下个事件循环前，执行一些集群收尾工作
     if (server.cluster_enabled) clusterBeforeSleep();
+
+    /* The iteration is over: record the time spent since the poll
+     * returned, that is, without the time waiting for events. */
+    // 记录本次迭代处理事件所用的时间
+    if (server.el_iteration_start) {
+        latencyAddEventLoopSample(ustime()-server.el_iteration_start);
+        server.el_iteration_start = 0;
+    }
+}
+
+/* This function gets called every time the event loop returns from the
+ * poll, and marks the start of the iteration. Nested calls of
+ * aeProcessEvents() (see processEventsWhileBlocked()) don't move the
+ * start, and neither do the ones performed while loading at startup. */
+// 每次事件循环从等待事件中返回时调用，记录本次迭代的开始时间
+void afterSleep(struct aeEventLoop *eventLoop) {
+    REDIS_NOTUSED(eventLoop);
+
+    if (!server.el_iteration_start && !server.loading)
+        server.el_iteration_start = ustime();
 }
 
 /* =========================== Server initialization ======================== */
@@ -1665,7 +1828,8 @@ void createSharedObjects(void) {
 
     // 常用整数
     for (j = 0; j < REDIS_SHARED_INTEGERS; j++) {
-        shared.integers[j] = createObject(REDIS_STRING,(void*)(long)j);
+        shared.integers[j] =
+            makeObjectShared(createObject(REDIS_STRING,(void*)(long)j));
         shared.integers[j]->encoding = REDIS_ENCODING_INT;
     }
 
@@ -1707,6 +1871,7 @@ void initServerConfig() {
     server.unixsocketperm = REDIS_DEFAULT_UNIX_SOCKET_PERM;
     server.ipfd_count = 0;
     server.sofd = -1;
+    server.accept_threads = REDIS_DEFAULT_ACCEPT_THREADS;
     server.dbnum = REDIS_DEFAULT_DBNUM;
     server.verbosity = REDIS_DEFAULT_VERBOSITY;
     server.maxidletime = REDIS_MAXIDLETIME;
@@ -1736,20 +1901,42 @@ void initServerConfig() {
     server.aof_selected_db = -1; /* Make sure the first time will not match */
     server.aof_flush_postponed_start = 0;
     server.aof_rewrite_incremental_fsync = REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC;
+    server.aof_load_pipeline = REDIS_DEFAULT_AOF_LOAD_PIPELINE;
+    server.aof_multi_part = REDIS_DEFAULT_AOF_MULTI_PART;
+    server.aof_timestamp_enabled = REDIS_DEFAULT_AOF_TIMESTAMP_ENABLED;
+    server.aof_load_stop_time = REDIS_DEFAULT_AOF_LOAD_STOP_TIME;
+    server.aof_group_commit = REDIS_DEFAULT_AOF_GROUP_COMMIT;
+    server.aof_use_rdb_preamble = REDIS_DEFAULT_AOF_USE_RDB_PREAMBLE;
     server.pidfile = zstrdup(REDIS_DEFAULT_PID_FILE);
     server.rdb_filename = zstrdup(REDIS_DEFAULT_RDB_FILENAME);
     server.aof_filename = zstrdup(REDIS_DEFAULT_AOF_FILENAME);
     server.requirepass = NULL;
     server.rdb_compression = REDIS_DEFAULT_RDB_COMPRESSION;
+    server.rdb_compression_codec = REDIS_DEFAULT_RDB_COMPRESSION_CODEC;
+    server.rdb_stream_compression = REDIS_DEFAULT_RDB_STREAM_COMPRESSION;
     server.rdb_checksum = REDIS_DEFAULT_RDB_CHECKSUM;
+    server.rdb_load_threads = REDIS_DEFAULT_RDB_LOAD_THREADS;
+    server.rdb_save_threads = REDIS_DEFAULT_RDB_SAVE_THREADS;
+    server.rdb_load_mmap = REDIS_DEFAULT_RDB_LOAD_MMAP;
+    server.save_write_behind = REDIS_DEFAULT_SAVE_WRITE_BEHIND;
+    server.save_direct_io = REDIS_DEFAULT_SAVE_DIRECT_IO;
+    server.rdb_forkless = REDIS_DEFAULT_RDB_FORKLESS;
     server.stop_writes_on_bgsave_err = REDIS_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = REDIS_DEFAULT_ACTIVE_REHASHING;
+    server.active_expire_wheel = REDIS_DEFAULT_ACTIVE_EXPIRE_WHEEL;
+    server.active_expire_effort_min = REDIS_DEFAULT_ACTIVE_EXPIRE_EFFORT_MIN;
+    server.active_expire_effort_max = REDIS_DEFAULT_ACTIVE_EXPIRE_EFFORT_MAX;
     server.notify_keyspace_events = 0;
     server.maxclients = REDIS_MAX_CLIENTS;
     server.bpop_blocked_clients = 0;
     server.maxmemory = REDIS_DEFAULT_MAXMEMORY;
     server.maxmemory_policy = REDIS_DEFAULT_MAXMEMORY_POLICY;
     server.maxmemory_samples = REDIS_DEFAULT_MAXMEMORY_SAMPLES;
+    server.maxmemory_pool_size = REDIS_EVICTION_POOL_SIZE;
+    server.lfu_log_factor = REDIS_DEFAULT_LFU_LOG_FACTOR;
+    server.lfu_decay_time = REDIS_DEFAULT_LFU_DECAY_TIME;
+    server.lazyfree_lazy_eviction = REDIS_DEFAULT_LAZYFREE_LAZY_EVICTION;
+    server.lazyfree_lazy_expire = REDIS_DEFAULT_LAZYFREE_LAZY_EXPIRE;
     server.hash_max_ziplist_entries = REDIS_HASH_MAX_ZIPLIST_ENTRIES;
     server.hash_max_ziplist_value = REDIS_HASH_MAX_ZIPLIST_VALUE;
     server.list_max_ziplist_entries = REDIS_LIST_MAX_ZIPLIST_ENTRIES;
@@ -1951,6 +2138,15 @@ void adjustOpenFilesLimit(void) {
  * one of the IPv4 or IPv6 protocols. */
 int listenToPort(int port, int *fds, int *count) {
     int j;
+    int (*tcpServer)(char*,int,char*,int) = anetTcpServer;
+    int (*tcp6Server)(char*,int,char*,int) = anetTcp6Server;
+
+    /* With accept threads every listener of the same address is created
+     * with SO_REUSEPORT, see acceptThreadsInit(). */
+    if (server.accept_threads > 0) {
+        tcpServer = anetTcpServerReusePort;
+        tcp6Server = anetTcp6ServerReusePort;
+    }
 
     /* Force binding of 0.0.0.0 if no bind address is specified, always
      * entering the loop if j == 0. */
@@ -1959,13 +2155,13 @@ int listenToPort(int port, int *fds, int *count) {
         if (server.bindaddr[j] == NULL) {
             /* Bind * for both IPv6 and IPv4, we enter here only if
              * server.bindaddr_count == 0. */
-            fds[*count] = anetTcp6Server(server.neterr,port,NULL,
+            fds[*count] = tcp6Server(server.neterr,port,NULL,
                 server.tcp_backlog);
             if (fds[*count] != ANET_ERR) {
                 anetNonBlock(NULL,fds[*count]);
                 (*count)++;
             }
-            fds[*count] = anetTcpServer(server.neterr,port,NULL,
+            fds[*count] = tcpServer(server.neterr,port,NULL,
                 server.tcp_backlog);
             if (fds[*count] != ANET_ERR) {
                 anetNonBlock(NULL,fds[*count]);
@@ -1977,11 +2173,11 @@ int listenToPort(int port, int *fds, int *count) {
             if (*count) break;
         } else if (strchr(server.bindaddr[j],':')) {
             /* Bind IPv6 address. */
-            fds[*count] = anetTcp6Server(server.neterr,port,server.bindaddr[j],
+            fds[*count] = tcp6Server(server.neterr,port,server.bindaddr[j],
                 server.tcp_backlog);
         } else {
             /* Bind IPv4 address. */
-            fds[*count] = anetTcpServer(server.neterr,port,server.bindaddr[j],
+            fds[*count] = tcpServer(server.neterr,port,server.bindaddr[j],
                 server.tcp_backlog);
         }
         if (fds[*count] == ANET_ERR) {
@@ -2036,6 +2232,8 @@ void initServer() {
     server.current_client = NULL;
     server.clients = listCreate();
     server.clients_to_close = listCreate();
+    server.clients_waiting_aof = listCreate();
+    server.aof_queued_offset = server.aof_synced_offset = 0;
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
@@ -2049,6 +2247,7 @@ void initServer() {
     createSharedObjects();
     adjustOpenFilesLimit();
     server.el = aeCreateEventLoop(server.maxclients+REDIS_EVENTLOOP_FDSET_INCR);
+    server.el_iteration_start = 0;
     server.db = zmalloc(sizeof(redisDb)*server.dbnum);
 
     /* Open the TCP listening socket for the user commands. */
@@ -2084,11 +2283,17 @@ void initServer() {
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&setDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
-        server.db[j].eviction_pool = evictionPoolAlloc();
+        server.db[j].expire_wheel = server.active_expire_wheel ?
+                                    expireWheelCreate() : NULL;
         server.db[j].id = j;
         server.db[j].avg_ttl = 0;
+        server.db[j].expire_stale_ratio = 0;
+        server.db[j].expire_effort = ACTIVE_EXPIRE_CYCLE_EFFORT_NEUTRAL;
     }
 
+    // 创建所有数据库共享的驱逐池
+    server.eviction_pool = evictionPoolAlloc(server.maxmemory_pool_size);
+
     // 创建 PUBSUB 相关结构
     server.pubsub_channels = dictCreate(&keylistDictType,NULL);
     server.pubsub_patterns = listCreate();
@@ -2097,8 +2302,21 @@ void initServer() {
 
     server.cronloops = 0;
     server.rdb_child_pid = -1;
+    server.rdb_snapshot_in_progress = 0;
     server.aof_child_pid = -1;
     aofRewriteBufferReset();
+    server.aof_pipe_write_data_to_child = -1;
+    server.aof_pipe_read_data_from_parent = -1;
+    server.aof_pipe_write_ack_to_parent = -1;
+    server.aof_pipe_read_ack_from_child = -1;
+    server.aof_pipe_write_ack_to_child = -1;
+    server.aof_pipe_read_ack_from_parent = -1;
+    server.aof_stop_sending_diff = 0;
+    server.aof_child_diff = NULL;
+    server.propagate_raw = NULL;
+    server.aof_last_timestamp = 0;
+    server.aof_tsidx_last = 0;
+    server.aof_tsidx_fd = -1;
     server.aof_buf = sdsempty();
     server.lastsave = time(NULL); /* At startup we consider the DB saved. */
     server.lastbgsave_try = 0;    /* At startup we never tried to BGSAVE. */
@@ -2128,13 +2346,18 @@ void initServer() {
      * domain sockets. */
     // 为 TCP 连接关联连接应答（accept）处理器
     // 用于接受并应答客户端的 connect() 调用
-    for (j = 0; j < server.ipfd_count; j++) {
-        if (aeCreateFileEvent(server.el, server.ipfd[j], AE_READABLE,
-            acceptTcpHandler,NULL) == AE_ERR)
-            {
-                redisPanic(
-                    "Unrecoverable error creating server.ipfd file event.");
-            }
+    // 如果打开了 accept 线程，那么新连接由这些线程接受
+    if (server.accept_threads > 0 && server.ipfd_count > 0) {
+        acceptThreadsInit();
+    } else {
+        for (j = 0; j < server.ipfd_count; j++) {
+            if (aeCreateFileEvent(server.el, server.ipfd[j], AE_READABLE,
+                acceptTcpHandler,NULL) == AE_ERR)
+                {
+                    redisPanic(
+                        "Unrecoverable error creating server.ipfd file event.");
+                }
+        }
     }
 
     // 为本地套接字关联应答处理器
@@ -2144,8 +2367,7 @@ void initServer() {
     /* Open the AOF file if needed. */
     // 如果 AOF 持久化功能已经打开，那么打开或创建一个 AOF 文件
     if (server.aof_state == REDIS_AOF_ON) {
-        server.aof_fd = open(server.aof_filename,
-                               O_WRONLY|O_APPEND|O_CREAT,0644);
+        server.aof_fd = aofOpenCurrentFile();
         if (server.aof_fd == -1) {
             redisLog(REDIS_WARNING, "Can't open the append-only file: %s",
                 strerror(errno));
@@ -2167,6 +2389,9 @@ void initServer() {
     // 如果服务器以 cluster 模式打开，那么初始化 cluster
     if (server.cluster_enabled) clusterInit();
 
+    // 创建命令查找表，这时配置文件中的命令改名已经完成
+    buildCommandLookupTable();
+
     // 初始化复制功能有关的脚本缓存
     replicationScriptCacheInit();
 
@@ -2178,6 +2403,9 @@ void initServer() {
 
     // 初始化 BIO 系统
     bioInit();
+
+    // 初始化惰性释放系统
+    lazyfreeInit();
 }
 
 /* Populates the Redis Command Table starting from the hard coded list
@@ -2252,7 +2480,11 @@ void resetCommandTableStats(void) {
 
         // 清零调用次数
         c->calls = 0;
+
+        // 清空延迟直方图
+        latencyResetCommand(c);
     }
+    latencyResetEventLoop();
 }
 
 /* ========================== Redis OP Array API ============================ */
@@ -2294,11 +2526,185 @@ void redisOpArrayFree(redisOpArray *oa) {
 
 /* ====================== Commands lookup and execution ===================== */
 
+/* Command lookup table.
+ *
+ * 命令查找表
+ *
+ * Every request resolves the command name, so instead of hashing the name
+ * with dictSdsCaseHash() and walking a dict bucket, lookupCommand() uses a
+ * collision free (perfect) hash table built from server.commands once the
+ * rename-command statements of the config file were applied.
+ *
+ * 每个命令请求都需要查找命令，所以 lookupCommand() 不再使用字典，
+ * 而是使用一个由 server.commands 生成的、没有碰撞的（完美）哈希表。
+ *
+ * The hash is computed in two steps ("hash and displace"):
+ *
+ * 1) The length and the first byte of the name select one of
+ *    COMMAND_LOOKUP_BUCKETS buckets, without looking at the rest of the name.
+ * 2) Every bucket has a seed, chosen when the table is built, such that the
+ *    case folded hash of the name with that seed sends every command to a
+ *    different slot of the table.
+ *
+ * 1) 名字的长度和第一个字节决定名字所属的桶。
+ * 2) 每个桶都有一个在创建查找表时选出的种子，
+ *    使用这个种子计算出的哈希值会将每个命令映射到查找表的不同位置上。
+ *
+ * A lookup is then a single hash of the name and a single case insensitive
+ * compare with the only command that can have that name. */
+
+#define COMMAND_LOOKUP_BUCKETS 512          /* 16 lengths * 32 first bytes. */
+#define COMMAND_LOOKUP_MAX_SEED 65536
+
+typedef struct commandLookupEntry {
+    sds name;                   /* Name in server.commands (maybe renamed). */
+    size_t len;
+    struct redisCommand *cmd;
+} commandLookupEntry;
+
+static struct {
+    commandLookupEntry *table;  /* NULL if not built: use server.commands. */
+    unsigned long mask;
+    unsigned int seed[COMMAND_LOOKUP_BUCKETS];
+} commandLookup;
+
+/* The bucket of a name. Only the low 5 bits of the first byte are used, so
+ * upper and lower case letters are in the same bucket. */
+static unsigned int commandLookupBucket(const char *name, size_t len) {
+    return ((len & 15) << 5) | (name[0] & 31);
+}
+
+/* FNV-1a of the name folded to lower case. Setting the 0x20 bit folds
+ * letters, and leaves unchanged the digits and '-' found in command names. */
+static unsigned int commandLookupHash(const char *name, size_t len,
+                                      unsigned int seed)
+{
+    unsigned int h = 2166136261U ^ seed;
+
+    while(len--) h = (h ^ ((unsigned char)*name++ | 0x20)) * 16777619U;
+    return h;
+}
+
+/* Return the entry of the command 'name', or NULL if no such command. */
+static commandLookupEntry *commandLookupFind(const char *name, size_t len) {
+    commandLookupEntry *e;
+    unsigned int seed;
+
+    if (len == 0) return NULL;
+    seed = commandLookup.seed[commandLookupBucket(name,len)];
+    e = commandLookup.table +
+        (commandLookupHash(name,len,seed) & commandLookup.mask);
+    if (e->len != len || strncasecmp(e->name,name,len) != 0) return NULL;
+    return e;
+}
+
+/* Build the lookup table from server.commands. If no seed can be found for
+ * some bucket (names that only differ by bytes folded together by the
+ * hash), the table is not built and the lookups use server.commands. */
+// 根据 server.commands 创建命令查找表
+void buildCommandLookupTable(void) {
+    unsigned long numcommands = dictSize(server.commands), size = 1, j;
+    commandLookupEntry *entries, *table;
+    unsigned long *count, *first, *order;
+    unsigned int *slots;
+    dictIterator *di;
+    dictEntry *de;
+
+    // 查找表的大小至少是命令数量的两倍
+    while (size < numcommands*2) size <<= 1;
+    table = zcalloc(sizeof(commandLookupEntry)*size);
+
+    entries = zmalloc(sizeof(commandLookupEntry)*numcommands);
+    count = zcalloc(sizeof(unsigned long)*COMMAND_LOOKUP_BUCKETS);
+    first = zmalloc(sizeof(unsigned long)*COMMAND_LOOKUP_BUCKETS);
+    order = zmalloc(sizeof(unsigned long)*COMMAND_LOOKUP_BUCKETS);
+    slots = zmalloc(sizeof(unsigned int)*numcommands);
+
+    /* Group the commands by bucket (counting sort): entries[first[b]] is
+     * the first of the count[b] commands of the bucket b. */
+    // 按桶对命令进行分组
+    di = dictGetIterator(server.commands);
+    while((de = dictNext(di)) != NULL) {
+        sds name = dictGetKey(de);
+        count[commandLookupBucket(name,sdslen(name))]++;
+    }
+    dictReleaseIterator(di);
+    for (j = 0; j < COMMAND_LOOKUP_BUCKETS; j++)
+        first[j] = j ? first[j-1] + count[j-1] : 0;
+    memcpy(order,first,sizeof(unsigned long)*COMMAND_LOOKUP_BUCKETS);
+    di = dictGetIterator(server.commands);
+    while((de = dictNext(di)) != NULL) {
+        sds name = dictGetKey(de);
+        commandLookupEntry *e;
+
+        e = entries + order[commandLookupBucket(name,sdslen(name))]++;
+        e->name = name;
+        e->len = sdslen(name);
+        e->cmd = dictGetVal(de);
+    }
+    dictReleaseIterator(di);
+
+    /* Place the biggest buckets first, when the table is still mostly
+     * empty. Selection sort is fine for 512 items at startup. */
+    // 先为最大的桶寻找种子
+    for (j = 0; j < COMMAND_LOOKUP_BUCKETS; j++) order[j] = j;
+    for (j = 0; j < COMMAND_LOOKUP_BUCKETS; j++) {
+        unsigned long k, max = j;
+
+        for (k = j+1; k < COMMAND_LOOKUP_BUCKETS; k++)
+            if (count[order[k]] > count[order[max]]) max = k;
+        k = order[j]; order[j] = order[max]; order[max] = k;
+    }
+
+    memset(commandLookup.seed,0,sizeof(commandLookup.seed));
+    for (j = 0; j < COMMAND_LOOKUP_BUCKETS; j++) {
+        unsigned long b = order[j], n = count[b], k, i;
+        unsigned int seed;
+
+        if (n == 0) break;
+        for (seed = 0; seed < COMMAND_LOOKUP_MAX_SEED; seed++) {
+            /* All the commands of the bucket must land in free slots,
+             * and in different slots. */
+            for (k = 0; k < n; k++) {
+                commandLookupEntry *e = entries+first[b]+k;
+
+                slots[k] = commandLookupHash(e->name,e->len,seed) & (size-1);
+                if (table[slots[k]].name) break;
+                for (i = 0; i < k; i++) if (slots[i] == slots[k]) break;
+                if (i != k) break;
+            }
+            if (k == n) break;
+        }
+        if (seed == COMMAND_LOOKUP_MAX_SEED) {
+            redisLog(REDIS_WARNING,
+                "Can't build the command lookup table, using the command dictionary.");
+            zfree(table);
+            table = NULL;
+            break;
+        }
+        commandLookup.seed[b] = seed;
+        for (k = 0; k < n; k++) table[slots[k]] = entries[first[b]+k];
+    }
+
+    zfree(commandLookup.table);
+    commandLookup.table = table;
+    commandLookup.mask = size-1;
+    zfree(entries);
+    zfree(count);
+    zfree(first);
+    zfree(order);
+    zfree(slots);
+}
+
 /*
  * 根据给定命令名字（SDS），查找命令
  */
 struct redisCommand *lookupCommand(sds name) {
-    return dictFetchValue(server.commands, name);
+    commandLookupEntry *e;
+
+    if (!commandLookup.table) return dictFetchValue(server.commands, name);
+    e = commandLookupFind(name,sdslen(name));
+    return e ? e->cmd : NULL;
 }
 
 /*
@@ -2306,13 +2712,41 @@ struct redisCommand *lookupCommand(sds name) {
  */
 struct redisCommand *lookupCommandByCString(char *s) {
     struct redisCommand *cmd;
-    sds name = sdsnew(s);
+    sds name;
 
+    if (commandLookup.table) {
+        commandLookupEntry *e = commandLookupFind(s,strlen(s));
+        return e ? e->cmd : NULL;
+    }
+    name = sdsnew(s);
     cmd = dictFetchValue(server.commands, name);
     sdsfree(name);
     return cmd;
 }
 
+/* Resolve the command of 'c' from its argv[0]. Clients sending pipelines
+ * often repeat the same command, so the name of the last command resolved
+ * for the client is compared first, with no hashing at all.
+ *
+ * 查找客户端要执行的命令。
+ * 流水线中的命令经常是相同的，所以先和客户端上一个命令的名字进行对比。 */
+static struct redisCommand *lookupClientCommand(redisClient *c) {
+    sds name = c->argv[0]->ptr;
+    size_t len = sdslen(name);
+    commandLookupEntry *e;
+
+    if (c->lastcmd_name && sdslen(c->lastcmd_name) == len &&
+        strncasecmp(c->lastcmd_name,name,len) == 0) return c->lastcmd;
+
+    if (!commandLookup.table) {
+        c->lastcmd_name = NULL;
+        return lookupCommand(name);
+    }
+    e = commandLookupFind(name,len);
+    c->lastcmd_name = e ? e->name : NULL;
+    return e ? e->cmd : NULL;
+}
+
 /* Lookup the command in the current table, if not found also check in
  * the original table containing the original command names unaffected by
  * redis.conf rename-command statement.
@@ -2330,7 +2764,7 @@ struct redisCommand *lookupCommandByCString(char *s) {
 struct redisCommand *lookupCommandOrOriginal(sds name) {
 
     // 查找当前表
-    struct redisCommand *cmd = dictFetchValue(server.commands, name);
+    struct redisCommand *cmd = lookupCommand(name);
 
     // 如果有需要的话，查找原始表
     if (!cmd) cmd = dictFetchValue(server.orig_commands,name);
@@ -2390,6 +2824,7 @@ void call(redisClient *c, int flags) {
     long long dirty, start, duration;
     // 记录命令开始执行前的 FLAG
     int client_old_flags = c->flags;
+    int locked;
 
     /* Sent the command to clients in MONITOR mode, only if the commands are
      * not generated from reading an AOF. */
@@ -2404,6 +2839,15 @@ void call(redisClient *c, int flags) {
     /* Call the command. */
     c->flags &= ~(REDIS_FORCE_AOF|REDIS_FORCE_REPL);
     redisOpArrayInit(&server.also_propagate);
+    /* If a fork-less snapshot is in progress, lock the keyspace and save
+     * the old version of the keys the command is going to modify. */
+    // 如果有快照正在进行，锁住键空间，并保存命令将要修改的键的旧值
+    locked = snapshotLockKeyspace();
+    if (locked) snapshotBeforeCommand(c);
+    // LFU 策略下，记录命令对键的访问
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy) &&
+        (c->cmd->firstkey || c->cmd->getkeys_proc))
+        updateCommandKeysLFU(c);
     // 保留旧 dirty 计数器值
     dirty = server.dirty;
     // 计算命令开始执行的时间
@@ -2412,6 +2856,7 @@ void call(redisClient *c, int flags) {
     c->cmd->proc(c);
     // 计算命令执行耗费的时间
     duration = ustime()-start;
+    if (locked) snapshotUnlockKeyspace();
     // 计算命令执行之后的 dirty 值
     dirty = server.dirty-dirty;
 
@@ -2442,6 +2887,7 @@ void call(redisClient *c, int flags) {
     if (flags & REDIS_CALL_STATS) {
         c->cmd->microseconds += duration;
         c->cmd->calls++;
+        latencyAddCommandSample(c->cmd,duration);
     }
 
     /* Propagate the command into the AOF and replication link */
@@ -2459,8 +2905,17 @@ void call(redisClient *c, int flags) {
         if (dirty)
             flags |= (REDIS_PROPAGATE_REPL | REDIS_PROPAGATE_AOF);
 
+        /* If the arguments are still the ones parsed from the query
+         * buffer, let the AOF reuse the protocol the client sent. */
+        // 参数没有被改写过的话，AOF 可以直接使用客户端发送的原始协议
+        if (c->querybuf_cmdlen && c->querybuf_argv == c->argv) {
+            server.propagate_raw = c->querybuf;
+            server.propagate_raw_len = c->querybuf_cmdlen;
+        }
+
         if (flags != REDIS_PROPAGATE_NONE)
             propagate(c->cmd,c->db->id,c->argv,c->argc,flags);
+        server.propagate_raw = NULL;
     }
 
     /* Restore the old FORCE_AOF/REPL flags, since call can be executed
@@ -2483,6 +2938,16 @@ void call(redisClient *c, int flags) {
         }
         redisOpArrayFree(&server.also_propagate);
     }
+
+    /* With AOF group commit the replies are held until the AOF is fsynced
+     * up to here. This is done for every command, not only for writes: a
+     * read may return data written by another client that is not yet
+     * durable, and a crash would then lose a write that was observed. If
+     * the AOF is already synced up to here the reply is not delayed. */
+    // 记录需要 fsync 到的偏移量，在此之前回复不会被发送。
+    // 读命令也需要等待，因为它可能读到其他客户端尚未 fsync 的写入
+    if (server.aof_group_commit && server.aof_fsync == AOF_FSYNC_ALWAYS)
+        c->aof_sync_offset = aofBufferedOffset();
     server.stat_numcommands++;
 }
 
@@ -2518,7 +2983,7 @@ int processCommand(redisClient *c) {
     /* Now lookup the command and check ASAP about trivial error conditions
      * such as wrong arity, bad command name and so forth. */
     // 查找命令，并进行命令合法性检查，以及命令参数个数检查
-    c->cmd = c->lastcmd = lookupCommand(c->argv[0]->ptr);
+    c->cmd = c->lastcmd = lookupClientCommand(c);
     if (!c->cmd) {
         // 没找到指定的命令
         flagTransaction(c);
@@ -2614,7 +3079,10 @@ int processCommand(redisClient *c) {
     // 如果设置了最大内存，那么检查内存是否超过限制，并做相应的操作
     if (server.maxmemory) {
         // 如果内存已超过限制，那么尝试通过删除过期键来释放内存
+        int locked = snapshotLockKeyspace();
         int retval = freeMemoryIfNeeded();
+
+        if (locked) snapshotUnlockKeyspace();
         // 如果即将要执行的命令可能占用大量内存（REDIS_CMD_DENYOOM）
         // 并且前面的内存释放失败的话
         // 那么向客户端返回内存错误
@@ -2738,8 +3206,17 @@ int processCommand(redisClient *c) {
 
         c->woff = server.master_repl_offset;
         // 处理那些解除了阻塞的键
-        if (listLength(server.ready_keys))
+        if (listLength(server.ready_keys)) {
+            int locked = snapshotLockKeyspace();
+            listNode *last = listLast(server.unblocked_clients);
+
+            /* Serving blocked clients pops from the ready keys, and
+             * BRPOPLPUSH clients push to their target keys. */
+            if (locked) snapshotPreserveReadyKeys();
             handleClientsBlockedOnLists();
+            if (locked) snapshotUnlockKeyspace();
+            aofHoldUnblockedClients(last);
+        }
     }
 
     return REDIS_OK;
@@ -2754,6 +3231,7 @@ void closeListeningSockets(int unlink_unix_socket) {
     int j;
 
     for (j = 0; j < server.ipfd_count; j++) close(server.ipfd[j]);
+    acceptThreadsCloseListeners();
 
     if (server.sofd != -1) close(server.sofd);
 
@@ -2781,6 +3259,10 @@ int prepareForShutdown(int flags) {
         kill(server.rdb_child_pid,SIGUSR1);
         rdbRemoveTempFile(server.rdb_child_pid);
     }
+    if (server.rdb_snapshot_in_progress) {
+        redisLog(REDIS_WARNING,"There is a thread saving an .rdb. Stopping it!");
+        snapshotAbort();
+    }
 
     // 同理，杀死正在执行 BGREWRITEAOF 的子进程
     if (server.aof_state != REDIS_AOF_OFF) {
@@ -2794,6 +3276,7 @@ int prepareForShutdown(int flags) {
         /* Append only file: fsync() the AOF and exit */
         redisLog(REDIS_NOTICE,"Calling fsync() on the AOF file.");
         // 将缓冲区的内容写入到硬盘里面
+        aofWriterDrain();
         aof_fsync(server.aof_fd);
     }
 
@@ -2972,6 +3455,7 @@ sds genRedisInfoString(char *section) {
             "os:%s %s %s\r\n"
             "arch_bits:%d\r\n"
             "multiplexing_api:%s\r\n"
+            "crc64_impl:%s\r\n"
             "gcc_version:%d.%d.%d\r\n"
             "process_id:%ld\r\n"
             "run_id:%s\r\n"
@@ -2989,6 +3473,7 @@ sds genRedisInfoString(char *section) {
             name.sysname, name.release, name.machine,
             server.arch_bits,
             aeGetApiName(),
+            crc64_impl_name(),
 #ifdef __GNUC__
             __GNUC__,__GNUC_MINOR__,__GNUC_PATCHLEVEL__,
 #else
@@ -3043,7 +3528,8 @@ sds genRedisInfoString(char *section) {
             "used_memory_peak_human:%s\r\n"
             "used_memory_lua:%lld\r\n"
             "mem_fragmentation_ratio:%.2f\r\n"
-            "mem_allocator:%s\r\n",
+            "mem_allocator:%s\r\n"
+            "lazyfree_pending_objects:%llu\r\n",
             zmalloc_used,
             hmem,
             server.resident_set_size,
@@ -3051,7 +3537,8 @@ sds genRedisInfoString(char *section) {
             peak_hmem,
             ((long long)lua_gc(server.lua,LUA_GCCOUNT,0))*1024LL,
             zmalloc_get_fragmentation_ratio(server.resident_set_size),
-            ZMALLOC_LIB
+            ZMALLOC_LIB,
+            lazyfreeGetPendingObjectsCount()
             );
     }
 
@@ -3076,11 +3563,12 @@ sds genRedisInfoString(char *section) {
             "aof_last_write_status:%s\r\n",
             server.loading,
             server.dirty,
-            server.rdb_child_pid != -1,
+            server.rdb_child_pid != -1 || server.rdb_snapshot_in_progress,
             (intmax_t)server.lastsave,
             (server.lastbgsave_status == REDIS_OK) ? "ok" : "err",
             (intmax_t)server.rdb_save_time_last,
-            (intmax_t)((server.rdb_child_pid == -1) ?
+            (intmax_t)((server.rdb_child_pid == -1 &&
+                        !server.rdb_snapshot_in_progress) ?
                 -1 : time(NULL)-server.rdb_save_time_start),
             server.aof_state != REDIS_AOF_OFF,
             server.aof_child_pid != -1,
@@ -3327,6 +3815,13 @@ sds genRedisInfoString(char *section) {
         }
     }
 
+    /* Latency percentiles */
+    if (allsections || !strcasecmp(section,"latencystats")) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info, "# Latencystats\r\n");
+        info = genLatencyStatsInfoString(info);
+    }
+
     /* Cluster */
     if (allsections || defsections || !strcasecmp(section,"cluster")) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -3347,8 +3842,11 @@ sds genRedisInfoString(char *section) {
             vkeys = dictSize(server.db[j].expires);
             if (keys || vkeys) {
                 info = sdscatprintf(info,
-                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld\r\n",
-                    j, keys, vkeys, server.db[j].avg_ttl);
+                    "db%d:keys=%lld,expires=%lld,avg_ttl=%lld,"
+                    "expired_backlog=%lld,expire_effort=%d\r\n",
+                    j, keys, vkeys, server.db[j].avg_ttl,
+                    activeExpireEstimatedBacklog(server.db+j),
+                    server.db[j].expire_effort);
             }
         }
     }
@@ -3420,7 +3918,9 @@ void monitorCommand(redisClient *c) {
  * Redis uses an approximation of the LRU algorithm that runs in constant
  * memory. Every time there is a key to expire, we sample N keys (with
  * N very small, usually in around 5) to populate a pool of best keys to
- * evict of M keys (the pool size is defined by REDIS_EVICTION_POOL_SIZE).
+ * evict of M keys (the pool size is maxmemory_pool_size, by default
+ * REDIS_EVICTION_POOL_SIZE). The pool is shared by all the DBs, and every
+ * DB contributes a number of samples proportional to its size.
  *
  * The N keys sampled are added in the pool of good keys to expire (the one
  * with an old access time) if they are better than one of the current keys
@@ -3433,21 +3933,54 @@ void monitorCommand(redisClient *c) {
  * When we try to evict a key, and all the entries in the pool don't exist
  * we populate it again. This time we'll be sure that the pool has at least
  * one key that can be evicted, if there is at least one key that can be
- * evicted in the whole database. */
-
-/* Create a new eviction pool. */
-struct evictionPoolEntry *evictionPoolAlloc(void) {
+ * evicted in the whole database.
+ *
+ * LFU approximation
+ *
+ * With the LFU policies the very same pool is used, but keys are ranked by
+ * 255 minus their (decayed) logarithmic access counter, so the keys that
+ * are accessed less frequently are evicted first. See LFUDecrAndReturn()
+ * in object.c. */
+
+/* Create a new eviction pool of 'size' entries. Every entry gets a
+ * preallocated SDS buffer that is reused for key names up to
+ * REDIS_EVICTION_POOL_CACHED_SDS_SIZE bytes, so that populating the pool
+ * does not need to allocate and free key names over and over.
+ *
+ * 创建一个带有 size 个项的驱逐池，每个项都带有一个预先分配的 sds 缓冲区。 */
+struct evictionPoolEntry *evictionPoolAlloc(int size) {
     struct evictionPoolEntry *ep;
     int j;
 
-    ep = zmalloc(sizeof(*ep)*REDIS_EVICTION_POOL_SIZE);
-    for (j = 0; j < REDIS_EVICTION_POOL_SIZE; j++) {
+    ep = zmalloc(sizeof(*ep)*size);
+    for (j = 0; j < size; j++) {
         ep[j].idle = 0;
         ep[j].key = NULL;
+        ep[j].cached = sdsnewlen(NULL,REDIS_EVICTION_POOL_CACHED_SDS_SIZE);
+        sdsclear(ep[j].cached);
+        ep[j].dbid = 0;
     }
     return ep;
 }
 
+/* Return the dictionary of 'db' we sample keys from, according to the
+ * maxmemory policy. */
+// 根据 maxmemory 策略，返回淘汰键时进行抽样的字典
+static dict *evictionPoolSampleDict(redisDb *db) {
+    if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
+        server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LFU)
+        return db->dict;
+    return db->expires;
+}
+
+/* Release the key name of a pool entry, leaving the entry empty. */
+// 清空驱逐池中的一个项
+static void evictionPoolClearEntry(struct evictionPoolEntry *e) {
+    if (e->key != e->cached) sdsfree(e->key);
+    e->key = NULL;
+    e->idle = 0;
+}
+
 /* This is an helper function for freeMemoryIfNeeded(), it is used in order
  * to populate the evictionPool with a few entries every time we want to
  * expire a key. Keys with idle time smaller than one of the current
@@ -3455,32 +3988,37 @@ struct evictionPoolEntry *evictionPoolAlloc(void) {
  *
  * We insert keys on place in ascending order, so keys with the smaller
  * idle time are on the left, and keys with the higher idle time on the
- * right. */
+ * right.
+ *
+ * 'count' keys are sampled from 'sampledict', a dictionary of the DB 'dbid'.
+ *
+ * 从数据库 dbid 的字典 sampledict 中抽样 count 个键，并将它们添加到驱逐池中。 */
 
 #define EVICTION_SAMPLES_ARRAY_SIZE 16
-void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEntry *pool) {
-    int j, k, count;
+void evictionPoolPopulate(int dbid, dict *sampledict, dict *keydict,
+                          int count, struct evictionPoolEntry *pool)
+{
+    int j, k, size = server.maxmemory_pool_size;
     dictEntry *_samples[EVICTION_SAMPLES_ARRAY_SIZE];
     dictEntry **samples;
 
     /* Try to use a static buffer: this function is a big hit...
      * Note: it was actually measured that this helps. */
-    if (server.maxmemory_samples <= EVICTION_SAMPLES_ARRAY_SIZE) {
+    if (count <= EVICTION_SAMPLES_ARRAY_SIZE) {
         samples = _samples;
     } else {
-        samples = zmalloc(sizeof(samples[0])*server.maxmemory_samples);
+        samples = zmalloc(sizeof(samples[0])*count);
     }
 
 #if 1 /* Use bulk get by default. */
-    count = dictGetRandomKeys(sampledict,samples,server.maxmemory_samples);
+    count = dictGetRandomKeys(sampledict,samples,count);
 #else
-    count = server.maxmemory_samples;
     for (j = 0; j < count; j++) samples[j] = dictGetRandomKey(sampledict);
 #endif
 
     for (j = 0; j < count; j++) {
         unsigned long long idle;
-        sds key;
+        sds key, cached;
         robj *o;
         dictEntry *de;
 
@@ -3491,51 +4029,141 @@ void evictionPoolPopulate(dict *sampledict, dict *keydict, struct evictionPoolEn
          * again in the key dictionary to obtain the value object. */
         if (sampledict != keydict) de = dictFind(keydict, key);
         o = dictGetVal(de);
-        idle = estimateObjectIdleTime(o);
+
+        /* Calculate the idle time according to the policy. This is called
+         * idle just because the code initially handled LRU, but is in fact
+         * just a score where an higher score means better candidate.
+         *
+         * LFU 策略下，访问频率越低的键得分越高，越优先被淘汰。 */
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            idle = 255-LFUDecrAndReturn(o);
+        } else {
+            idle = estimateObjectIdleTime(o);
+        }
 
         /* Insert the element inside the pool.
          * First, find the first empty bucket or the first populated
          * bucket that has an idle time smaller than our idle time. */
         k = 0;
-        while (k < REDIS_EVICTION_POOL_SIZE &&
+        while (k < size &&
                pool[k].key &&
                pool[k].idle < idle) k++;
-        if (k == 0 && pool[REDIS_EVICTION_POOL_SIZE-1].key != NULL) {
+        if (k == 0 && pool[size-1].key != NULL) {
             /* Can't insert if the element is < the worst element we have
              * and there are no empty buckets. */
             continue;
-        } else if (k < REDIS_EVICTION_POOL_SIZE && pool[k].key == NULL) {
+        } else if (k < size && pool[k].key == NULL) {
             /* Inserting into empty position. No setup needed before insert. */
         } else {
             /* Inserting in the middle. Now k points to the first element
              * greater than the element to insert.  */
-            if (pool[REDIS_EVICTION_POOL_SIZE-1].key == NULL) {
+            if (pool[size-1].key == NULL) {
                 /* Free space on the right? Insert at k shifting
                  * all the elements from k to end to the right. */
+
+                /* Save the SDS buffer of the empty entry we overwrite. */
+                // 保存被覆盖的空项的 sds 缓冲区
+                cached = pool[size-1].cached;
                 memmove(pool+k+1,pool+k,
-                    sizeof(pool[0])*(REDIS_EVICTION_POOL_SIZE-k-1));
+                    sizeof(pool[0])*(size-k-1));
+                pool[k].cached = cached;
             } else {
                 /* No free space on right? Insert at k-1 */
                 k--;
                 /* Shift all elements on the left of k (included) to the
                  * left, so we discard the element with smaller idle time. */
-                sdsfree(pool[0].key);
+                cached = pool[0].cached;
+                if (pool[0].key != pool[0].cached) sdsfree(pool[0].key);
                 memmove(pool,pool+1,sizeof(pool[0])*k);
+                pool[k].cached = cached;
             }
         }
-        pool[k].key = sdsdup(key);
+
+        /* Try to reuse the cached SDS buffer of the entry, it is big enough
+         * for most key names: this avoids an allocation and a free for
+         * every key inserted and later removed from the pool. */
+        // 尽量重用项的 sds 缓冲区，避免为键名分配内存
+        if (sdslen(key) <= REDIS_EVICTION_POOL_CACHED_SDS_SIZE) {
+            pool[k].key = sdscpylen(pool[k].cached,key,sdslen(key));
+        } else {
+            pool[k].key = sdsdup(key);
+        }
         pool[k].idle = idle;
+        pool[k].dbid = dbid;
     }
     if (samples != _samples) zfree(samples);
 }
 
+/* Populate the shared eviction pool sampling keys from all the DBs, then
+ * return the best key to evict, storing its DB into '*dbp'. The returned
+ * key is the one stored in the DB dictionary, not a copy.
+ *
+ * 从所有数据库中抽样键并填充驱逐池，然后返回最适合被淘汰的键，
+ * 并将键所在的数据库保存到 *dbp 中。
+ *
+ * The number of keys sampled from every DB is proportional to the number
+ * of candidate keys the DB contains, so that with uneven DBs the quality of
+ * the approximation does not depend on how keys are spread across DBs.
+ * Every non empty DB gets at least one sample.
+ *
+ * 每个数据库被抽样的键数量和它包含的候选键数量成正比，
+ * 每个非空数据库至少会被抽样一个键。
+ *
+ * NULL is returned if there are no keys to evict. */
+sds evictionPoolPickBest(redisDb **dbp) {
+    struct evictionPoolEntry *pool = server.eviction_pool;
+    int j, k;
+
+    while(1) {
+        unsigned long long total = 0;
+
+        for (j = 0; j < server.dbnum; j++)
+            total += dictSize(evictionPoolSampleDict(server.db+j));
+        if (total == 0) return NULL;
+
+        for (j = 0; j < server.dbnum; j++) {
+            redisDb *db = server.db+j;
+            dict *d = evictionPoolSampleDict(db);
+            unsigned long long size = dictSize(d);
+            int count;
+
+            if (size == 0) continue;
+            // 按数据库大小分配抽样数量，向上取整
+            count = (int)((server.maxmemory_samples*size+total-1)/total);
+            evictionPoolPopulate(j,d,db->dict,count,pool);
+        }
+
+        /* Go backward from best to worst element to evict. */
+        for (k = server.maxmemory_pool_size-1; k >= 0; k--) {
+            redisDb *db;
+            dictEntry *de;
+
+            if (pool[k].key == NULL) continue;
+            db = server.db+pool[k].dbid;
+            de = dictFind(evictionPoolSampleDict(db),pool[k].key);
+
+            /* Remove the entry from the pool. Since we always pick the
+             * rightmost entry, empty entries stay on the right. */
+            evictionPoolClearEntry(pool+k);
+
+            /* If the key exists, is our pick. Otherwise it is
+             * a ghost and we need to try the next element. */
+            if (de) {
+                *dbp = db;
+                return dictGetKey(de);
+            }
+        }
+    }
+}
+
 int freeMemoryIfNeeded(void) {
-    size_t mem_used, mem_tofree, mem_freed;
+    size_t mem_used, mem_tofree, mem_freed, mem_overhead;
     int slaves = listLength(server.slaves);
+    int lazy_freed = 0;
 
-    /* Remove the size of slaves output buffers and AOF buffer from the
-     * count of used memory. */
-    // 计算出 Redis 目前占用的内存总数，但有两个方面的内存不会计算在内：
+    /* Remove the size of slaves output buffers, AOF buffer and free reply
+     * blocks from the count of used memory. */
+    // 计算出 Redis 目前占用的内存总数，但有三个方面的内存不会计算在内：
     // 1）从服务器的输出缓冲区的内存
     // 2）AOF 缓冲区的内存
     mem_used = zmalloc_used_memory();
@@ -3557,6 +4185,16 @@ int freeMemoryIfNeeded(void) {
         mem_used -= sdslen(server.aof_buf);
         mem_used -= aofRewriteBufferSize();
     }
+    /* Free reply blocks in the pool are not used by the dataset: they are
+     * released by clientsCron() anyway. */
+    // 3）回复块池中空闲块的内存
+    if (replyBlockPoolMemory() > mem_used)
+        mem_used = 0;
+    else
+        mem_used -= replyBlockPoolMemory();
+
+    // 不计算在内的内存大小，在惰性驱逐时用于重新检查内存占用
+    mem_overhead = zmalloc_used_memory() - mem_used;
 
     /* Check if we are over the memory limit. */
     // 如果目前使用的内存大小比设置的 maxmemory 要小，那么无须执行进一步操作
@@ -3586,20 +4224,33 @@ int freeMemoryIfNeeded(void) {
             redisDb *db = server.db+j;
             dict *dict;
 
+            /* volatile-lru, allkeys-lru, volatile-lfu and allkeys-lfu policy */
+            // 如果使用的是 LRU 或 LFU 策略，
+            // 那么从所有数据库共享的驱逐池中选出 IDLE 时间最长（或访问频率最低）的键
             if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM)
+                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU ||
+                REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+            {
+                /* The pool is shared by all the DBs: evict a single key,
+                 * from whatever DB it belongs to, per iteration. */
+                // 驱逐池由所有数据库共享，每次迭代只淘汰一个键
+                if (j > 0) break;
+                bestkey = evictionPoolPickBest(&db);
+                dict = NULL;
+            } else if (server.maxmemory_policy ==
+                       REDIS_MAXMEMORY_ALLKEYS_RANDOM)
             {
-                // 如果策略是 allkeys-lru 或者 allkeys-random
+                // 如果策略是 allkeys-random
                 // 那么淘汰的目标为所有数据库键
                 dict = server.db[j].dict;
             } else {
-                // 如果策略是 volatile-lru 、 volatile-random 或者 volatile-ttl
+                // 如果策略是 volatile-random 或者 volatile-ttl
                 // 那么淘汰的目标为带过期时间的数据库键
                 dict = server.db[j].expires;
             }
 
             // 跳过空字典
-            if (dictSize(dict) == 0) continue;
+            if (dict && dictSize(dict) == 0) continue;
 
             /* volatile-random and allkeys-random policy */
             // 如果使用的是随机策略，那么从目标字典中随机选出键
@@ -3610,44 +4261,6 @@ int freeMemoryIfNeeded(void) {
                 bestkey = dictGetKey(de);
             }
 
-            /* volatile-lru and allkeys-lru policy */
-            // 如果使用的是 LRU 策略，
-            // 那么从一集 sample 键中选出 IDLE 时间最长的那个键
-            else if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
-            {
-                struct evictionPoolEntry *pool = db->eviction_pool;
-
-                while(bestkey == NULL) {
-                    evictionPoolPopulate(dict, db->dict, db->eviction_pool);
-                    /* Go backward from best to worst element to evict. */
-                    for (k = REDIS_EVICTION_POOL_SIZE-1; k >= 0; k--) {
-                        if (pool[k].key == NULL) continue;
-                        de = dictFind(dict,pool[k].key);
-
-                        /* Remove the entry from the pool. */
-                        sdsfree(pool[k].key);
-                        /* Shift all elements on its right to left. */
-                        memmove(pool+k,pool+k+1,
-                            sizeof(pool[0])*(REDIS_EVICTION_POOL_SIZE-k-1));
-                        /* Clear the element on the right which is empty
-                         * since we shifted one position to the left.  */
-                        pool[REDIS_EVICTION_POOL_SIZE-1].key = NULL;
-                        pool[REDIS_EVICTION_POOL_SIZE-1].idle = 0;
-
-                        /* If the key exists, is our pick. Otherwise it is
-                         * a ghost and we need to try the next element. */
-                        if (de) {
-                            bestkey = dictGetKey(de);
-                            break;
-                        } else {
-                            /* Ghost... */
-                            continue;
-                        }
-                    }
-                }
-            }
-
             /* volatile-ttl */
             // 策略为 volatile-ttl ，从一集 sample 键中选出过期时间距离当前时间最接近的键
             else if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_TTL) {
@@ -3675,6 +4288,7 @@ int freeMemoryIfNeeded(void) {
 
                 robj *keyobj = createStringObject(bestkey,sdslen(bestkey));
                 propagateExpire(db,keyobj);
+                snapshotPreserveKey(db,keyobj);
                 /* We compute the amount of memory freed by dbDelete() alone.
                  * It is possible that actually the memory needed to propagate
                  * the DEL in AOF and replication link is greater than the one
@@ -3685,7 +4299,10 @@ int freeMemoryIfNeeded(void) {
                  * we only care about memory used by the key space. */
                 // 计算删除键所释放的内存数量
                 delta = (long long) zmalloc_used_memory();
-                dbDelete(db,keyobj);
+                if (server.lazyfree_lazy_eviction)
+                    dbAsyncDelete(db,keyobj);
+                else
+                    dbDelete(db,keyobj);
                 delta -= (long long) zmalloc_used_memory();
                 mem_freed += delta;
 
@@ -3702,6 +4319,19 @@ int freeMemoryIfNeeded(void) {
                  * deliver data to the slaves fast enough, so we force the
                  * transmission here inside the loop. */
                 if (slaves) flushSlavesOutputBuffers();
+
+                /* With lazy eviction the memory of big values is reclaimed
+                 * by the background thread, so the delta computed above is
+                 * an underestimation. From time to time check if the
+                 * memory used is already below the limit, in which case
+                 * we can stop evicting keys. */
+                // 惰性驱逐时，每删除 16 个键就检查一次内存是否已经足够
+                if (server.lazyfree_lazy_eviction && !(++lazy_freed % 16)) {
+                    size_t used = zmalloc_used_memory();
+
+                    used = (used > mem_overhead) ? used - mem_overhead : 0;
+                    if (used <= server.maxmemory) mem_freed = mem_tofree;
+                }
             }
         }
 
@@ -3862,7 +4492,7 @@ void loadDataFromDisk(void) {
     // AOF 持久化已打开？
     if (server.aof_state == REDIS_AOF_ON) {
         // 尝试载入 AOF 文件
-        if (loadAppendOnlyFile(server.aof_filename) == REDIS_OK)
+        if (loadAppendOnlyFiles() == REDIS_OK)
             // 打印载入信息，并计算载入耗时长度
             redisLog(REDIS_NOTICE,"DB loaded from append only file: %.3f seconds",(float)(ustime()-start)/1000000);
     // AOF 持久化未打开
@@ -3912,6 +4542,8 @@ int main(int argc, char **argv) {
     setlocale(LC_COLLATE,"");
     zmalloc_enable_thread_safeness();
     zmalloc_set_oom_handler(redisOutOfMemoryHandler);
+    // 构建 CRC64 查找表并选择实现，必须在创建任何线程之前调用
+    crc64_init();
     srand(time(NULL)^getpid());
     gettimeofday(&tv,NULL);
     dictSetHashFunctionSeed(tv.tv_sec^tv.tv_usec^getpid());
@@ -4047,6 +4679,7 @@ int main(int argc, char **argv) {
 
     // 运行事件处理器，一直到服务器关闭为止
     aeSetBeforeSleepProc(server.el,beforeSleep);
+    aeSetAfterSleepProc(server.el,afterSleep);
     aeMain(server.el);
 
     // 服务器关闭，停止事件循环
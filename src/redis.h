@@ -75,11 +75,23 @@
 #define REDIS_DEFAULT_DAEMONIZE 0
 #define REDIS_DEFAULT_UNIX_SOCKET_PERM 0
 #define REDIS_DEFAULT_TCP_KEEPALIVE 0
+#define REDIS_DEFAULT_ACCEPT_THREADS 0
+#define REDIS_ACCEPT_THREADS_MAX 64
 #define REDIS_DEFAULT_LOGFILE ""
 #define REDIS_DEFAULT_SYSLOG_ENABLED 0
 #define REDIS_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR 1
 #define REDIS_DEFAULT_RDB_COMPRESSION 1
+#define REDIS_DEFAULT_RDB_COMPRESSION_CODEC 0 /* REDIS_RDB_CODEC_LZF */
 #define REDIS_DEFAULT_RDB_CHECKSUM 1
+#define REDIS_DEFAULT_RDB_STREAM_COMPRESSION 0 /* Per string compression. */
+#define REDIS_DEFAULT_RDB_LOAD_THREADS 0    /* Serial loading. */
+#define REDIS_DEFAULT_RDB_LOAD_MMAP 0    /* See rdbLoadOpenRio(). */
+#define REDIS_DEFAULT_RDB_FORKLESS 0        /* BGSAVE forks a child. */
+#define REDIS_RDB_LOAD_MAX_THREADS 64
+#define REDIS_DEFAULT_RDB_SAVE_THREADS 0    /* Single stream RDB. */
+#define REDIS_RDB_SAVE_MAX_THREADS 64
+#define REDIS_DEFAULT_SAVE_WRITE_BEHIND 0   /* Write dumps with stdio. */
+#define REDIS_DEFAULT_SAVE_DIRECT_IO 0
 #define REDIS_DEFAULT_RDB_FILENAME "dump.rdb"
 #define REDIS_DEFAULT_SLAVE_SERVE_STALE_DATA 1
 #define REDIS_DEFAULT_SLAVE_READ_ONLY 1
@@ -90,6 +102,12 @@
 #define REDIS_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define REDIS_DEFAULT_ACTIVE_REHASHING 1
 #define REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
+#define REDIS_DEFAULT_AOF_LOAD_PIPELINE 0   /* Parse and execute serially. */
+#define REDIS_DEFAULT_AOF_GROUP_COMMIT 0    /* fsync in beforeSleep(). */
+#define REDIS_DEFAULT_AOF_USE_RDB_PREAMBLE 0
+#define REDIS_DEFAULT_AOF_MULTI_PART 0      /* Single AOF file. */
+#define REDIS_DEFAULT_AOF_TIMESTAMP_ENABLED 0
+#define REDIS_DEFAULT_AOF_LOAD_STOP_TIME 0  /* Load the whole AOF. */
 #define REDIS_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define REDIS_DEFAULT_MIN_SLAVES_MAX_LAG 10
 #define REDIS_IP_STR_LEN INET6_ADDRSTRLEN
@@ -103,10 +121,37 @@
 #define ACTIVE_EXPIRE_CYCLE_SLOW 0
 #define ACTIVE_EXPIRE_CYCLE_FAST 1
 
+/* Adaptive active expire effort. The effort of a DB goes from 1 to
+ * ACTIVE_EXPIRE_CYCLE_EFFORT_LIMIT: lookups per loop and time budgets scale
+ * linearly with it, and match the constants above at the neutral level. */
+// 主动过期的自适应工作量等级，在中间等级时和上面的常量一致
+#define ACTIVE_EXPIRE_CYCLE_EFFORT_NEUTRAL 4
+#define ACTIVE_EXPIRE_CYCLE_EFFORT_LIMIT 10
+#define ACTIVE_EXPIRE_CYCLE_MAX_TIME_PERC 50 /* Hard cap on CPU % used. */
+#define REDIS_DEFAULT_ACTIVE_EXPIRE_EFFORT_MIN 1
+#define REDIS_DEFAULT_ACTIVE_EXPIRE_EFFORT_MAX ACTIVE_EXPIRE_CYCLE_EFFORT_LIMIT
+
+/* Expire timer wheel (see expirewheel.c) */
+// 过期时间轮的桶数量，以及每个桶覆盖的毫秒数
+#define REDIS_EXPIRE_WHEEL_SLOTS 4096
+#define REDIS_EXPIRE_WHEEL_RESOLUTION 10 /* Milliseconds per slot. */
+#define REDIS_DEFAULT_ACTIVE_EXPIRE_WHEEL 0
+
+/* Latency histograms (see latency.c) */
+// 每个 2 的幂之间的区间被分成 2^SUB_BITS 个桶，可以记录的最大值为 2^MAX_BITS 微秒
+#define REDIS_LATENCY_HIST_SUB_BITS 4   /* 16 buckets per power of two. */
+#define REDIS_LATENCY_HIST_MAX_BITS 36  /* About 19 hours in microseconds. */
+#define REDIS_LATENCY_HIST_BUCKETS \
+    ((REDIS_LATENCY_HIST_MAX_BITS-REDIS_LATENCY_HIST_SUB_BITS+1) << \
+     REDIS_LATENCY_HIST_SUB_BITS)
+
 /* Protocol and I/O related defines */
 #define REDIS_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
 #define REDIS_IOBUF_LEN         (1024*16)  /* Generic I/O buffer size */
 #define REDIS_REPLY_CHUNK_BYTES (16*1024) /* 16k output buffer */
+#define REDIS_REPLY_BLOCK_SIZE  (16*1024) /* Reply list block, with header. */
+#define REDIS_REPLY_BLOCK_POOL_SIZE 128   /* Free reply blocks kept around. */
+#define REDIS_REPLY_IOV_MAX     16        /* Max buffers written per writev. */
 #define REDIS_INLINE_MAX_SIZE   (1024*64) /* Max size of inline reads */
 #define REDIS_MBULK_BIG_ARG     (1024*32)
 #define REDIS_LONGSTR_SIZE      21          /* Bytes needed for long -> str */
@@ -186,6 +231,7 @@
 #define REDIS_RDB_ENC_INT16 1       /* 16 bit signed integer */
 #define REDIS_RDB_ENC_INT32 2       /* 32 bit signed integer */
 #define REDIS_RDB_ENC_LZF 3         /* string compressed with FASTLZ */
+#define REDIS_RDB_ENC_CODEC 4       /* string compressed, codec id follows */
 
 /* AOF states */
 #define REDIS_AOF_OFF 0             /* AOF is off */
@@ -212,6 +258,7 @@
 #define REDIS_FORCE_REPL (1<<15)  /* Force replication of current cmd. */
 #define REDIS_PRE_PSYNC (1<<16)   /* Instance don't understand PSYNC. */
 #define REDIS_READONLY (1<<17)    /* Cluster client is in read-only state. */
+#define REDIS_AOF_WAIT (1<<18)    /* Replies held until the AOF is fsynced. */
 
 /* Client block type (btype field in client structure)
  * if REDIS_BLOCKED flag is set. */
@@ -304,8 +351,37 @@
 #define REDIS_MAXMEMORY_ALLKEYS_LRU 3
 #define REDIS_MAXMEMORY_ALLKEYS_RANDOM 4
 #define REDIS_MAXMEMORY_NO_EVICTION 5
+#define REDIS_MAXMEMORY_VOLATILE_LFU 6
+#define REDIS_MAXMEMORY_ALLKEYS_LFU 7
 #define REDIS_DEFAULT_MAXMEMORY_POLICY REDIS_MAXMEMORY_NO_EVICTION
 
+/* True if the configured policy keeps an LFU counter in robj->lru instead
+ * of the LRU clock. */
+#define REDIS_MAXMEMORY_IS_LFU(_policy_) \
+    ((_policy_) == REDIS_MAXMEMORY_VOLATILE_LFU || \
+     (_policy_) == REDIS_MAXMEMORY_ALLKEYS_LFU)
+
+/* LFU defaults. In LFU mode the 24 bits of robj->lru are split in two:
+ *
+ *          16 bits      8 bits
+ *     +----------------+--------+
+ *     + Last decr time | LOG_C  |
+ *     +----------------+--------+
+ *
+ * The 16 bits are the time, in minutes, of the last counter decrement,
+ * the 8 bits are a logarithmic access counter. */
+#define REDIS_LFU_INIT_VAL 5
+#define REDIS_DEFAULT_LFU_LOG_FACTOR 10
+#define REDIS_DEFAULT_LFU_DECAY_TIME 1
+
+/* Lazy free. Values whose free effort (see lazyfreeGetFreeEffort()) is
+ * greater than REDIS_LAZYFREE_THRESHOLD are released by a background thread
+ * when lazy freeing is used. */
+// 释放工作量大于这个值的对象才会交给后台线程释放
+#define REDIS_LAZYFREE_THRESHOLD 64
+#define REDIS_DEFAULT_LAZYFREE_LAZY_EVICTION 0
+#define REDIS_DEFAULT_LAZYFREE_LAZY_EXPIRE 0
+
 /* Scripting */
 #define REDIS_LUA_TIME_LIMIT 5000 /* milliseconds */
 
@@ -369,6 +445,8 @@ typedef long long mstime_t; /* millisecond time type. */
 #define REDIS_LRU_BITS 24
 #define REDIS_LRU_CLOCK_MAX ((1<<REDIS_LRU_BITS)-1) /* Max value of obj->lru */
 #define REDIS_LRU_CLOCK_RESOLUTION 1000 /* LRU clock resolution in ms */
+// 共享对象的引用计数，这种对象的引用计数永远不会被修改
+#define REDIS_SHARED_REFCOUNT INT_MAX
 typedef struct redisObject {
 
     // 类型
@@ -378,7 +456,9 @@ typedef struct redisObject {
     unsigned encoding:4;
 
     // 对象最后一次被访问的时间
-    unsigned lru:REDIS_LRU_BITS; /* lru time (relative to server.lruclock) */
+    // 在 LFU 策略下保存的是访问频率计数器和衰减时间
+    unsigned lru:REDIS_LRU_BITS; /* LRU time (relative to server.lruclock) or
+                                  * LFU data (see REDIS_LFU_INIT_VAL). */
 
     // 引用计数
     int refcount;
@@ -413,15 +493,37 @@ typedef struct redisObject {
  *
  * Empty entries have the key pointer set to NULL. */
 //驱逐池
-#define REDIS_EVICTION_POOL_SIZE 16
+//
+// 驱逐池由所有数据库共享，每个项都记录了键所在的数据库。
+// 为了避免重复分配内存，每个项都带有一个预先分配的 sds 缓冲区，
+// 长度不超过 REDIS_EVICTION_POOL_CACHED_SDS_SIZE 的键名会被复制到这个缓冲区中。
+#define REDIS_EVICTION_POOL_SIZE 16     /* Default pool size. */
+#define REDIS_EVICTION_POOL_CACHED_SDS_SIZE 255
 struct evictionPoolEntry {
     unsigned long long idle;    /* Object idle time. */
     sds key;                    /* Key name. */
+    sds cached;                 /* Cached SDS object for key name. */
+    int dbid;                   /* Key DB number. */
 };
 
 /* Redis database representation. There are multiple databases identified
  * by integers from 0 (the default database) up to the max configured
  * database. The database number is the 'id' field in the structure. */
+/* An entry of the expire timer wheel. */
+typedef struct expireWheelEntry {
+    sds key;                        /* Copy of the key name. */
+    long long when;                 /* Unix time in ms the key expires. */
+    struct expireWheelEntry *next;  /* Next entry in the same slot. */
+} expireWheelEntry;
+
+/* Timer wheel indexing the keys with an expire of a DB by expire time. */
+// 按过期时间索引数据库中带过期时间的键的时间轮
+typedef struct expireWheel {
+    expireWheelEntry **slots;       /* REDIS_EXPIRE_WHEEL_SLOTS entry lists. */
+    long long tick;                 /* Next tick (ms/resolution) to visit. */
+    unsigned long entries;          /* Number of indexed entries. */
+} expireWheel;
+
 typedef struct redisDb {
 
     // 数据库键空间，保存着数据库中的所有键值对
@@ -439,7 +541,9 @@ typedef struct redisDb {
     // 正在被 WATCH 命令监视的键
     dict *watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
 
-    struct evictionPoolEntry *eviction_pool;    /* Eviction pool of keys */
+
+    // 过期时间轮，只在 active_expire_wheel 打开时创建
+    expireWheel *expire_wheel;  /* Expire index, NULL in sampled mode. */
 
     // 数据库号码
     int id;                     /* Database ID */
@@ -447,6 +551,10 @@ typedef struct redisDb {
     // 数据库的键的平均 TTL ，统计信息
     long long avg_ttl;          /* Average TTL, just for stats */
 
+    // 估计的已过期但未被删除的键的比例，以及当前的主动过期工作量等级
+    double expire_stale_ratio;  /* Estimated fraction of expired keys. */
+    int expire_effort;          /* Active expire effort level. */
+
 } redisDb;
 
 /* Client MULTI/EXEC state */
@@ -525,6 +633,18 @@ typedef struct readyList {
     robj *key;
 } readyList;
 
+/* The reply list of a client is made of fixed size blocks, taken from a
+ * global pool of free blocks. Replies are appended to the tail block as
+ * long as there is room, and the blocks are written with writev().
+ *
+ * 客户端的回复链表由固定大小的回复块组成，回复块从全局的空闲块池中分配，
+ * 回复会被追加到链表最后一个块中，直到它被填满，写入时使用 writev() 。 */
+typedef struct clientReplyBlock {
+    size_t size;            /* Usable bytes in buf. */
+    size_t used;            /* Bytes of buf filled with the reply. */
+    char buf[];
+} clientReplyBlock;
+
 /* With multiplexing we need to take per-client state.
  * Clients are taken in a liked list.
  *
@@ -552,6 +672,11 @@ typedef struct redisClient {
     // 查询缓冲区长度峰值
     size_t querybuf_peak;   /* Recent (100ms or more) peak of querybuf size */
 
+    // 当前命令在查询缓冲区开头的原始协议字节数，以及它们对应的参数数组，
+    // 命令执行之后这些字节才会被删除
+    size_t querybuf_cmdlen; /* Protocol bytes of argv at the querybuf head */
+    robj **querybuf_argv;   /* argv parsed from them, NULL if rewritten */
+
     // 参数数量
     int argc;
 
@@ -561,6 +686,9 @@ typedef struct redisClient {
     // 记录被客户端执行的命令
     struct redisCommand *cmd, *lastcmd;
 
+    // 最近一次执行的命令在命令表中的名字，用于快速查找重复的命令
+    sds lastcmd_name;           /* Name of lastcmd in the command table. */
+
     // 请求的类型：内联命令还是多条命令
     int reqtype;
 
@@ -573,8 +701,8 @@ typedef struct redisClient {
     // 回复链表
     list *reply;
 
-    // 回复链表中对象的总大小
-    unsigned long reply_bytes; /* Tot bytes of objects in reply list */
+    // 回复链表中回复块所使用的内存总量
+    unsigned long reply_bytes; /* Tot bytes of blocks in reply list */
 
     // 已发送字节，处理 short write 用
     int sentlen;            /* Amount of bytes already sent in the current
@@ -609,6 +737,9 @@ typedef struct redisClient {
 
     sds replpreamble;       /* replication DB preamble. */
 
+    // 最后一个写命令写入 AOF 之后的偏移量，在 AOF 被 fsync 到这个偏移量之前不发送回复
+    long long aof_sync_offset; /* AOF offset to fsync before replying */
+
     // 主服务器的复制偏移量
     long long reploff;      /* replication offset if this is our master */
     // 从服务器最后一次发送 REPLCONF ACK 时的偏移量
@@ -824,6 +955,17 @@ struct redisServer {
     // 关闭服务器的标识
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
 
+    // 是否使用时间轮索引来主动删除过期键
+    /* active-expire-wheel is parsed by config.c and the wheel is fed by
+     * setExpire() in db.c, neither of which is part of this tree: until
+     * they are, the option stays off. */
+    int active_expire_wheel;    /* Use the expire timer wheel? */
+    // 主动过期工作量等级的上下限
+    /* Set by active-expire-effort-min/max in config.c, which is not part
+     * of this tree: until it is, they keep their defaults. */
+    int active_expire_effort_min;   /* Lower bound of DBs expire effort. */
+    int active_expire_effort_max;   /* Upper bound of DBs expire effort. */
+
     // 在执行 serverCron() 时进行渐进式 rehash
     int activerehashing;        /* Incremental rehash in serverCron() */
 
@@ -870,6 +1012,9 @@ struct redisServer {
     // UNIX 套接字文件描述符
     int sofd;                   /* Unix socket file descriptor */
 
+    // 接受新连接的线程数量，为 0 时由主线程接受新连接
+    int accept_threads;         /* SO_REUSEPORT acceptor threads, 0 = none */
+
     int cfd[REDIS_BINDADDR_MAX];/* Cluster bus listening socket */
     int cfd_count;              /* Used slots in cfd[] */
 
@@ -981,6 +1126,8 @@ struct redisServer {
     long long ops_sec_samples[REDIS_OPS_SEC_SAMPLES];
     // 数组索引，用于保存抽样结果，并在需要时回绕到 0
     int ops_sec_idx;
+    // 事件循环本次迭代开始处理事件的时间，用于延迟直方图
+    long long el_iteration_start;   /* ustime() when the poll returned, or 0 */
 
 
     /* Configuration */
@@ -1020,6 +1167,15 @@ struct redisServer {
 
     // AOF 文件的当前字节大小
     off_t aof_current_size;         /* AOF current size. */
+    // 是否由写线程写入并 fsync AOF 文件（只在 appendfsync always 时有效）
+    /* Set by aof-group-commit in config.c, which is not part of this tree:
+     * until it is, the AOF is written by the main thread. */
+    int aof_group_commit;           /* fsync from a writer thread */
+    // 已经从 AOF 缓存中取出（写入或者交给写线程）的字节数，以及已经写入磁盘的字节数
+    long long aof_queued_offset;    /* Bytes taken from aof_buf so far */
+    long long aof_synced_offset;    /* Bytes durable on disk so far */
+    // 等待 AOF 被 fsync 才能接收回复的客户端
+    list *clients_waiting_aof;      /* Clients with REDIS_AOF_WAIT set */
     int aof_rewrite_scheduled;      /* Rewrite once BGSAVE terminates. */
 
     // 负责进行 AOF 重写的子进程 ID
@@ -1028,6 +1184,19 @@ struct redisServer {
     // AOF 重写缓存链表，链接着多个缓存块
     list *aof_rewrite_buf_blocks;   /* Hold changes during an AOF rewrite. */
 
+    // 重写期间父子进程通信所使用的管道
+    int aof_pipe_write_data_to_child;
+    int aof_pipe_read_data_from_parent;
+    int aof_pipe_write_ack_to_parent;
+    int aof_pipe_read_ack_from_child;
+    int aof_pipe_write_ack_to_child;
+    int aof_pipe_read_ack_from_parent;
+    // 子进程要求停止发送差异时为真
+    int aof_stop_sending_diff;     /* If true stop sending accumulated diffs
+                                      to child process. */
+    // 子进程中，保存从父进程接收到的差异
+    sds aof_child_diff;             /* AOF diff accumulator child side. */
+
     // AOF 缓冲区
     sds aof_buf;      /* AOF buffer, written before entering the event loop */
 
@@ -1055,6 +1224,25 @@ struct redisServer {
 
     // 指示是否需要每写入一定量的数据，就主动执行一次 fsync()
     int aof_rewrite_incremental_fsync;/* fsync incrementally while rewriting? */
+    // 重写 AOF 时是否以 RDB 格式保存数据集
+    /* Set by aof-use-rdb-preamble in config.c, which is not part of this
+     * tree: until it is, rewrites produce commands only. */
+    int aof_use_rdb_preamble;       /* Rewrite the AOF base in RDB format */
+    // 载入 AOF 时是否使用后台线程解析文件
+    int aof_load_pipeline;          /* Parse the AOF in a thread on load */
+    // 是否将 AOF 保存为基础文件加增量文件，由清单文件记录（只在启动时读取）
+    /* Set by aof-multi-part in config.c, which is not part of this tree:
+     * until it is, the AOF is a single file. */
+    int aof_multi_part;             /* Base + incremental files + manifest */
+    // 是否在 AOF 中写入时间戳注释
+    int aof_timestamp_enabled;      /* Write "#TS:<ms>" annotations */
+    // 载入 AOF 时，在这个时间（毫秒）之后的第一个注释处停止，0 表示载入全部内容
+    long long aof_load_stop_time;   /* Point in time to load the AOF up to */
+    // 最后一个时间戳注释的时间，以及最后一个索引项的时间
+    long long aof_last_timestamp;   /* Time of the last annotation */
+    long long aof_tsidx_last;       /* Time of the last index entry */
+    // 时间戳索引文件的描述符
+    int aof_tsidx_fd;               /* Timestamp index, -1 if not open */
     int aof_last_write_status;      /* REDIS_OK or REDIS_ERR */
     int aof_last_write_errno;       /* Valid if aof_last_write_status is ERR */
     /* RDB persistence */
@@ -1072,7 +1260,27 @@ struct redisServer {
     int saveparamslen;              /* Number of saving points */
     char *rdb_filename;             /* Name of RDB file */
     int rdb_compression;            /* Use compression in RDB? */
+    int rdb_compression_codec;      /* REDIS_RDB_CODEC_* used when saving. */
+    // 是否压缩整个 RDB 文件，而不只是单个字符串
+    int rdb_stream_compression;     /* Compress the whole RDB file */
     int rdb_checksum;               /* Use RDB checksum? */
+    // 载入 RDB 时用于解码对象的线程数量，小于 2 时不使用多线程
+    int rdb_load_threads;           /* Threads decoding objects on load */
+    // 保存 RDB 时用于序列化数据的线程数量，大于 1 时保存为分段 RDB
+    int rdb_save_threads;           /* Threads writing a segmented RDB */
+    // 保存 RDB 和重写 AOF 时，是否使用写线程异步写入文件，以及是否使用 O_DIRECT
+    int save_write_behind;          /* Write RDB/AOF rewrite from a thread */
+    int save_direct_io;             /* Use O_DIRECT with save_write_behind */
+    // 载入 RDB 时是否将文件映射到内存中
+    /* Set by rdb-load-mmap in config.c, which is not part of this tree:
+     * until it is, mmap() loading stays off. */
+    int rdb_load_mmap;              /* Use mmap() to read the RDB on load */
+    // BGSAVE 是否使用后台线程代替子进程
+    /* Set by rdb-forkless in config.c, which is not part of this tree:
+     * until it is, BGSAVE always forks. */
+    int rdb_forkless;               /* BGSAVE using a thread, see snapshot.c */
+    // 是否有不使用 fork 的快照正在进行
+    int rdb_snapshot_in_progress;   /* Fork-less snapshot thread running */
 
     // 最后一次完成 SAVE 的时间
     time_t lastsave;                /* Unix time of last successful save */
@@ -1093,6 +1301,9 @@ struct redisServer {
 
     /* Propagation of commands in AOF / replication */
     redisOpArray also_propagate;    /* Additional command to propagate. */
+    // 正在传播的命令的原始协议，AOF 可以直接使用它而不必重新编码
+    char *propagate_raw;            /* Original protocol of the propagated */
+    size_t propagate_raw_len;       /* command, or NULL. */
 
 
     /* Logging */
@@ -1199,7 +1410,22 @@ struct redisServer {
     unsigned long long maxmemory;   /* Max number of memory bytes to use */
     int maxmemory_policy;           /* Policy for key eviction */
     int maxmemory_samples;          /* Pricision of random sampling */
-
+    int maxmemory_pool_size;        /* Entries of the eviction pool */
+    // 所有数据库共享的驱逐池
+    struct evictionPoolEntry *eviction_pool; /* Eviction pool of keys */
+    // LFU 计数器的对数因子，以及计数器衰减的周期（分钟）
+    /* The parsing of lfu-log-factor, lfu-decay-time and of the LFU
+     * maxmemory policies belongs to config.c, which is not part of this
+     * tree: until it is, these keep their defaults and no LFU policy can
+     * be selected. */
+    int lfu_log_factor;             /* LFU logarithmic counter factor. */
+    int lfu_decay_time;             /* LFU counter decay time in minutes. */
+
+    /* Lazy free. The options are parsed by config.c, which is not part of
+     * this tree: until it is, they keep their defaults (off). */
+    // 是否在后台线程中释放被驱逐以及过期的值
+    int lazyfree_lazy_eviction;     /* Free evicted values in background. */
+    int lazyfree_lazy_expire;       /* Free expired values in background. */
 
     /* Blocked clients */
     unsigned int bpop_blocked_clients; /* Number of clients blocked by lists */
@@ -1343,8 +1569,18 @@ struct redisCommand {
     // microseconds 记录了命令执行耗费的总毫微秒数
     // calls 是命令被执行的总次数
     long long microseconds, calls;
+
+    // 命令延迟的直方图，在命令第一次被执行时创建
+    struct latencyHistogram *latency; /* NULL if never called. */
 };
 
+/* Log-linear histogram of latencies in microseconds, see latency.c. */
+typedef struct latencyHistogram {
+    long long count;            /* Number of samples. */
+    long long max;              /* Biggest sample. */
+    unsigned long long buckets[REDIS_LATENCY_HIST_BUCKETS];
+} latencyHistogram;
+
 struct redisFunctionSym {
     char *name;
     unsigned long pointer;
@@ -1481,6 +1717,8 @@ extern dictType zsetDictType;
 extern dictType clusterNodesDictType;
 extern dictType clusterNodesBlackListDictType;
 extern dictType dbDictType;
+extern dictType keyptrDictType;
+extern dictType snapshotKeysDictType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
@@ -1495,6 +1733,8 @@ long long ustime(void);
 long long mstime(void);
 void getRandomHexChars(char *p, unsigned int len);
 uint64_t crc64(uint64_t crc, const unsigned char *s, uint64_t l);
+void crc64_init(void);
+const char *crc64_impl_name(void);
 void exitFromChild(int retcode);
 size_t redisPopcount(void *s, long count);
 void redisSetProcTitle(char *title);
@@ -1513,6 +1753,8 @@ void addReplySds(redisClient *c, sds s);
 void processInputBuffer(redisClient *c);
 void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask);
+void acceptThreadsInit(void);
+void acceptThreadsCloseListeners(void);
 void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask);
 void addReplyBulk(redisClient *c, robj *obj);
 void addReplyBulkCString(redisClient *c, char *s);
@@ -1528,6 +1770,9 @@ void addReplyLongLong(redisClient *c, long long ll);
 void addReplyMultiBulkLen(redisClient *c, long length);
 void copyClientOutputBuffer(redisClient *dst, redisClient *src);
 void *dupClientReplyValue(void *o);
+void freeClientReplyValue(void *o);
+void replyBlockPoolTrim(void);
+size_t replyBlockPoolMemory(void);
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer);
 void formatPeerId(char *peerid, size_t peerid_len, char *ip, int port);
@@ -1589,6 +1834,7 @@ void flagTransaction(redisClient *c);
 void decrRefCount(robj *o);
 void decrRefCountVoid(void *o);
 void incrRefCount(robj *o);
+robj *makeObjectShared(robj *o);
 robj *resetRefCount(robj *obj);
 void freeStringObject(robj *o);
 void freeListObject(robj *o);
@@ -1625,6 +1871,11 @@ int compareStringObjects(robj *a, robj *b);
 int collateStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
 unsigned long long estimateObjectIdleTime(robj *o);
+unsigned long LFUGetTimeInMinutes(void);
+uint8_t LFULogIncr(uint8_t counter);
+unsigned long LFUDecrAndReturn(robj *o);
+void updateLFU(robj *o);
+void updateCommandKeysLFU(redisClient *c);
 #define sdsEncodedObject(objptr) (objptr->encoding == REDIS_ENCODING_RAW || objptr->encoding == REDIS_ENCODING_EMBSTR)
 
 /* Synchronous I/O with timeout */
@@ -1663,10 +1914,17 @@ void stopLoading(void);
 
 /* AOF persistence */
 void flushAppendOnlyFile(int force);
+void aofWriterDrain(void);
+long long aofBufferedOffset(void);
+int aofClientMustWait(redisClient *c);
+void aofHoldUnblockedClients(listNode *last);
 void feedAppendOnlyFile(struct redisCommand *cmd, int dictid, robj **argv, int argc);
 void aofRemoveTempFile(pid_t childpid);
+void aofClosePipes(void);
 int rewriteAppendOnlyFileBackground(void);
 int loadAppendOnlyFile(char *filename);
+int loadAppendOnlyFiles(void);
+int aofOpenCurrentFile(void);
 void stopAppendOnly(void);
 int startAppendOnly(void);
 void backgroundRewriteDoneHandler(int exitcode, int bysignal);
@@ -1709,6 +1967,7 @@ unsigned long zslGetRank(zskiplist *zsl, double score, robj *o);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
+int activeExpireCycleTryExpire(redisDb *db, dictEntry *de, long long now);
 int processCommand(redisClient *c);
 void setupSignalHandlers(void);
 struct redisCommand *lookupCommand(sds name);
@@ -1732,6 +1991,7 @@ void updateDictResizePolicy(void);
 int htNeedsResize(dict *dict);
 void oom(const char *msg);
 void populateCommandTable(void);
+void buildCommandLookupTable(void);
 void resetCommandTableStats(void);
 void adjustOpenFilesLimit(void);
 void closeListeningSockets(int unlink_unix_socket);
@@ -1814,10 +2074,48 @@ long long emptyDb(void(callback)(void*));
 int selectDb(redisClient *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
 void signalFlushedDb(int dbid);
+void slotToKeyDel(robj *key);
 unsigned int getKeysInSlot(unsigned int hashslot, robj **keys, unsigned int count);
 unsigned int countKeysInSlot(unsigned int hashslot);
 unsigned int delKeysInSlot(unsigned int hashslot);
 int verifyClusterConfigWithData(void);
+
+/* expirewheel.c -- Time-bucketed index of keys with an expire */
+expireWheel *expireWheelCreate(void);
+void expireWheelEmpty(expireWheel *w);
+void expireWheelAdd(redisDb *db, sds key, long long when);
+int expireWheelProcess(redisDb *db, long long start, long long timelimit,
+                       long long *expired);
+
+/* snapshot.c -- Fork-less RDB snapshots */
+int snapshotStart(char *filename);
+int snapshotLockKeyspace(void);
+void snapshotUnlockKeyspace(void);
+void snapshotPreserveKey(redisDb *db, robj *key);
+void snapshotBeforeCommand(redisClient *c);
+void snapshotPreserveReadyKeys(void);
+void snapshotDetachDb(redisDb *db);
+void snapshotDetachAll(void);
+void snapshotCheckDone(void);
+void snapshotAbort(void);
+
+/* latency.c -- Latency histograms */
+latencyHistogram *latencyHistogramCreate(void);
+void latencyHistogramReset(latencyHistogram *h);
+void latencyHistogramAdd(latencyHistogram *h, long long usec);
+long long latencyHistogramPercentile(latencyHistogram *h, double perc);
+void latencyAddCommandSample(struct redisCommand *cmd, long long usec);
+void latencyAddEventLoopSample(long long usec);
+void latencyResetCommand(struct redisCommand *cmd);
+void latencyResetEventLoop(void);
+sds genLatencyStatsInfoString(sds info);
+
+/* lazyfree.c -- Lazy freeing of big values */
+void lazyfreeInit(void);
+size_t lazyfreeGetFreeEffort(robj *obj);
+unsigned long long lazyfreeGetPendingObjectsCount(void);
+void freeObjAsync(robj *o);
+int dbAsyncDelete(redisDb *db, robj *key);
 void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor);
 int parseScanCursorOrReply(redisClient *c, robj *o, unsigned long *cursor);
 
@@ -2015,6 +2313,8 @@ void pfaddCommand(redisClient *c);
 void pfcountCommand(redisClient *c);
 void pfmergeCommand(redisClient *c);
 void pfdebugCommand(redisClient *c);
+void unlinkCommand(redisClient *c);
+void latencyCommand(redisClient *c);
 
 #if defined(__GNUC__)
 void *calloc(size_t count, size_t size) __attribute__ ((deprecated));
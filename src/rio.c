@@ -2,9 +2,14 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
 #include "rio.h"
 #include "util.h"
 #include "crc64.h"
+#include "endianconv.h"
 #include "config.h"
 #include "redis.h"
 
@@ -27,6 +32,7 @@ static size_t rioBufferRead(rio *r, void *buf, size_t len) {
         return 0;
     memcpy(buf, r->io.buffer.ptr+r->io.buffer.pos, len);
     //更新偏移量
+    r->io.buffer.pos += len;
     return 1;
 }
 
@@ -128,6 +134,409 @@ void rioInitWithFile(rio *r, FILE *fp) {
     r->io.file.autosync = 0;
 }
 
+/* ------------------ Write behind file descriptor implementation -------------
+ * 异步写回文件实现
+ *
+ * A write only target for big sequential files (RDB dumps and AOF rewrites).
+ * Data is accumulated into a ring of large, page aligned buffers: once a
+ * buffer is full it is handed to a writer thread that pwrite()s it to disk,
+ * so that the caller serializes the next buffer while the previous one is
+ * being written.
+ *
+ * 数据先被写入一组大的、按页对齐的缓冲区中，缓冲区写满之后交给写线程写入磁盘，
+ * 这样调用者在序列化下一个缓冲区的同时，上一个缓冲区正在被写入磁盘。
+ *
+ * On Linux the writer thread also starts the writeback of every buffer with
+ * sync_file_range() and waits for the previous ones, so that the amount of
+ * dirty pages is bounded and the final fsync() is cheap. Optionally the file
+ * can be written with O_DIRECT, bypassing the page cache entirely: only the
+ * tail of the file, that is not a multiple of the block size, is written
+ * without O_DIRECT.
+ *
+ * 在 Linux 上，写线程会使用 sync_file_range() 渐进地冲洗数据，
+ * 使得脏页的数量有上限，最后的 fsync() 也因此很快完成。
+ * 还可以选择使用 O_DIRECT 绕过页缓存。 */
+
+struct rioWriteBehind {
+    int fd;
+    int orig_flags;         /* File status flags to restore on release. */
+    int direct;             /* Buffers are written with O_DIRECT. */
+    char *raw[RIO_WB_BUFFERS];  /* Allocations, as returned by zmalloc(). */
+    char *buf[RIO_WB_BUFFERS];  /* Aligned buffers inside 'raw'. */
+    size_t used[RIO_WB_BUFFERS];
+    int fill;               /* Buffer currently filled by the caller. */
+    int head;               /* Next buffer to write for the writer thread. */
+    int pending;            /* Buffers queued for the writer thread. */
+    off_t pos;              /* Logical offset: bytes accepted so far. */
+    off_t written;          /* Offset the writer thread will write next. */
+    off_t synced;           /* Writeback completed up to this offset. */
+    int error;              /* First write error (errno value), sticky. */
+    int stop;               /* Set to terminate the writer thread. */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* Signaled when a buffer is queued. */
+    pthread_cond_t done;    /* Signaled when a buffer is written. */
+};
+
+// 将len字节完整地写入文件的offset处，处理短写入的情况
+static int rioWriteBehindPwrite(int fd, const char *p, size_t len, off_t offset) {
+    while (len) {
+        ssize_t nwritten = pwrite(fd,p,len,offset);
+        if (nwritten == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (nwritten == 0) {
+            errno = EIO;
+            return -1;
+        }
+        p += nwritten;
+        offset += nwritten;
+        len -= nwritten;
+    }
+    return 0;
+}
+
+/* Write one buffer at the current offset. Called by the writer thread
+ * without holding the lock: the buffer belongs to the thread until
+ * 'pending' is decremented. */
+// 写入一个缓冲区，由写线程在不持有锁的情况下调用
+static int rioWriteBehindWriteBuffer(struct rioWriteBehind *wb, int idx) {
+    char *p = wb->buf[idx];
+    size_t len = wb->used[idx];
+
+    if (wb->direct && (len % RIO_WB_ALIGN) != 0) {
+        size_t aligned = len - (len % RIO_WB_ALIGN);
+
+        /* Only whole blocks can be written with O_DIRECT. The tail is
+         * written through the page cache, and since the following writes
+         * would be unaligned, O_DIRECT is not used anymore. */
+        // O_DIRECT 只能写入完整的块，剩余部分通过页缓存写入
+        if (aligned) {
+            if (rioWriteBehindPwrite(wb->fd,p,aligned,wb->written) == -1)
+                return -1;
+            wb->written += aligned;
+            p += aligned;
+            len -= aligned;
+        }
+        if (fcntl(wb->fd,F_SETFL,wb->orig_flags) == -1) return -1;
+        wb->direct = 0;
+    }
+    if (rioWriteBehindPwrite(wb->fd,p,len,wb->written) == -1) return -1;
+
+#ifdef HAVE_SYNC_FILE_RANGE
+    /* Start the writeback of this buffer, and wait for the writeback of
+     * the previous ones, so that at most a buffer worth of dirty pages
+     * is ever accumulated by this file. */
+    // 开始写回这个缓冲区的数据，并等待之前的数据写回完成
+    if (!wb->direct) {
+        if (wb->written > wb->synced &&
+            sync_file_range(wb->fd,wb->synced,wb->written-wb->synced,
+                SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WRITE|
+                SYNC_FILE_RANGE_WAIT_AFTER) == 0)
+        {
+            wb->synced = wb->written;
+        }
+        sync_file_range(wb->fd,wb->written,len,SYNC_FILE_RANGE_WRITE);
+    }
+#endif
+    wb->written += len;
+    return 0;
+}
+
+// 写线程的主函数
+static void *rioWriteBehindThreadMain(void *arg) {
+    struct rioWriteBehind *wb = arg;
+    sigset_t sigset;
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    pthread_mutex_lock(&wb->lock);
+    while(1) {
+        int idx, failed, retval;
+
+        if (wb->pending == 0) {
+            if (wb->stop) break;
+            pthread_cond_wait(&wb->work,&wb->lock);
+            continue;
+        }
+        idx = wb->head;
+        failed = wb->error;
+        pthread_mutex_unlock(&wb->lock);
+
+        // 出错之后不再写入，只是丢弃缓冲区
+        retval = failed ? 0 : rioWriteBehindWriteBuffer(wb,idx);
+
+        pthread_mutex_lock(&wb->lock);
+        if (retval == -1 && !wb->error) wb->error = errno ? errno : EIO;
+        wb->used[idx] = 0;
+        wb->head = (wb->head+1) % RIO_WB_BUFFERS;
+        wb->pending--;
+        pthread_cond_signal(&wb->done);
+    }
+    pthread_mutex_unlock(&wb->lock);
+    return NULL;
+}
+
+/* Queue the buffer being filled for the writer thread, and wait until the
+ * next one is free. Returns 0 if a write error was already reported by the
+ * writer thread, 1 otherwise. */
+// 将正在填充的缓冲区交给写线程，并等待下一个缓冲区可用
+static int rioWriteBehindSubmit(struct rioWriteBehind *wb) {
+    int ok;
+
+    pthread_mutex_lock(&wb->lock);
+    if (wb->used[wb->fill]) {
+        wb->pending++;
+        wb->fill = (wb->fill+1) % RIO_WB_BUFFERS;
+        pthread_cond_signal(&wb->work);
+    }
+    while (wb->pending == RIO_WB_BUFFERS)
+        pthread_cond_wait(&wb->done,&wb->lock);
+    ok = (wb->error == 0);
+    if (!ok) errno = wb->error;
+    pthread_mutex_unlock(&wb->lock);
+    return ok;
+}
+
+// 将buf中长度为len的内容复制到缓冲区中，缓冲区满时交给写线程
+static size_t rioWriteBehindWrite(rio *r, const void *buf, size_t len) {
+    struct rioWriteBehind *wb = r->io.wbfile.state;
+    const char *p = buf;
+
+    while (len) {
+        size_t avail = RIO_WB_BUFSIZE - wb->used[wb->fill];
+        size_t count = len < avail ? len : avail;
+
+        memcpy(wb->buf[wb->fill]+wb->used[wb->fill],p,count);
+        wb->used[wb->fill] += count;
+        wb->pos += count;
+        p += count;
+        len -= count;
+        if (wb->used[wb->fill] == RIO_WB_BUFSIZE &&
+            rioWriteBehindSubmit(wb) == 0) return 0;
+    }
+    return 1;
+}
+
+// 只写对象，不支持读操作
+static size_t rioWriteBehindRead(rio *r, void *buf, size_t len) {
+    REDIS_NOTUSED(r);
+    REDIS_NOTUSED(buf);
+    REDIS_NOTUSED(len);
+    return 0; /* Error, this target does not support reading. */
+}
+
+// 返回逻辑偏移量，包括还在缓冲区中没有写入的数据
+static off_t rioWriteBehindTell(rio *r) {
+    return r->io.wbfile.state->pos;
+}
+
+/* Queue the partially filled buffer and wait for the writer thread to
+ * write everything to the file. Returns 1 on success, 0 if any write
+ * failed, in which case errno is set. */
+// 将所有数据写入文件，等待写线程完成，成功返回1，失败返回0
+static int rioWriteBehindFlush(rio *r) {
+    struct rioWriteBehind *wb = r->io.wbfile.state;
+    int ok;
+
+    if (rioWriteBehindSubmit(wb) == 0) return 0;
+    pthread_mutex_lock(&wb->lock);
+    while (wb->pending) pthread_cond_wait(&wb->done,&wb->lock);
+    ok = (wb->error == 0);
+    if (!ok) errno = wb->error;
+    pthread_mutex_unlock(&wb->lock);
+    return ok;
+}
+
+// 根据上面的方法定义的异步写回文件rio对象
+static const rio rioWriteBehindIO = {
+    rioWriteBehindRead,
+    rioWriteBehindWrite,
+    rioWriteBehindTell,
+    rioWriteBehindFlush,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
+/* Initialize a write behind rio writing to 'fd' starting at its current
+ * offset. If 'direct' is true O_DIRECT is used when the file system allows
+ * it. The caller must not use the file descriptor until rioFreeWriteBehind()
+ * is called, and should call rioFlush() before it to check for errors.
+ *
+ * Returns REDIS_ERR if the writer thread can't be created.
+ *
+ * 初始化异步写回rio对象，从fd的当前偏移量开始写入。
+ * direct为真时，在文件系统允许的情况下使用O_DIRECT。 */
+int rioInitWithWriteBehind(rio *r, int fd, int direct) {
+    struct rioWriteBehind *wb = zcalloc(sizeof(*wb));
+    off_t offset = lseek(fd,0,SEEK_CUR);
+    int j;
+
+    wb->fd = fd;
+    wb->orig_flags = fcntl(fd,F_GETFL);
+    wb->written = wb->synced = (offset == -1) ? 0 : offset;
+    for (j = 0; j < RIO_WB_BUFFERS; j++) {
+        uintptr_t p;
+
+        wb->raw[j] = zmalloc(RIO_WB_BUFSIZE+RIO_WB_ALIGN);
+        p = (uintptr_t) wb->raw[j];
+        wb->buf[j] = (char*) ((p+RIO_WB_ALIGN-1) & ~((uintptr_t)RIO_WB_ALIGN-1));
+    }
+
+#ifdef O_DIRECT
+    /* O_DIRECT needs the file offset to be aligned as well. If the file
+     * system refuses it we just go through the page cache. */
+    if (direct && wb->orig_flags != -1 && (wb->written % RIO_WB_ALIGN) == 0 &&
+        fcntl(fd,F_SETFL,wb->orig_flags|O_DIRECT) != -1)
+    {
+        wb->direct = 1;
+    }
+#else
+    REDIS_NOTUSED(direct);
+#endif
+
+    pthread_mutex_init(&wb->lock,NULL);
+    pthread_cond_init(&wb->work,NULL);
+    pthread_cond_init(&wb->done,NULL);
+
+    *r = rioWriteBehindIO;
+    r->io.wbfile.state = wb;
+    if (pthread_create(&wb->thread,NULL,rioWriteBehindThreadMain,wb) != 0) {
+        wb->stop = 1;
+        wb->thread = pthread_self();
+        rioFreeWriteBehind(r);
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/* Stop the writer thread and release the buffers. Data not yet flushed
+ * with rioFlush() is discarded. The file offset is moved after the last
+ * byte written, and O_DIRECT is cleared, so the descriptor can be used
+ * again (to fsync and close it) by the caller. Calling this function more
+ * than once is safe. */
+// 停止写线程并释放缓冲区，可以安全地多次调用
+void rioFreeWriteBehind(rio *r) {
+    struct rioWriteBehind *wb = r->io.wbfile.state;
+    int j;
+
+    if (wb == NULL) return;
+    pthread_mutex_lock(&wb->lock);
+    if (!wb->stop) {
+        /* Let the thread drop whatever is still queued. */
+        if (!wb->error) wb->error = ECANCELED;
+        wb->stop = 1;
+        pthread_cond_signal(&wb->work);
+        pthread_mutex_unlock(&wb->lock);
+        pthread_join(wb->thread,NULL);
+    } else {
+        pthread_mutex_unlock(&wb->lock);
+    }
+    if (wb->orig_flags != -1) fcntl(wb->fd,F_SETFL,wb->orig_flags);
+    lseek(wb->fd,wb->written,SEEK_SET);
+
+    pthread_mutex_destroy(&wb->lock);
+    pthread_cond_destroy(&wb->work);
+    pthread_cond_destroy(&wb->done);
+    for (j = 0; j < RIO_WB_BUFFERS; j++) zfree(wb->raw[j]);
+    zfree(wb);
+    r->io.wbfile.state = NULL;
+}
+
+/* ----------------------- Memory mapped file implementation ------------------
+ * 内存映射文件实现
+ *
+ * A read only target reading from a file mapped in memory with mmap(). It
+ * avoids the stdio buffering layer and, using rioReadInPlace(), allows the
+ * callers to copy data straight from the mapped pages to its final
+ * destination. */
+
+// 从映射的内存中读取长度为len的内容到buf中
+static size_t rioMmapRead(rio *r, void *buf, size_t len) {
+    if (r->io.map.len - r->io.map.pos < len) return 0;
+    memcpy(buf,r->io.map.base+r->io.map.pos,len);
+    r->io.map.pos += len;
+    return 1;
+}
+
+// 内存映射对象只读，不支持写操作
+static size_t rioMmapWrite(rio *r, const void *buf, size_t len) {
+    REDIS_NOTUSED(r);
+    REDIS_NOTUSED(buf);
+    REDIS_NOTUSED(len);
+    return 0; /* Error, this target does not support writing. */
+}
+
+// 返回读取偏移量
+static off_t rioMmapTell(rio *r) {
+    return r->io.map.pos;
+}
+
+static int rioMmapFlush(rio *r) {
+    REDIS_NOTUSED(r);
+    return 1;
+}
+
+// 根据上面的方法定义的流为内存映射文件时使用的rio对象
+static const rio rioMmapIO = {
+    rioMmapRead,
+    rioMmapWrite,
+    rioMmapTell,
+    rioMmapFlush,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
+// 初始化内存映射rio对象，base和len为mmap()映射的区域
+void rioInitWithMmap(rio *r, const void *base, size_t len) {
+    *r = rioMmapIO;
+    r->io.map.base = base;
+    r->io.map.len = len;
+    r->io.map.pos = 0;
+}
+
+// 检查r是否为内存映射rio对象
+int rioIsMmap(rio *r) {
+    return r->read == rioMmapIO.read;
+}
+
+/* Consume 'len' bytes from a memory mapped rio, returning a pointer to them
+ * inside the mapping instead of copying them. The checksum and the
+ * processed bytes are updated exactly like rioRead() would do.
+ *
+ * NULL is returned if the target is not memory mapped or if there are not
+ * enough bytes left: in the first case the caller should use rioRead().
+ *
+ * 从内存映射rio对象中读取len字节，返回指向映射内存的指针，而不是复制数据。 */
+const void *rioReadInPlace(rio *r, size_t len) {
+    const char *p, *cur;
+
+    if (!rioIsMmap(r) || r->io.map.len - r->io.map.pos < len) return NULL;
+    p = cur = r->io.map.base+r->io.map.pos;
+    r->io.map.pos += len;
+    while (len) {
+        size_t chunk = (r->max_processing_chunk &&
+                        r->max_processing_chunk < len) ?
+                        r->max_processing_chunk : len;
+        if (r->update_cksum) r->update_cksum(r,cur,chunk);
+        cur += chunk;
+        len -= chunk;
+        r->processed_bytes += chunk;
+    }
+    return p;
+}
+
 /* ------------------- File descriptors set implementation ------------------- */
 /* 文件描述符集合实现，用于控制多个文件描述符 */
 
@@ -210,7 +619,6 @@ static size_t rioFdsetWrite(rio *r, const void *buf, size_t len) {
     return 1;
 }
 
-=
 // fd set对象不支持读操作，直接报错
 static size_t rioFdsetRead(rio *r, void *buf, size_t len) {
     REDIS_NOTUSED(r);
@@ -267,10 +675,270 @@ void rioFreeFdset(rio *r) {
     sdsfree(r->io.fdset.buf);
 }
 
+/* ----------------------------- Layered implementation -----------------------
+ * 分层实现
+ *
+ * A layer is a rio that transforms the data and reads or writes the result
+ * from/to another rio (the next layer), so that transforms can be stacked on
+ * top of any backend without changes in the code producing or consuming
+ * the data. Data is processed in blocks of at most RIO_LAYER_BLOCK_SIZE
+ * bytes. Two layers are implemented:
+ *
+ * 分层rio对数据进行转换，然后从另一个rio（下一层）读入或者写入转换后的数据，
+ * 这样转换可以叠加在任何后端之上，而不需要修改生成或者使用数据的代码。
+ *
+ * Framing: every block is written as a frame with its length and a CRC64
+ * of the payload, so that the stream is self delimiting and corruption is
+ * detected as soon as the damaged frame is read:
+ *
+ *   [len:4][payload:len][crc64:8]
+ *
+ * 分帧层：每个块被写成一个带有长度和 CRC64 校验和的帧。
+ *
+ * Compression: every block is compressed with one of the codecs of rdb.c,
+ * blocks that don't compress are stored as they are:
+ *
+ *   [codec:1][rawlen:4][storedlen:4][data:storedlen]
+ *
+ * 压缩层：每个块使用 rdb.c 中的压缩算法进行压缩，无法压缩的块按原样保存。
+ *
+ * Both formats end with a block of length zero, written by rioFinishLayer().
+ * All integers are little endian. */
+
+struct rioLayer {
+    int type;           /* RIO_LAYER_FRAMING or RIO_LAYER_COMPRESSION */
+    int codec;          /* Compression codec used when writing. */
+    int finished;       /* End of stream written (or read). */
+    char *block;        /* Uncompressed data of the current block. */
+    size_t len;         /* Bytes in 'block'. */
+    size_t pos;         /* Reading: bytes of 'block' already consumed. */
+    char *scratch;      /* Compressed data of the current block. */
+    off_t offset;       /* Logical offset, for rioTell(). */
+};
+
+// 将长度为len的当前块写入下一层，len为0时写入流结束标记
+static int rioLayerEmit(rio *r) {
+    struct rioLayer *l = r->io.layer.state;
+    rio *next = r->io.layer.next;
+    uint32_t len = l->len;
+
+    memrev32ifbe(&len);
+    if (l->type == RIO_LAYER_FRAMING) {
+        uint64_t crc = crc64(0,(unsigned char*)l->block,l->len);
+
+        memrev64ifbe(&crc);
+        if (rioWrite(next,&len,4) == 0) return 0;
+        if (l->len == 0) return 1;
+        if (rioWrite(next,l->block,l->len) == 0) return 0;
+        if (rioWrite(next,&crc,8) == 0) return 0;
+    } else {
+        rdbCodec *c = rdbGetCodec(l->codec);
+        unsigned char codec = l->codec;
+        size_t stored = 0;
+        uint32_t storedlen;
+        char *data = l->scratch;
+
+        // 压缩失败或者压缩后没有变小时，直接保存原始数据
+        if (c && l->len > 4)
+            stored = c->compress(l->block,l->len,l->scratch,l->len-1);
+        if (stored == 0) {
+            codec = RIO_LAYER_RAW;
+            stored = l->len;
+            data = l->block;
+        }
+        storedlen = stored;
+        memrev32ifbe(&storedlen);
+        if (rioWrite(next,&codec,1) == 0) return 0;
+        if (rioWrite(next,&len,4) == 0) return 0;
+        if (rioWrite(next,&storedlen,4) == 0) return 0;
+        if (stored && rioWrite(next,data,stored) == 0) return 0;
+    }
+    l->len = 0;
+    return 1;
+}
+
+/* Read the next block from the next layer. Returns 0 on errors, corrupted
+ * blocks and at the end of the stream. */
+// 从下一层读入下一个块，出错、块损坏或者流结束时返回0
+static int rioLayerFill(rio *r) {
+    struct rioLayer *l = r->io.layer.state;
+    rio *next = r->io.layer.next;
+    uint32_t len;
+
+    l->len = l->pos = 0;
+    if (l->finished) return 0;
+    if (l->type == RIO_LAYER_FRAMING) {
+        uint64_t crc;
+
+        if (rioRead(next,&len,4) == 0) return 0;
+        memrev32ifbe(&len);
+        if (len == 0) {
+            l->finished = 1;
+            return 0;
+        }
+        if (len > RIO_LAYER_BLOCK_SIZE) return 0;
+        if (rioRead(next,l->block,len) == 0) return 0;
+        if (rioRead(next,&crc,8) == 0) return 0;
+        memrev64ifbe(&crc);
+        if (crc != crc64(0,(unsigned char*)l->block,len)) return 0;
+    } else {
+        unsigned char codec;
+        uint32_t storedlen;
+        rdbCodec *c;
+
+        if (rioRead(next,&codec,1) == 0) return 0;
+        if (rioRead(next,&len,4) == 0) return 0;
+        if (rioRead(next,&storedlen,4) == 0) return 0;
+        memrev32ifbe(&len);
+        memrev32ifbe(&storedlen);
+        if (len == 0) {
+            l->finished = 1;
+            return 0;
+        }
+        if (len > RIO_LAYER_BLOCK_SIZE || storedlen > RIO_LAYER_BLOCK_SIZE)
+            return 0;
+        if (codec == RIO_LAYER_RAW) {
+            if (storedlen != len) return 0;
+            if (rioRead(next,l->block,len) == 0) return 0;
+        } else {
+            if ((c = rdbGetCodec(codec)) == NULL) return 0;
+            if (rioRead(next,l->scratch,storedlen) == 0) return 0;
+            if (c->decompress(l->scratch,storedlen,l->block,len) != len)
+                return 0;
+        }
+    }
+    l->len = len;
+    return 1;
+}
+
+// 将buf中的内容追加到当前块中，块满时将它写入下一层
+static size_t rioLayerWrite(rio *r, const void *buf, size_t len) {
+    struct rioLayer *l = r->io.layer.state;
+    const char *p = buf;
+
+    while (len) {
+        size_t count = RIO_LAYER_BLOCK_SIZE - l->len;
+
+        if (count > len) count = len;
+        memcpy(l->block+l->len,p,count);
+        l->len += count;
+        l->offset += count;
+        p += count;
+        len -= count;
+        if (l->len == RIO_LAYER_BLOCK_SIZE && rioLayerEmit(r) == 0) return 0;
+    }
+    return 1;
+}
+
+// 从当前块中读取len字节，块用完时从下一层读入新的块
+static size_t rioLayerRead(rio *r, void *buf, size_t len) {
+    struct rioLayer *l = r->io.layer.state;
+    char *p = buf;
+
+    while (len) {
+        size_t count;
+
+        if (l->pos == l->len && rioLayerFill(r) == 0) return 0;
+        count = l->len - l->pos;
+        if (count > len) count = len;
+        memcpy(p,l->block+l->pos,count);
+        l->pos += count;
+        l->offset += count;
+        p += count;
+        len -= count;
+    }
+    return 1;
+}
+
+// 返回逻辑偏移量，也就是转换之前的数据的偏移量
+static off_t rioLayerTell(rio *r) {
+    return r->io.layer.state->offset;
+}
+
+// 将不完整的当前块写入下一层，并冲洗下一层
+static int rioLayerFlush(rio *r) {
+    struct rioLayer *l = r->io.layer.state;
+
+    if (l->len && rioLayerEmit(r) == 0) return 0;
+    return rioFlush(r->io.layer.next);
+}
+
+// 根据上面的方法定义的分层rio对象
+static const rio rioLayerIO = {
+    rioLayerRead,
+    rioLayerWrite,
+    rioLayerTell,
+    rioLayerFlush,
+    NULL,           /* update_checksum */
+    0,              /* current checksum */
+    0,              /* bytes read or written */
+    0,              /* read/write chunk size */
+    { { NULL, 0 } } /* union for io-specific vars */
+};
+
+static void rioInitLayer(rio *r, rio *next, int type, int codec) {
+    struct rioLayer *l = zcalloc(sizeof(*l));
+
+    l->type = type;
+    l->codec = codec;
+    l->block = zmalloc(RIO_LAYER_BLOCK_SIZE);
+    if (type == RIO_LAYER_COMPRESSION)
+        l->scratch = zmalloc(RIO_LAYER_BLOCK_SIZE);
+    *r = rioLayerIO;
+    r->io.layer.next = next;
+    r->io.layer.state = l;
+}
+
+/* Initialize 'r' as a framing layer on top of 'next'. */
+// 在next之上初始化一个分帧层
+void rioInitWithFraming(rio *r, rio *next) {
+    rioInitLayer(r,next,RIO_LAYER_FRAMING,0);
+}
+
+/* Initialize 'r' as a block compression layer on top of 'next'. When
+ * writing, blocks are compressed with the REDIS_RDB_CODEC_* 'codec' (LZF
+ * if it is not compiled in). When reading, the codec is the one recorded
+ * in every block. */
+// 在next之上初始化一个压缩层，写入时使用codec压缩
+void rioInitWithCompression(rio *r, rio *next, int codec) {
+    if (rdbGetCodec(codec) == NULL) codec = REDIS_RDB_CODEC_LZF;
+    rioInitLayer(r,next,RIO_LAYER_COMPRESSION,codec);
+}
+
+// 检查r是否为分层rio对象
+int rioIsLayer(rio *r) {
+    return r->read == rioLayerIO.read;
+}
+
+/* Write the last block and the end of stream marker to the next layer.
+ * Must be called once, by writers, after the last write. Returns 1 on
+ * success, 0 on write errors. The next layer is not flushed.
+ *
+ * 写入最后一个块以及流结束标记，成功返回1，失败返回0。 */
+int rioFinishLayer(rio *r) {
+    struct rioLayer *l = r->io.layer.state;
+
+    if (l->len && rioLayerEmit(r) == 0) return 0;
+    if (rioLayerEmit(r) == 0) return 0; /* Zero length block. */
+    l->finished = 1;
+    return 1;
+}
+
+/* Release a layer. The next layer is not touched. */
+// 释放分层rio对象，不会释放下一层
+void rioFreeLayer(rio *r) {
+    struct rioLayer *l = r->io.layer.state;
+
+    zfree(l->block);
+    zfree(l->scratch);
+    zfree(l);
+    r->io.layer.state = NULL;
+}
+
 /* ---------------------------- Generic functions ---------------------------- */
 
 // 计算文件校验和
-void rioGenericUpdatechecksum(rio *r, const void *buf, size_t len) {
+void rioGenericUpdateChecksum(rio *r, const void *buf, size_t len) {
     r->cksum = crc64(r->cksum,buf,len);
 }
 
@@ -5,12 +5,31 @@
 #include <stdint.h>
 #include "sds.h"
 
+/* Write behind target: number and size of the buffers handed to the writer
+ * thread, and the alignment required by O_DIRECT. */
+// 异步写回对象的缓冲区数量、大小，以及 O_DIRECT 要求的对齐大小
+#define RIO_WB_BUFFERS 4
+#define RIO_WB_BUFSIZE (1024*1024*4)
+#define RIO_WB_ALIGN 4096
+
+/* Layers: block size, layer types, and codec id of blocks stored without
+ * compression by the compression layer. */
+// 分层rio对象的块大小、层的类型，以及压缩层中没有被压缩的块的算法 id
+#define RIO_LAYER_BLOCK_SIZE (1024*256)
+#define RIO_LAYER_FRAMING 0
+#define RIO_LAYER_COMPRESSION 1
+#define RIO_LAYER_RAW 255
+
+struct rioWriteBehind;
+struct rioLayer;
+
 //RIO API接口和状态
 struct _rio {
     //API
     size_t (*read)(struct _rio *, void *buf, size_t len);
     size_t (*write)(struct _rio *, const void *buf, size_t len);
     off_t (*tell)(struct _rio *);
+    int (*flush)(struct _rio *);
 
     //检验和计算函数，每次有写入/读取新数据时都要计算一次
     void (*update_cksum)(struct _rio *, const void *buf, size_t len);
@@ -41,6 +60,40 @@ struct _rio {
             //写入多少字节以后，才会自动执行一次fsync
             off_t autosync;
         } file;
+
+        struct {
+            //文件描述符数组
+            int *fds;
+            //每个文件描述符的错误状态
+            int *state;
+            //文件描述符的数量
+            int numfds;
+            //偏移量
+            off_t pos;
+            //写入缓冲区
+            sds buf;
+        } fdset;
+
+        struct {
+            //异步写回状态，由写线程共享
+            struct rioWriteBehind *state;
+        } wbfile;
+
+        struct {
+            //下一层rio对象
+            struct _rio *next;
+            //层的状态
+            struct rioLayer *state;
+        } layer;
+
+        struct {
+            //被映射到内存的文件内容
+            const char *base;
+            //映射的长度
+            size_t len;
+            //读取偏移量
+            off_t pos;
+        } map;
     } io;
 
 };
@@ -86,8 +139,25 @@ static inline off_t rioTell(rio *r) {
     return r->tell(r);
 }
 
+//冲洗r中的缓存数据
+static inline int rioFlush(rio *r) {
+    return r->flush(r);
+}
+
 void rioInitWithFile(rio *r, FILE *fp);
 void rioInitWithBuffer(rio *r, sds s);
+void rioInitWithFdset(rio *r, int *fds, int numfds);
+void rioFreeFdset(rio *r);
+int rioInitWithWriteBehind(rio *r, int fd, int direct);
+void rioFreeWriteBehind(rio *r);
+void rioInitWithFraming(rio *r, rio *next);
+void rioInitWithCompression(rio *r, rio *next, int codec);
+int rioIsLayer(rio *r);
+int rioFinishLayer(rio *r);
+void rioFreeLayer(rio *r);
+void rioInitWithMmap(rio *r, const void *base, size_t len);
+int rioIsMmap(rio *r);
+const void *rioReadInPlace(rio *r, size_t len);
 
 size_t rioWriteBulkCount(rio *r, char prefix, int count);
 size_t rioWriteBulkString(rio *r, const char *buf, size_t len);
@@ -0,0 +1,695 @@
+/* Fork-less point-in-time RDB snapshots.
+ *
+ * 不使用 fork() 的时间点 RDB 快照。
+ *
+ * rdbSaveBackground() normally forks a child that saves the copy of the
+ * dataset it inherits from the parent. With big instances the fork itself
+ * blocks the server while the page tables are copied, and copy-on-write may
+ * double the memory usage when the write load is high.
+ *
+ * 通常 rdbSaveBackground() 会 fork 一个子进程来保存数据集。
+ * 对于很大的实例，fork 本身会因为复制页表而阻塞服务器，
+ * 写入负载很高时，写时复制还可能让内存占用翻倍。
+ *
+ * When server.rdb_forkless is true the snapshot is instead produced by a
+ * thread of the Redis process, that walks the buckets of every DB hash
+ * table in order while the main thread keeps serving clients:
+ *
+ * 当 server.rdb_forkless 为真时，快照由一个后台线程生成，
+ * 这个线程按顺序遍历每个数据库哈希表的所有桶，同时主线程继续为客户端服务：
+ *
+ * 1) Incremental rehashing of the DB dictionaries is suspended for the
+ *    whole snapshot, so that every key keeps its bucket and the thread
+ *    cursor (db, table, bucket) tells exactly which keys were saved.
+ *
+ *    快照期间暂停数据库字典的渐进式 rehash ，
+ *    这样每个键都停留在原来的桶中，
+ *    线程的游标（数据库、哈希表、桶）可以准确地说明哪些键已经被保存了。
+ *
+ * 2) The keyspace is protected by a mutex: the thread takes it to serialize
+ *    a small batch of buckets, the main thread takes it while executing a
+ *    command or deleting keys from the crons.
+ *
+ *    键空间由一个互斥锁保护：后台线程在序列化一小批桶时持有它，
+ *    主线程在执行命令，或者在定时任务中删除键时持有它。
+ *
+ * 3) Before a command touches a key not yet visited by the thread, the
+ *    current value of the key is serialized into a per DB "pre-image"
+ *    buffer, and the key is added to a per DB skip set so that the thread
+ *    will ignore it. Keys created after the snapshot started end in the
+ *    skip set as well.
+ *
+ *    在命令修改一个后台线程尚未访问的键之前，
+ *    键的当前值会被序列化到数据库的“前像”缓冲区中，
+ *    并且键会被添加到跳过集合里，让后台线程忽略它。
+ *    快照开始之后才创建的键也会被添加到跳过集合里。
+ *
+ * The pre-image buffers are appended by the thread to the section of the
+ * file of their DB, so the result is a normal RDB file with the content the
+ * dataset had when the snapshot started.
+ *
+ * 后台线程会将前像缓冲区写入到对应数据库的部分中，
+ * 所以最终得到的是一个普通的 RDB 文件，
+ * 它的内容就是快照开始时的数据集。
+ *
+ * Commands that empty whole DBs (FLUSHALL, FLUSHDB) detach the hash tables
+ * of the DBs the thread did not finish yet: the DB gets new empty tables,
+ * and the old ones are only read by the thread and released when the
+ * snapshot ends, so the flush does not need to serialize anything.
+ * DEBUG RELOAD and DEBUG LOADAOF are handled the same way. Code emptying
+ * the keyspace outside of call(), like the replication full sync before
+ * calling emptyDb(), must call snapshotDetachAll() first, with the keyspace
+ * lock held.
+ *
+ * 清空整个数据库的命令（FLUSHALL 、 FLUSHDB）会将后台线程尚未完成的数据库的
+ * 哈希表分离出来：数据库换上新的空哈希表，旧的哈希表只由后台线程读取，
+ * 并在快照结束时释放，所以清空数据库时不需要序列化任何数据。 */
+
+#include "redis.h"
+#include "endianconv.h"
+
+#include <pthread.h>
+
+// 后台线程的栈大小，和 bio.h 中的 REDIS_THREAD_STACK_SIZE 相同
+#define SNAPSHOT_THREAD_STACK_SIZE (1024*1024*4)
+
+/* Max number of buckets, and of serialized bytes, produced by the thread
+ * every time it takes the keyspace lock. Small values mean less latency
+ * for the main thread. The byte limit is checked after every key, so a
+ * single big value is still serialized in one go. */
+#define SNAPSHOT_BATCH_BUCKETS 128
+#define SNAPSHOT_BATCH_BYTES (64*1024)
+
+static struct {
+    pthread_t thread;
+    int lock_depth;             /* Nesting of snapshotLockKeyspace() calls. */
+    char tmpfile[256];          /* File written by the thread. */
+    sds filename;               /* Final name of the RDB file. */
+    FILE *fp;
+    long long now;              /* Snapshot time, used to skip expired keys. */
+    int paused;                 /* True if rehashing is suspended. */
+    dict **dicts;               /* DB dicts, NULL if empty at start. */
+    dict **expires;             /* DB expires, NULL if empty at start. */
+    int *detached;              /* True if dicts[j] was detached from DB j. */
+    unsigned long *dbsize;      /* Keys of every DB at start. */
+    unsigned long *expsize;     /* Keys with an expire at start. */
+    dict **skip;                /* Keys the thread must not save. */
+    sds *preimage;              /* Serialized old versions of the keys. */
+    int cur_db;                 /* Thread cursor: buckets before */
+    int cur_table;              /* (cur_db,cur_table,cur_idx) were */
+    unsigned long cur_idx;      /* already visited. */
+    long long preimage_keys;    /* Keys serialized by the main thread. */
+    int done;                   /* Set by the thread when it exits. */
+    int abort;                  /* Set by the main thread to stop it. */
+    int status;                 /* REDIS_OK or REDIS_ERR, valid if done. */
+} snapshot;
+
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void *snapshotThreadMain(void *arg);
+
+/* ------------------------------ Keyspace lock ---------------------------- */
+
+/* Take the keyspace lock if a snapshot is in progress. Calls can be nested,
+ * only the outermost one actually locks the mutex.
+ *
+ * 如果有快照正在进行，那么获取键空间锁，可以嵌套调用。
+ *
+ * Returns 1 if the caller must call snapshotUnlockKeyspace() later. */
+int snapshotLockKeyspace(void) {
+    if (!server.rdb_snapshot_in_progress) return 0;
+    if (snapshot.lock_depth++ == 0) pthread_mutex_lock(&snapshot_mutex);
+    return 1;
+}
+
+// 释放键空间锁
+void snapshotUnlockKeyspace(void) {
+    if (--snapshot.lock_depth == 0) pthread_mutex_unlock(&snapshot_mutex);
+}
+
+/* -------------------------------- Cursor --------------------------------- */
+
+/* Suspend / resume incremental rehashing of the DB dictionaries. A dict
+ * with iterators > 0 never performs rehashing steps. */
+static void snapshotPauseRehashing(int pause) {
+    int j;
+
+    if (snapshot.paused == pause) return;
+    for (j = 0; j < server.dbnum; j++) {
+        if (snapshot.dicts[j] == NULL) continue;
+        snapshot.dicts[j]->iterators += pause ? 1 : -1;
+        snapshot.expires[j]->iterators += pause ? 1 : -1;
+    }
+    snapshot.paused = pause;
+}
+
+/* Return true if the key 'key' of the DB 'dbid' was already saved by the
+ * thread, or if it does not need to be saved at all.
+ *
+ * 如果键已经被后台线程保存过，或者根本不需要保存，那么返回真。 */
+static int snapshotKeyVisited(int dbid, sds key) {
+    dict *d = snapshot.dicts[dbid];
+    unsigned int h;
+    int table;
+
+    if (dbid < snapshot.cur_db || d == NULL || snapshot.detached[dbid])
+        return 1;
+    if (dbid > snapshot.cur_db || key == NULL) return 0;
+
+    // 查找键所在的哈希表和桶，并和游标进行对比
+    h = dictHashKey(d,key);
+    for (table = 0; table <= 1; table++) {
+        unsigned long idx;
+        dictEntry *de;
+
+        if (d->ht[table].size == 0) continue;
+        idx = h & d->ht[table].sizemask;
+        for (de = d->ht[table].table[idx]; de; de = de->next) {
+            if (dictCompareKeys(d,key,de->key))
+                return table < snapshot.cur_table ||
+                       (table == snapshot.cur_table && idx < snapshot.cur_idx);
+        }
+        if (!dictIsRehashing(d)) break;
+    }
+    return 0;
+}
+
+/* Serialize a key of the DB 'dbid' into 'r', with its expire if any. The
+ * expire is looked up in the table of the snapshot, that is no longer the
+ * one of the DB if it was detached. */
+static int snapshotSaveEntry(rio *r, int dbid, sds keystr, robj *val) {
+    dictEntry *de = dictFind(snapshot.expires[dbid],keystr);
+    robj key;
+
+    initStaticStringObject(key,keystr);
+    return rdbSaveKeyValuePair(r,&key,val,
+                               de ? dictGetSignedIntegerVal(de) : -1,
+                               snapshot.now);
+}
+
+/* Serialize up to 'count' buckets of the current DB into 'r', a buffer
+ * rio, skipping the keys in the skip set, and advance the cursor. The lock
+ * must be held. The function also returns once SNAPSHOT_BATCH_BYTES were
+ * added to the buffer.
+ *
+ * 将当前数据库中最多 count 个桶序列化到 r 中，并向前移动游标，
+ * 写入的数据超过 SNAPSHOT_BATCH_BYTES 字节时也会返回。
+ *
+ * Returns 1 when all the buckets of the current DB were visited. */
+static int snapshotVisitBuckets(rio *r, unsigned long count) {
+    int j = snapshot.cur_db;
+    dict *d = snapshot.dicts[j];
+    size_t limit = sdslen(r->io.buffer.ptr) + SNAPSHOT_BATCH_BYTES;
+
+    while(count-- && sdslen(r->io.buffer.ptr) < limit) {
+        dictht *ht = &d->ht[snapshot.cur_table];
+        dictEntry *de;
+
+        // 当前哈希表已经访问完毕
+        if (snapshot.cur_idx >= ht->size) {
+            if (snapshot.cur_table == 1) return 1;
+            snapshot.cur_table = 1;
+            snapshot.cur_idx = 0;
+            continue;
+        }
+
+        for (de = ht->table[snapshot.cur_idx]; de; de = de->next) {
+            sds keystr = dictGetKey(de);
+
+            if (dictFind(snapshot.skip[j],keystr)) continue;
+            if (snapshotSaveEntry(r,j,keystr,dictGetVal(de)) == -1) return -1;
+        }
+        snapshot.cur_idx++;
+    }
+    return 0;
+}
+
+/* Move the cursor to the first bucket of the next DB. */
+static void snapshotNextDb(void) {
+    snapshot.cur_db++;
+    snapshot.cur_table = 0;
+    snapshot.cur_idx = 0;
+}
+
+/* ----------------------------- Main thread API --------------------------- */
+
+/* Serialize the current value of 'key' into the pre-image buffer of 'db'
+ * if the thread did not save the key yet, and make sure the thread will
+ * not save it later. Must be called, with the keyspace lock held, before
+ * any change to the key.
+ *
+ * 如果后台线程还没有保存这个键，那么将键的当前值序列化到前像缓冲区中，
+ * 并确保后台线程之后不会再保存它。
+ * 必须在持有键空间锁的情况下，在修改键之前调用。 */
+void snapshotPreserveKey(redisDb *db, robj *key) {
+    dictEntry *de;
+
+    if (!server.rdb_snapshot_in_progress) return;
+    if (snapshotKeyVisited(db->id,key->ptr)) return;
+    if (dictFind(snapshot.skip[db->id],key->ptr)) return;
+
+    if ((de = dictFind(db->dict,key->ptr)) != NULL) {
+        rio r;
+
+        rioInitWithBuffer(&r,snapshot.preimage[db->id]);
+        snapshotSaveEntry(&r,db->id,dictGetKey(de),dictGetVal(de));
+        snapshot.preimage[db->id] = r.io.buffer.ptr;
+        snapshot.preimage_keys++;
+    }
+    dictAdd(snapshot.skip[db->id],sdsdup(key->ptr),NULL);
+}
+
+/* Give the DB 'db' new empty hash tables, leaving the old ones to the
+ * thread if it did not finish saving the DB yet. Called with the keyspace
+ * lock held before the DB is emptied. The detached tables are released by
+ * snapshotCleanup().
+ *
+ * 如果后台线程还没有保存完数据库 db ，那么将数据库原来的哈希表交给后台线程，
+ * 并为数据库创建新的空哈希表。在清空数据库之前调用。 */
+void snapshotDetachDb(redisDb *db) {
+    int j = db->id;
+
+    if (!server.rdb_snapshot_in_progress) return;
+    if (snapshotKeyVisited(j,NULL)) return;
+
+    snapshot.detached[j] = 1;
+    db->dict = dictCreate(&dbDictType,NULL);
+    db->expires = dictCreate(&keyptrDictType,NULL);
+}
+
+/* Detach all the DBs the thread did not finish yet. Must be called, with
+ * the keyspace lock held, before emptyDb() by code that empties the
+ * keyspace outside of call(), such as the replication full sync (DEBUG
+ * RELOAD is handled by snapshotBeforeCommand()). Otherwise the thread
+ * would resume its cursor on the rebuilt tables, and save keys twice or
+ * keys that are not part of the snapshot.
+ *
+ * 分离所有后台线程尚未完成的数据库。
+ * 在命令之外清空键空间的代码（比如复制）
+ * 必须在调用 emptyDb() 之前，在持有键空间锁的情况下调用这个函数。 */
+void snapshotDetachAll(void) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) snapshotDetachDb(server.db+j);
+}
+
+/* Preserve 'key' of 'db' once, and queue it in 'todo' so that the clients
+ * blocked on it are examined. */
+// 保存键，并将它加入待检查的列表中
+static void snapshotPreserveChained(list *todo, dict *seen, redisDb *db,
+                                    robj *key)
+{
+    readyList *rl;
+    sds id = sdscatprintf(sdsempty(),"%d:",db->id);
+
+    // 以 "数据库号码:键" 的形式记录已经处理过的键
+    id = sdscatsds(id,key->ptr);
+    if (dictAdd(seen,id,NULL) != DICT_OK) {
+        sdsfree(id);
+        return;
+    }
+    snapshotPreserveKey(db,key);
+    rl = zmalloc(sizeof(*rl));
+    rl->db = db;
+    rl->key = key;
+    listAddNodeTail(todo,rl);
+}
+
+/* Preserve the keys that handleClientsBlockedOnLists() is going to modify.
+ * Called with the keyspace lock held before serving the blocked clients.
+ *
+ * 保存 handleClientsBlockedOnLists() 将要修改的键。
+ *
+ * Besides the ready keys, the target of every BRPOPLPUSH client blocked on
+ * them receives an element. Such a client may have blocked before the
+ * snapshot started, so its target was not preserved by the command. A push
+ * to a target can in turn serve the clients blocked on it, so the targets
+ * are followed transitively. */
+void snapshotPreserveReadyKeys(void) {
+    dict *seen = dictCreate(&snapshotKeysDictType,NULL);
+    list *todo = listCreate();
+    listIter li;
+    listNode *ln;
+
+    listSetFreeMethod(todo,zfree);
+    listRewind(server.ready_keys,&li);
+    while((ln = listNext(&li))) {
+        readyList *rl = ln->value;
+
+        snapshotPreserveChained(todo,seen,rl->db,rl->key);
+    }
+
+    /* 'todo' holds the (db,key) pairs whose blocked clients were not
+     * examined yet. The keys are owned by the ready list or by the
+     * blocked clients, that are not released meanwhile. */
+    while((ln = listFirst(todo)) != NULL) {
+        readyList *rl = ln->value;
+        list *clients = dictFetchValue(rl->db->blocking_keys,rl->key);
+
+        if (clients) {
+            listIter ci;
+            listNode *cn;
+
+            listRewind(clients,&ci);
+            while((cn = listNext(&ci))) {
+                redisClient *receiver = cn->value;
+
+                if (receiver->bpop.target)
+                    snapshotPreserveChained(todo,seen,rl->db,
+                                            receiver->bpop.target);
+            }
+        }
+        listDelNode(todo,ln);
+    }
+    listRelease(todo);
+    dictRelease(seen);
+}
+
+/* Called by call() with the keyspace lock held, before the command is
+ * executed: preserve the keys the command may modify. Read only commands
+ * are also considered for keys with an expire, since looking up an expired
+ * key deletes it. */
+void snapshotBeforeCommand(redisClient *c) {
+    int *keys, numkeys, j;
+    int write = c->cmd->flags & REDIS_CMD_WRITE;
+
+    // 清空数据库的命令，将后台线程还没保存完的数据库分离出来
+    if (c->cmd->proc == flushallCommand) {
+        snapshotDetachAll();
+        return;
+    } else if (c->cmd->proc == flushdbCommand) {
+        snapshotDetachDb(c->db);
+        return;
+    } else if (c->cmd->proc == debugCommand && c->argc >= 2 &&
+               (!strcasecmp(c->argv[1]->ptr,"reload") ||
+                !strcasecmp(c->argv[1]->ptr,"loadaof")))
+    {
+        // DEBUG RELOAD 和 DEBUG LOADAOF 会清空并重新载入整个键空间
+        snapshotDetachAll();
+        return;
+    }
+
+    keys = getKeysFromCommand(c->cmd,c->argv,c->argc,&numkeys);
+    for (j = 0; j < numkeys; j++) {
+        robj *key = c->argv[keys[j]];
+
+        if (!write && dictFind(c->db->expires,key->ptr) == NULL) continue;
+        snapshotPreserveKey(c->db,key);
+    }
+    getKeysFreeResult(keys);
+
+    /* MOVE also writes the key in the target DB. */
+    // MOVE 还会修改目标数据库中的键
+    if (c->cmd->proc == moveCommand) {
+        long long dbid;
+
+        if (getLongLongFromObject(c->argv[2],&dbid) == REDIS_OK &&
+            dbid >= 0 && dbid < server.dbnum)
+            snapshotPreserveKey(server.db+dbid,c->argv[1]);
+    }
+
+    /* MIGRATE has no key specification in the command table, but deletes
+     * the key (argv[3]) once it was transferred. */
+    // MIGRATE 在命令表中没有键参数，但迁移成功之后会删除键
+    if (c->cmd->proc == migrateCommand && c->argc > 3)
+        snapshotPreserveKey(c->db,c->argv[3]);
+}
+
+/* Start a fork-less snapshot of the dataset into 'filename'.
+ *
+ * 开始一次不使用 fork 的快照，将数据集保存到 filename 中。 */
+int snapshotStart(char *filename) {
+    pthread_attr_t attr;
+    size_t stacksize;
+    int j;
+
+    if (server.rdb_snapshot_in_progress) return REDIS_ERR;
+
+    snprintf(snapshot.tmpfile,256,"temp-snapshot-%d.rdb", (int) getpid());
+    snapshot.fp = fopen(snapshot.tmpfile,"w");
+    if (!snapshot.fp) {
+        redisLog(REDIS_WARNING, "Failed opening .rdb for saving: %s",
+            strerror(errno));
+        return REDIS_ERR;
+    }
+
+    snapshot.filename = sdsnew(filename);
+    snapshot.now = mstime();
+    snapshot.dicts = zmalloc(sizeof(dict*)*server.dbnum);
+    snapshot.expires = zmalloc(sizeof(dict*)*server.dbnum);
+    snapshot.detached = zmalloc(sizeof(int)*server.dbnum);
+    snapshot.dbsize = zmalloc(sizeof(unsigned long)*server.dbnum);
+    snapshot.expsize = zmalloc(sizeof(unsigned long)*server.dbnum);
+    snapshot.skip = zmalloc(sizeof(dict*)*server.dbnum);
+    snapshot.preimage = zmalloc(sizeof(sds)*server.dbnum);
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        snapshot.dbsize[j] = dictSize(db->dict);
+        snapshot.expsize[j] = dictSize(db->expires);
+        snapshot.dicts[j] = snapshot.dbsize[j] ? db->dict : NULL;
+        snapshot.expires[j] = snapshot.dbsize[j] ? db->expires : NULL;
+        snapshot.detached[j] = 0;
+        snapshot.skip[j] = dictCreate(&snapshotKeysDictType,NULL);
+        snapshot.preimage[j] = sdsempty();
+    }
+    snapshot.cur_db = 0;
+    snapshot.cur_table = 0;
+    snapshot.cur_idx = 0;
+    snapshot.preimage_keys = 0;
+    snapshot.done = 0;
+    snapshot.abort = 0;
+    snapshot.status = REDIS_ERR;
+    snapshot.paused = 0;
+    snapshotPauseRehashing(1);
+
+    server.rdb_snapshot_in_progress = 1;
+    updateDictResizePolicy();
+    server.dirty_before_bgsave = server.dirty;
+    server.lastbgsave_try = time(NULL);
+
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr,&stacksize);
+    if (!stacksize) stacksize = 1; /* The world is full of Solaris Fixes */
+    while (stacksize < SNAPSHOT_THREAD_STACK_SIZE) stacksize *= 2;
+    pthread_attr_setstacksize(&attr, stacksize);
+
+    if (pthread_create(&snapshot.thread,&attr,snapshotThreadMain,NULL) != 0) {
+        redisLog(REDIS_WARNING,"Can't save in background: thread: %s",
+            strerror(errno));
+        fclose(snapshot.fp);
+        unlink(snapshot.tmpfile);
+        snapshotPauseRehashing(0);
+        server.rdb_snapshot_in_progress = 0;
+        updateDictResizePolicy();
+        server.lastbgsave_status = REDIS_ERR;
+        return REDIS_ERR;
+    }
+
+    redisLog(REDIS_NOTICE,"Background saving started by a snapshot thread");
+    server.rdb_save_time_start = time(NULL);
+    return REDIS_OK;
+}
+
+/* Release the snapshot state once the thread exited. */
+static void snapshotCleanup(void) {
+    int j;
+
+    snapshotPauseRehashing(0);
+    for (j = 0; j < server.dbnum; j++) {
+        // 释放被 FLUSHALL 或者 FLUSHDB 分离出来的哈希表
+        if (snapshot.detached[j]) {
+            dictRelease(snapshot.dicts[j]);
+            dictRelease(snapshot.expires[j]);
+        }
+        dictRelease(snapshot.skip[j]);
+        sdsfree(snapshot.preimage[j]);
+    }
+    zfree(snapshot.dicts);
+    zfree(snapshot.expires);
+    zfree(snapshot.detached);
+    zfree(snapshot.dbsize);
+    zfree(snapshot.expsize);
+    zfree(snapshot.skip);
+    zfree(snapshot.preimage);
+    sdsfree(snapshot.filename);
+    server.rdb_snapshot_in_progress = 0;
+    updateDictResizePolicy();
+}
+
+/* Called by serverCron(): if the snapshot thread terminated move the file
+ * to its final destination and handle the end of the BGSAVE.
+ *
+ * 由 serverCron() 调用，如果快照线程已经结束，
+ * 那么对文件进行改名，并处理 BGSAVE 的完成。 */
+void snapshotCheckDone(void) {
+    int done, status;
+
+    if (!server.rdb_snapshot_in_progress) return;
+
+    pthread_mutex_lock(&snapshot_mutex);
+    done = snapshot.done;
+    pthread_mutex_unlock(&snapshot_mutex);
+    if (!done) return;
+
+    pthread_join(snapshot.thread,NULL);
+    status = snapshot.status;
+    if (status == REDIS_OK && rename(snapshot.tmpfile,snapshot.filename) == -1) {
+        redisLog(REDIS_WARNING,"Error moving temp DB file on the final destination: %s", strerror(errno));
+        status = REDIS_ERR;
+    }
+    if (status != REDIS_OK) unlink(snapshot.tmpfile);
+    if (snapshot.preimage_keys)
+        redisLog(REDIS_NOTICE,
+            "RDB: %lld keys saved by the main thread before being modified",
+            snapshot.preimage_keys);
+    snapshotCleanup();
+    backgroundSaveDoneHandler(status == REDIS_OK ? 0 : 1, 0);
+}
+
+/* Stop the snapshot thread and remove its temp file, used on shutdown. */
+// 停止快照线程，并删除临时文件
+void snapshotAbort(void) {
+    int depth = snapshot.lock_depth;
+
+    if (!server.rdb_snapshot_in_progress) return;
+
+    /* We may be called from a command, with the lock already held: release
+     * it so that the thread can notice the abort flag and exit. */
+    if (depth == 0) pthread_mutex_lock(&snapshot_mutex);
+    snapshot.abort = 1;
+    pthread_mutex_unlock(&snapshot_mutex);
+    pthread_join(snapshot.thread,NULL);
+    if (depth != 0) pthread_mutex_lock(&snapshot_mutex);
+
+    unlink(snapshot.tmpfile);
+    snapshotCleanup();
+}
+
+/* ------------------------------ Snapshot thread -------------------------- */
+
+/* Write the sds 's' to the file and free it. */
+static int snapshotWriteBuffer(rio *rdb, sds s) {
+    int retval = 0;
+
+    if (sdslen(s) && rioWrite(rdb,s,sdslen(s)) == 0) retval = -1;
+    sdsfree(s);
+    return retval;
+}
+
+void *snapshotThreadMain(void *arg) {
+    char magic[10];
+    uint64_t cksum;
+    sigset_t sigset;
+    rio rdb;
+    int j;
+
+    REDIS_NOTUSED(arg);
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        redisLog(REDIS_WARNING,
+            "Warning: can't mask SIGALRM in snapshot thread: %s",
+            strerror(errno));
+
+    rioInitWithFile(&rdb,snapshot.fp);
+    if (server.rdb_checksum)
+        rdb.update_cksum = rioGenericUpdateChecksum;
+
+    // 写入 RDB 版本号
+    snprintf(magic,sizeof(magic),"REDIS%04d",REDIS_RDB_VERSION);
+    if (rioWrite(&rdb,magic,9) == 0) goto werr;
+
+    for (j = 0; j < server.dbnum; j++) {
+        int finished = 0;
+
+        // 跳过快照开始时为空的数据库
+        pthread_mutex_lock(&snapshot_mutex);
+        if (snapshot.dicts[j] == NULL) {
+            if (snapshot.cur_db == j) snapshotNextDb();
+            pthread_mutex_unlock(&snapshot_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&snapshot_mutex);
+
+        // 写入 DB 选择器和数据库的大小
+        if (rdbSaveType(&rdb,REDIS_RDB_OPCODE_SELECTDB) == -1) goto werr;
+        if (rdbSaveLen(&rdb,j) == -1) goto werr;
+        if (rdbSaveType(&rdb,REDIS_RDB_OPCODE_RESIZEDB) == -1) goto werr;
+        if (rdbSaveLen(&rdb,snapshot.dbsize[j] < REDIS_RDB_LENERR ?
+            snapshot.dbsize[j] : REDIS_RDB_LENERR-1) == -1) goto werr;
+        if (rdbSaveLen(&rdb,snapshot.expsize[j] < REDIS_RDB_LENERR ?
+            snapshot.expsize[j] : REDIS_RDB_LENERR-1) == -1) goto werr;
+
+        /* Serialize a batch of buckets at a time with the lock held, then
+         * write it, with the pre-images produced meanwhile by the main
+         * thread, after releasing the lock. */
+        // 每次持有锁序列化一批桶，然后在释放锁之后写入文件
+        while (!finished) {
+            sds pre;
+            rio r;
+
+            rioInitWithBuffer(&r,sdsempty());
+            pthread_mutex_lock(&snapshot_mutex);
+            if (snapshot.abort) {
+                pthread_mutex_unlock(&snapshot_mutex);
+                sdsfree(r.io.buffer.ptr);
+                goto werr;
+            }
+            if (snapshot.cur_db > j) {
+                finished = 1;
+            } else {
+                finished = snapshotVisitBuckets(&r,SNAPSHOT_BATCH_BUCKETS);
+                if (finished == 1) snapshotNextDb();
+            }
+            pre = snapshot.preimage[j];
+            snapshot.preimage[j] = sdsempty();
+            pthread_mutex_unlock(&snapshot_mutex);
+
+            if (finished == -1) {
+                sdsfree(r.io.buffer.ptr);
+                sdsfree(pre);
+                goto werr;
+            }
+            if (snapshotWriteBuffer(&rdb,r.io.buffer.ptr) == -1) {
+                sdsfree(pre);
+                goto werr;
+            }
+            if (snapshotWriteBuffer(&rdb,pre) == -1) goto werr;
+        }
+    }
+
+    // 写入 EOF 代码和校验和
+    if (rdbSaveType(&rdb,REDIS_RDB_OPCODE_EOF) == -1) goto werr;
+    cksum = rdb.cksum;
+    memrev64ifbe(&cksum);
+    if (rioWrite(&rdb,&cksum,8) == 0) goto werr;
+
+    // 冲洗缓存，确保数据已写入磁盘
+    if (fflush(snapshot.fp) == EOF) goto werr;
+    if (fsync(fileno(snapshot.fp)) == -1) goto werr;
+    if (fclose(snapshot.fp) == EOF) {
+        snapshot.fp = NULL;
+        goto werr;
+    }
+
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot.status = REDIS_OK;
+    snapshot.done = 1;
+    pthread_mutex_unlock(&snapshot_mutex);
+    return NULL;
+
+werr:
+    if (!snapshot.abort)
+        redisLog(REDIS_WARNING,"Write error saving DB on disk: %s",
+            strerror(errno));
+    if (snapshot.fp) fclose(snapshot.fp);
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot.status = REDIS_ERR;
+    snapshot.done = 1;
+    pthread_mutex_unlock(&snapshot_mutex);
+    return NULL;
+}